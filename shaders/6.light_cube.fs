@@ -1,7 +1,18 @@
 #version 330 core
 out vec4 FragColor;
 
+in vec3 Color;
+
+uniform bool pointSprites;
+
 void main()
 {
-    FragColor = vec4(1.0); // set all 4 vector values to 1.0
+    // round stars: drop the corners of the point sprite square
+    if (pointSprites)
+    {
+        vec2 p = gl_PointCoord * 2.0 - 1.0;
+        if (dot(p, p) > 1.0)
+            discard;
+    }
+    FragColor = vec4(Color, 1.0); // white for lamps, the star color for point sprites
 }
\ No newline at end of file
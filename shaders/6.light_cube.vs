@@ -1,11 +1,29 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor; // per-star color, only read for point sprites
+layout (location = 3) in mat4 aInstanceModel; // per-instance model matrix (locations 3..6), used when 'instanced' is set
+
+out vec3 Color;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool instanced;
+
+// starfield: the whole star buffer is drawn as GL_POINTS in one call
+uniform bool pointSprites;
+uniform float pointSize;   // world-space diameter of a star
+uniform float pointScale;  // pixels per world unit at distance 1 (viewport height * projection[1][1] / 2)
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = projection * view * (instanced ? aInstanceModel : model) * vec4(aPos, 1.0);
+    if (pointSprites)
+    {
+        Color = aColor;
+        // keep far stars at least a pixel and a half wide so they don't flicker out
+        gl_PointSize = max(pointSize * pointScale / gl_Position.w, 1.5);
+    }
+    else
+        Color = vec3(1.0);
+}
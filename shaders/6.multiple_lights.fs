@@ -7,9 +7,10 @@ struct Material {
     float shininess;
 }; 
 
+// the light structs live in a std140 uniform block, mirrored on the C++ side by LightRigStd140 (light_rig.h);
+// each scalar sits in the padding slot after a vec3, so keep the member order in sync with the C++ structs
 struct DirLight {
     vec3 direction;
-	
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
@@ -17,63 +18,141 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;
-	
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
 };
 
 #define NR_POINT_LIGHTS 4
 
+layout (std140) uniform LightRig {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in float ViewDepth;
 
 uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
 uniform Material material;
 
+// clustered forward mode (light_clusters.h): the point lights come from buffer textures instead of
+// pointLights[], and each fragment only evaluates the lights assigned to its cluster
+uniform bool clustered;
+uniform samplerBuffer clusterLights;   // 4 texels per light in PointLight order, range in the last slot
+uniform usamplerBuffer clusterGrid;    // per cluster: (offset, count) into clusterIndices
+uniform usamplerBuffer clusterIndices;
+uniform uvec3 clusterDims;
+uniform vec2 clusterTileSize;          // tile size in pixels
+uniform vec2 clusterDepthParams;       // depth slice = log(ViewDepth) * x - y
+
+// shadow maps (shadows.h): a static and a dynamic layer per light, both tested and multiplied.
+// Samplers can only be indexed with constants here, so PointShadowTap picks the light with an if-chain.
+uniform bool shadows;
+uniform int shadowPcf;                 // filter radius: (2r+1)^2 taps for the directional light, 20 for point lights when r > 0
+uniform sampler2DShadow dirShadow[2];  // static, dynamic
+uniform mat4 dirShadowMatrix;          // world to shadow map [0, 1]
+uniform vec2 dirShadowParams;          // texel size, normal offset in world units
+uniform samplerCubeShadow pointShadow[8]; // 0-3 static, 4-7 dynamic
+uniform vec3 pointShadowParams;        // near, far, texel size at unit distance
+
 // function prototypes
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcClusterLights(vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcStarlight(vec3 normal);
+vec3 CalcBakedLights(vec3 normal, vec3 fragPos);
+vec3 CalcDirSpecular(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointSpecular(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+float DirShadow(vec3 fragPos, vec3 normal);
+float PointShadow(int light, vec3 fragPos, vec3 normal);
 
-// make star
-#define NR_STARS 500
-struct StarLight {
-    vec3 position;
-    vec3 color;
-};
-uniform StarLight starLights[NR_STARS];
+// starfield irradiance as order-2 spherical harmonics (star_irradiance.h), with the
+// cosine convolution already folded into the coefficients on the CPU
+uniform vec3 starlightSH[9];
+
+// irradiance volume (irradiance_volume.h): the static lights' ambient and diffuse baked into ambient-cube
+// probes, the grids of the faces +x, -x, +y, -y, +z, -z stacked along z; p * scale + offset is in probe texels
+uniform sampler3D irradianceVolume;
+uniform vec3 irradianceVolumeScale;
+uniform vec3 irradianceVolumeOffset;
+uniform vec3 irradianceVolumeSize;     // probes per axis
 
+// Specialized variants (shader_variants.h) are this file with defines injected after #version: VARIANT,
+// plus DIR_LIGHT, POINT_LIGHTS, SPOT_LIGHT, CLUSTERED, STARLIGHT, SHADOWS and BAKED_LIGHTS fixing the light
+// setup at compile time. With BAKED_LIGHTS the directional and point lights only add their specular terms live.
+// Without them it is the uber-shader, which evaluates every light type and picks the point-light path
+// from the 'clustered' uniform at run time.
+#ifdef VARIANT
+// the material is sampled once per fragment in main() and shared by every light
+vec3 diffuseTexel;
+vec3 specularTexel;
+#define DIFFUSE_TEXEL diffuseTexel
+#define SPECULAR_TEXEL specularTexel
+// a constant, so the shadow lookups are compiled out rather than skipped; software rasterizers such as llvmpipe
+// run both sides of 'shadows ? ... : 1.0' for every fragment
+#define SHADOWS_ON bool(SHADOWS)
+#else
+#define DIFFUSE_TEXEL vec3(texture(material.diffuse, TexCoords))
+#define SPECULAR_TEXEL vec3(texture(material.specular, TexCoords))
+// the uber-shader keeps the run-time switch, so on llvmpipe it pays for the lookups with shadows off as well
+#define SHADOWS_ON shadows
+#endif
 
 void main()
 {    
     // properties
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
-    
+
+#ifdef VARIANT
+    diffuseTexel = vec3(texture(material.diffuse, TexCoords));
+    specularTexel = vec3(texture(material.specular, TexCoords));
+    vec3 result = vec3(0.0);
+#if BAKED_LIGHTS
+    result += CalcBakedLights(norm, FragPos);
+#if DIR_LIGHT
+    result += CalcDirSpecular(dirLight, norm, viewDir);
+#endif
+    for (int i = 0; i < POINT_LIGHTS; i++)
+        result += CalcPointSpecular(pointLights[i], norm, FragPos, viewDir);
+#else
+#if DIR_LIGHT
+    result += CalcDirLight(dirLight, norm, viewDir, SHADOWS_ON ? DirShadow(FragPos, norm) : 1.0);
+#endif
+#if CLUSTERED
+    result += CalcClusterLights(norm, FragPos, viewDir);
+#endif
+    for (int i = 0; i < POINT_LIGHTS; i++)
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, SHADOWS_ON ? PointShadow(i, FragPos, norm) : 1.0);
+#endif
+#if SPOT_LIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
+#if STARLIGHT
+    result += CalcStarlight(norm);
+#endif
+#else
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
     // For each phase, a calculate function is defined that calculates the corresponding color
@@ -81,25 +160,24 @@ void main()
     // this fragment's final color.
     // == =====================================================
     // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    vec3 result = CalcDirLight(dirLight, norm, viewDir, shadows ? DirShadow(FragPos, norm) : 1.0);
     // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+    if (clustered)
+        result += CalcClusterLights(norm, FragPos, viewDir);
+    else
+        for(int i = 0; i < NR_POINT_LIGHTS; i++)
+            result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, shadows ? PointShadow(i, FragPos, norm) : 1.0);
     // phase 3: spot light
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+    // phase 4: faint starlight from the whole starfield
+    result += CalcStarlight(norm);
+#endif
     
     FragColor = vec4(result, 1.0);
-
-    // add stars
-    for (int i = 0; i < NR_STARS; i++) {
-        vec3 lightDir = normalize(starLights[i].position - FragPos);
-        float diff = max(dot(norm, lightDir), 0.0);
-        result += starLights[i].color * diff * 0.2; // faint star effect
-}
 }
 
-// calculates the color when using a directional light.
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// calculates the color when using a directional light; shadow scales the diffuse and specular terms.
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -108,14 +186,16 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * DIFFUSE_TEXEL;
+    vec3 diffuse = light.diffuse * diff * DIFFUSE_TEXEL;
+    vec3 specular = light.specular * spec * SPECULAR_TEXEL;
+    diffuse *= shadow;
+    specular *= shadow;
     return (ambient + diffuse + specular);
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
@@ -127,12 +207,12 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * DIFFUSE_TEXEL;
+    vec3 diffuse = light.diffuse * diff * DIFFUSE_TEXEL;
+    vec3 specular = light.specular * spec * SPECULAR_TEXEL;
     ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
     return (ambient + diffuse + specular);
 }
 
@@ -153,11 +233,149 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.ambient * DIFFUSE_TEXEL;
+    vec3 diffuse = light.diffuse * diff * DIFFUSE_TEXEL;
+    vec3 specular = light.specular * spec * SPECULAR_TEXEL;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
+}
+
+// calculates the diffuse color the starfield adds, from its SH irradiance.
+vec3 CalcStarlight(vec3 n)
+{
+    vec3 irradiance = starlightSH[0] * 0.282095
+                    + starlightSH[1] * 0.488603 * n.y
+                    + starlightSH[2] * 0.488603 * n.z
+                    + starlightSH[3] * 0.488603 * n.x
+                    + starlightSH[4] * 1.092548 * n.x * n.y
+                    + starlightSH[5] * 1.092548 * n.y * n.z
+                    + starlightSH[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+                    + starlightSH[7] * 1.092548 * n.x * n.z
+                    + starlightSH[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+    // order-2 SH can ring slightly negative opposite a bright cluster of stars
+    return max(irradiance, 0.0) * DIFFUSE_TEXEL;
+}
+
+// calculates the ambient and diffuse color of the directional and point lights from the irradiance volume:
+// the three cube faces the normal leans towards, weighted by its squared components. Clamping to the outer
+// probes keeps the filter inside one face's grid.
+vec3 CalcBakedLights(vec3 normal, vec3 fragPos)
+{
+    vec3 texel = clamp(fragPos * irradianceVolumeScale + irradianceVolumeOffset, vec3(0.5), irradianceVolumeSize - 0.5);
+    vec3 uvw = texel / vec3(irradianceVolumeSize.xy, 6.0 * irradianceVolumeSize.z);
+    vec3 face = vec3(normal.x < 0.0 ? 1.0 : 0.0, normal.y < 0.0 ? 3.0 : 2.0, normal.z < 0.0 ? 5.0 : 4.0) / 6.0;
+    vec3 weight = normal * normal;
+    vec3 irradiance = weight.x * texture(irradianceVolume, vec3(uvw.xy, uvw.z + face.x)).rgb
+                    + weight.y * texture(irradianceVolume, vec3(uvw.xy, uvw.z + face.y)).rgb
+                    + weight.z * texture(irradianceVolume, vec3(uvw.xy, uvw.z + face.z)).rgb;
+    return irradiance * DIFFUSE_TEXEL;
+}
+
+// the specular term of CalcDirLight alone, for when its ambient and diffuse are baked.
+vec3 CalcDirSpecular(DirLight light, vec3 normal, vec3 viewDir)
+{
+    vec3 reflectDir = reflect(normalize(light.direction), normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    return light.specular * spec * SPECULAR_TEXEL;
+}
+
+// the specular term of CalcPointLight alone, for when its ambient and diffuse are baked.
+vec3 CalcPointSpecular(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 toLight = light.position - fragPos;
+    float distance = length(toLight);
+    vec3 reflectDir = reflect(-toLight / distance, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    return light.specular * spec * attenuation * SPECULAR_TEXEL;
+}
+
+// calculates the color of all point lights assigned to this fragment's cluster.
+vec3 CalcClusterLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    uint slice = uint(max(log(ViewDepth) * clusterDepthParams.x - clusterDepthParams.y, 0.0));
+    uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / clusterTileSize), slice), clusterDims - 1u);
+    uint cluster = (cell.z * clusterDims.y + cell.y) * clusterDims.x + cell.x;
+    uvec2 range = texelFetch(clusterGrid, int(cluster)).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        int base = 4 * index;
+        vec4 t0 = texelFetch(clusterLights, base);
+        vec4 t1 = texelFetch(clusterLights, base + 1);
+        vec4 t2 = texelFetch(clusterLights, base + 2);
+        vec4 t3 = texelFetch(clusterLights, base + 3);
+        PointLight light = PointLight(t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz);
+        // fade out towards the light's range so the cut-off at cluster borders is invisible
+        float d = length(light.position - fragPos) / t3.w;
+        float window = clamp(1.0 - d * d * d * d, 0.0, 1.0);
+        // the first NR_POINT_LIGHTS are the rig's lights, which are the ones with shadow maps
+        float shadow = SHADOWS_ON && index < NR_POINT_LIGHTS ? PointShadow(index, fragPos, normal) : 1.0;
+        result += CalcPointLight(light, normal, fragPos, viewDir, shadow) * window * window;
+    }
+    return result;
+}
+
+// fraction of the directional light reaching fragPos, both layers with a (2 * shadowPcf + 1)^2 box of
+// bilinear comparison taps; the point is pushed out along the normal so lit faces do not shadow themselves.
+float DirShadow(vec3 fragPos, vec3 normal)
+{
+    vec3 p = (dirShadowMatrix * vec4(fragPos + normal * dirShadowParams.y, 1.0)).xyz;
+    if (p.z > 1.0)
+        return 1.0;
+    float lit = 0.0;
+    for (int y = -shadowPcf; y <= shadowPcf; y++)
+        for (int x = -shadowPcf; x <= shadowPcf; x++)
+        {
+            vec3 tap = vec3(p.xy + vec2(x, y) * dirShadowParams.x, p.z);
+            lit += texture(dirShadow[0], tap) * texture(dirShadow[1], tap);
+        }
+    float side = float(2 * shadowPcf + 1);
+    return lit / (side * side);
+}
+
+// one comparison of point light 'light' against both layers; coord is the direction and reference depth
+float PointShadowTap(int light, vec4 coord)
+{
+    if (light == 0)
+        return texture(pointShadow[0], coord) * texture(pointShadow[4], coord);
+    if (light == 1)
+        return texture(pointShadow[1], coord) * texture(pointShadow[5], coord);
+    if (light == 2)
+        return texture(pointShadow[2], coord) * texture(pointShadow[6], coord);
+    return texture(pointShadow[3], coord) * texture(pointShadow[7], coord);
+}
+
+// directions for the point light filter: the cube's corners and edge midpoints
+const vec3 POINT_SHADOW_OFFSETS[20] = vec3[](
+    vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
+    vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+    vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+    vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+    vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+);
+
+// fraction of point light 'light' reaching fragPos; the cube faces store perspective depth, so the reference
+// is the same projection applied to the distance along the face's axis
+float PointShadow(int light, vec3 fragPos, vec3 normal)
+{
+    vec3 toFrag = fragPos - pointLights[light].position;
+    float texel = pointShadowParams.z * max(max(abs(toFrag.x), abs(toFrag.y)), abs(toFrag.z));
+    toFrag += normal * 1.5 * texel;
+    float axis = max(max(abs(toFrag.x), abs(toFrag.y)), abs(toFrag.z));
+    float n = pointShadowParams.x, f = pointShadowParams.y;
+    if (axis >= f)
+        return 1.0;
+    float depth = 0.5 * ((f + n) / (f - n) - 2.0 * f * n / ((f - n) * axis)) + 0.5;
+    if (shadowPcf == 0)
+        return PointShadowTap(light, vec4(toFrag, depth));
+    float lit = 0.0;
+    float radius = float(shadowPcf) * texel;
+    for (int i = 0; i < 20; i++)
+        lit += PointShadowTap(light, vec4(toFrag + POINT_SHADOW_OFFSETS[i] * radius, depth));
+    return lit / 20.0;
 }
\ No newline at end of file
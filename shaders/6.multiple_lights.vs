@@ -2,20 +2,26 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aInstanceModel; // per-instance model matrix (locations 3..6), used when 'instanced' is set
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out float ViewDepth; // distance along the view axis, picks the depth slice in clustered mode
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform bool instanced;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    mat4 world = instanced ? aInstanceModel : model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(world))) * aNormal;  
     TexCoords = aTexCoords;
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    vec4 viewSpace = view * vec4(FragPos, 1.0);
+    ViewDepth = -viewSpace.z;
+    gl_Position = projection * viewSpace;
 }
\ No newline at end of file
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aInstanceModel; // per-instance model matrix (locations 3..6), every shadow caster comes from the arena
+
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * aInstanceModel * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+uniform vec2 uvScale;    // the lower-left part of image that holds this frame
+uniform vec2 texelSize;  // one texel of image
+uniform float sharpness; // 0: plain bilinear, 1: full edge-aware sharpen
+
+// taps stay inside the drawn part; the rest of the target holds older, larger frames
+vec3 Tap(vec2 uv)
+{
+    return texture(image, clamp(uv, 0.5 * texelSize, uvScale - 0.5 * texelSize)).rgb;
+}
+
+void main()
+{
+    vec2 uv = TexCoords * uvScale;
+    vec3 color = Tap(uv);
+    if (sharpness > 0.0)
+    {
+        // edge-aware sharpen (after contrast-adaptive sharpening): a negative-lobed cross of the neighbours one
+        // source texel away. Its weight shrinks as the neighbourhood nears black or white, so strong edges don't
+        // overshoot and ring, while soft detail blurred by the upscale gets its contrast back.
+        vec3 n = Tap(uv + vec2(0.0, texelSize.y));
+        vec3 s = Tap(uv - vec2(0.0, texelSize.y));
+        vec3 e = Tap(uv + vec2(texelSize.x, 0.0));
+        vec3 w = Tap(uv - vec2(texelSize.x, 0.0));
+        vec3 lo = min(color, min(min(n, s), min(e, w)));
+        vec3 hi = max(color, max(max(n, s), max(e, w)));
+        vec3 amount = sqrt(clamp(min(lo, 1.0 - hi) / max(hi, vec3(1e-4)), 0.0, 1.0));
+        vec3 weight = -amount * 0.1 * sharpness;
+        color = clamp((color + (n + s + e + w) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);
+    }
+    FragColor = vec4(color, 1.0);
+}
\ No newline at end of file
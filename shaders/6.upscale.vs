@@ -0,0 +1,9 @@
+#version 330 core
+out vec2 TexCoords;
+
+// one triangle that covers the screen, from gl_VertexID alone: texture coordinates (0,0), (2,0) and (0,2)
+void main()
+{
+    TexCoords = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(TexCoords * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef BENCHMARK_REPORT_H
+#define BENCHMARK_REPORT_H
+
+#include "headless.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Benchmark report
+// ----------------
+// What one deterministic benchmark run measured, as a single JSON object so runs can be diffed and
+// tracked by scripts. Frame times are wall clock after glFinish; draw calls and triangles are counted
+// by the renderer per frame (stars are points and not counted as triangles).
+
+struct BenchmarkReport {
+    // configuration
+    std::string renderer;
+    std::string gearMode;
+    std::string cameraPath; // file name, or "orbit" for the scripted default
+    int width = 0, height = 0; // the output framebuffer as rendered in the last measured frame, not the requested size
+    unsigned int warmupFrames = 0;
+    unsigned int gears = 0, teeth = 0;
+    unsigned int pointLights = 0;
+    bool clustered = false;
+    unsigned int stars = 0;
+
+    // startup, in ms since main(); -1 when it never happened
+    double timeToFirstFrameMs = -1.0;
+    double timeToTexturesMs = -1.0;
+
+    // per measured frame
+    FrameTimeStats frames;
+    std::vector<unsigned int> drawCalls;
+    std::vector<unsigned int> triangles;
+
+    void AddFrame(double ms, unsigned int frameDrawCalls, unsigned int frameTriangles)
+    {
+        frames.frameMs.push_back(ms);
+        drawCalls.push_back(frameDrawCalls);
+        triangles.push_back(frameTriangles);
+    }
+
+    // writes to path, or to stdout when path is "-"
+    bool Write(const std::string& path) const
+    {
+        FILE* file = path == "-" ? stdout : std::fopen(path.c_str(), "w");
+        if (!file) {
+            std::printf("Failed to write benchmark report %s\n", path.c_str());
+            return false;
+        }
+        std::fprintf(file, "{\n");
+        std::fprintf(file, "  \"renderer\": \"%s\",\n", Escaped(renderer).c_str());
+        std::fprintf(file, "  \"resolution\": [%d, %d],\n", width, height);
+        std::fprintf(file, "  \"frames\": %zu,\n", frames.frameMs.size());
+        std::fprintf(file, "  \"warmup_frames\": %u,\n", warmupFrames);
+        std::fprintf(file, "  \"camera_path\": \"%s\",\n", Escaped(cameraPath).c_str());
+        std::fprintf(file, "  \"gear_mode\": \"%s\",\n", Escaped(gearMode).c_str());
+        std::fprintf(file, "  \"gears\": %u,\n", gears);
+        std::fprintf(file, "  \"teeth\": %u,\n", teeth);
+        std::fprintf(file, "  \"point_lights\": %u,\n", pointLights);
+        std::fprintf(file, "  \"clustered\": %s,\n", clustered ? "true" : "false");
+        std::fprintf(file, "  \"stars\": %u,\n", stars);
+        std::fprintf(file, "  \"time_to_first_frame_ms\": %.2f,\n", timeToFirstFrameMs);
+        std::fprintf(file, "  \"time_to_textures_loaded_ms\": %.2f,\n", timeToTexturesMs);
+        std::fprintf(file, "  \"frame_ms\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+            frames.Mean(), frames.Percentile(0.0), frames.Percentile(50.0), frames.Percentile(95.0),
+            frames.Percentile(99.0), frames.Percentile(100.0));
+        std::fprintf(file, "  \"draw_calls_per_frame\": {\"mean\": %.1f, \"min\": %u, \"max\": %u},\n",
+            Mean(drawCalls), Min(drawCalls), Max(drawCalls));
+        std::fprintf(file, "  \"triangles_per_frame\": {\"mean\": %.1f, \"min\": %u, \"max\": %u}\n",
+            Mean(triangles), Min(triangles), Max(triangles));
+        std::fprintf(file, "}\n");
+        if (file != stdout) {
+            std::fclose(file);
+            std::printf("Benchmark report written to %s\n", path.c_str());
+        }
+        return true;
+    }
+
+private:
+    static std::string Escaped(const std::string& s)
+    {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if ((unsigned char)c >= 0x20)
+                out += c;
+        }
+        return out;
+    }
+
+    static double Mean(const std::vector<unsigned int>& v)
+    {
+        double sum = 0.0;
+        for (unsigned int x : v)
+            sum += x;
+        return v.empty() ? 0.0 : sum / v.size();
+    }
+    static unsigned int Min(const std::vector<unsigned int>& v) { return v.empty() ? 0 : *std::min_element(v.begin(), v.end()); }
+    static unsigned int Max(const std::vector<unsigned int>& v) { return v.empty() ? 0 : *std::max_element(v.begin(), v.end()); }
+};
+
+#endif
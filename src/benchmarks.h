@@ -0,0 +1,128 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gear_train.h"
+#include "light_clusters.h"
+#include "star_irradiance.h"
+#include "starfield.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Headless benchmarks selected from the command line (see main). None of them need a window or
+// a GL context; each prints one line per configuration so runs can be diffed.
+
+inline double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// --bench-clusters: CPU light assignment time and cluster occupancy as the point-light count grows
+inline void RunClusterBenchmark()
+{
+    const unsigned int counts[] = { 4, 64, 256, 1024, 4096, 16384 };
+    const int iterations = 20;
+
+    ClusterConfig config;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, config.nearZ, config.farZ);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 12.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    ThreadPool pool;
+    LightClusterGrid clusters;
+    clusters.Configure(config, projection);
+
+    std::printf("cluster grid %ux%ux%u, %d iterations, %u threads\n", config.x, config.y, config.z, iterations, pool.Size());
+    std::printf("%8s %8s %12s %14s %18s %10s\n", "lights", "threads", "assign ms", "avg/cluster", "avg/occupied", "max");
+    for (unsigned int count : counts) {
+        // lights spread through the gear area and a little beyond it
+        std::vector<ClusterPointLight> lights = ScatterPointLights(count, glm::vec3(-10.0f, -6.0f, -4.0f), glm::vec3(8.0f, 6.0f, 4.0f));
+        // single-threaded first, then on the pool (skipped when the pool has no extra workers)
+        for (int threaded = 0; threaded < (pool.Size() > 1 ? 2 : 1); threaded++) {
+            ThreadPool* p = threaded ? &pool : nullptr;
+            clusters.Assign(lights, view, p); // warm-up, sizes the buffers
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; i++)
+                clusters.Assign(lights, view, p);
+            double ms = ElapsedMs(start) / iterations;
+            std::printf("%8u %8u %12.3f %14.2f %18.2f %10u\n", count, threaded ? pool.Size() : 1u, ms,
+                clusters.AverageLightsPerCluster(), clusters.AverageLightsPerOccupiedCluster(), clusters.MaxLightsPerCluster());
+        }
+    }
+}
+
+// --bench-stars: starfield generation and SH projection time at 10k / 100k / 1M stars
+inline void RunStarfieldBenchmark()
+{
+    const size_t counts[] = { 10000, 100000, 1000000 };
+    ThreadPool pool;
+
+    std::printf("%10s %8s %14s %14s\n", "stars", "threads", "generate ms", "project ms");
+    for (size_t count : counts) {
+        for (int threaded = 0; threaded < (pool.Size() > 1 ? 2 : 1); threaded++) {
+            ThreadPool* p = threaded ? &pool : nullptr;
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<Star> stars = GenerateStars(count, 30.0f, 1, p);
+            double generateMs = ElapsedMs(start);
+            start = std::chrono::high_resolution_clock::now();
+            ProjectStarlight(stars, 0.2f, p);
+            double projectMs = ElapsedMs(start);
+            std::printf("%10zu %8u %14.2f %14.2f\n", count, threaded ? pool.Size() : 1u, generateMs, projectMs);
+        }
+    }
+}
+
+// --bench-gears: per-frame kinematics cost (angles + gear transforms, then tooth transforms) for
+// 1k / 10k / 100k gears, scalar vs SIMD, and scaling with thread count
+inline void RunGearTrainBenchmark()
+{
+    const unsigned int counts[] = { 1000, 10000, 100000 };
+    const unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int n = 1; n < hardware; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(hardware);
+
+#ifdef GEAR_TRAIN_SSE2
+    const char* simdName = "sse2";
+#else
+    const char* simdName = "scalar";
+#endif
+    std::printf("SIMD kernel: %s, %u hardware threads\n", simdName, hardware);
+    std::printf("%8s %9s %10s %8s %14s %12s %12s %12s\n", "gears", "teeth", "solve ms", "threads",
+        "angles ms", "simd ms", "teeth ms", "frame ms");
+    for (unsigned int count : counts) {
+        GearTrain train = MakeGearRows(count);
+        auto start = std::chrono::high_resolution_clock::now();
+        unsigned int conflicts = train.Solve(0, 0.5);
+        double solveMs = ElapsedMs(start);
+        if (conflicts)
+            std::printf("  %u conflicting meshes\n", conflicts);
+
+        const int iterations = std::max(5, (int)(2000000 / count));
+        for (unsigned int threads : threadCounts) {
+            ThreadPool pool(threads);
+            double t = 100.0;
+            auto timeIt = [&](auto&& step) {
+                step(); // warm-up, sizes the buffers
+                auto begin = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; i++) {
+                    t += 1.0 / 60.0;
+                    step();
+                }
+                return ElapsedMs(begin) / iterations;
+            };
+            double scalarMs = timeIt([&] { train.Update(t, &pool, false); });
+            double simdMs = timeIt([&] { train.Update(t, &pool, true); });
+            double teethMs = timeIt([&] { train.BuildToothModels(0.25f, 0.2f, 0.2f, &pool); });
+            std::printf("%8u %9zu %10.2f %8u %14.3f %12.3f %12.3f %12.3f\n", count, train.ToothCount(), solveMs,
+                threads, scalarMs, simdMs, teethMs, simdMs + teethMs);
+        }
+    }
+}
+
+#endif
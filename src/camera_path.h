@@ -0,0 +1,118 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/camera.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Camera paths
+// ------------
+// A list of timed camera poses, sampled with linear interpolation. The benchmark build replays one instead of
+// reading the mouse and keyboard: either a file recorded from an interactive run (--record-camera) or
+// a scripted orbit around the gears. Either way, two runs see exactly the same frames.
+
+struct CameraKey {
+    float time;
+    glm::vec3 position;
+    float yaw, pitch; // degrees, as in Camera
+};
+
+class CameraPath
+{
+public:
+    std::vector<CameraKey> keys;
+
+    bool Empty() const { return keys.empty(); }
+    float Duration() const { return keys.empty() ? 0.0f : keys.back().time; }
+
+    void Record(float time, const Camera& camera)
+    {
+        keys.push_back({ time, camera.Position, camera.Yaw, camera.Pitch });
+    }
+
+    // text, one key per line: time x y z yaw pitch; lines starting with # are comments
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        keys.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream in(line);
+            CameraKey k;
+            if (in >> k.time >> k.position.x >> k.position.y >> k.position.z >> k.yaw >> k.pitch)
+                keys.push_back(k);
+        }
+        std::sort(keys.begin(), keys.end(), [](const CameraKey& a, const CameraKey& b) { return a.time < b.time; });
+        return !keys.empty();
+    }
+
+    bool Save(const std::string& path) const
+    {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        std::fprintf(file, "# time x y z yaw pitch\n");
+        for (const CameraKey& k : keys)
+            std::fprintf(file, "%.4f %.5f %.5f %.5f %.4f %.4f\n", k.time, k.position.x, k.position.y, k.position.z, k.yaw, k.pitch);
+        std::fclose(file);
+        return true;
+    }
+
+    // clamps outside the recorded range
+    CameraKey Sample(float time) const
+    {
+        if (time <= keys.front().time)
+            return keys.front();
+        if (time >= keys.back().time)
+            return keys.back();
+        auto next = std::upper_bound(keys.begin(), keys.end(), time,
+            [](float t, const CameraKey& k) { return t < k.time; });
+        const CameraKey& b = *next;
+        const CameraKey& a = *(next - 1);
+        float s = (time - a.time) / std::max(b.time - a.time, 1e-6f);
+        // turn the short way round when yaw wraps
+        float yawDelta = std::remainder(b.yaw - a.yaw, 360.0f);
+        return { time, a.position + (b.position - a.position) * s, a.yaw + yawDelta * s, a.pitch + (b.pitch - a.pitch) * s };
+    }
+
+    // looks at target from a slow side-to-side orbit that dollies between 55% and 100% of distance
+    static CameraPath Orbit(glm::vec3 target, float distance, float duration)
+    {
+        const float TWO_PI = 6.28318530717958647692f;
+        CameraPath path;
+        const int steps = std::max(2, (int)(duration * 4.0f));
+        for (int i = 0; i <= steps; i++) {
+            float t = duration * i / steps;
+            float phase = TWO_PI * t / duration;
+            float swing = 0.35f * std::sin(phase);
+            float d = distance * (0.55f + 0.45f * (0.5f + 0.5f * std::cos(phase)));
+            glm::vec3 position = target + d * glm::vec3(std::sin(swing), 0.15f * std::sin(2.0f * phase), std::cos(swing));
+            glm::vec3 dir = glm::normalize(target - position);
+            path.keys.push_back({ t, position, glm::degrees(std::atan2(dir.z, dir.x)), glm::degrees(std::asin(dir.y)) });
+        }
+        return path;
+    }
+};
+
+// moves the camera to a key; zero mouse movement just rebuilds Front/Right/Up from the new yaw and pitch
+inline void ApplyCameraKey(Camera& camera, const CameraKey& key)
+{
+    camera.Position = key.position;
+    camera.Yaw = key.yaw;
+    camera.Pitch = key.pitch;
+    camera.ProcessMouseMovement(0.0f, 0.0f);
+}
+
+#endif
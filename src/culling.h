@@ -0,0 +1,218 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Frustum culling
+// ---------------
+// Every drawable (a gear, a lamp, a cell of stars) has a world-space box in one bounding-volume hierarchy.
+// The tree is built once, top down, splitting at the median centre along the longest axis. When objects move
+// it is refit rather than rebuilt: children always come after their parent in the node array, so one
+// backwards pass recomputes every box. The topology is kept, so boxes loosen if objects travel far, but they
+// stay correct. Each frame the tree is walked against the six planes of projection * view. A node fully
+// outside drops its subtree, and a node fully inside accepts its subtree without testing anything below it.
+
+struct Aabb {
+    glm::vec3 lo = glm::vec3(1e30f), hi = glm::vec3(-1e30f);
+
+    Aabb() = default;
+    Aabb(const glm::vec3& lo, const glm::vec3& hi) : lo(lo), hi(hi) {}
+
+    void Add(const glm::vec3& p)
+    {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+
+    void Add(const Aabb& b)
+    {
+        lo = glm::min(lo, b.lo);
+        hi = glm::max(hi, b.hi);
+    }
+
+    glm::vec3 Center() const { return 0.5f * (lo + hi); }
+    glm::vec3 Extent() const { return hi - lo; }
+};
+
+// bounds of interleaved vertices whose first three floats are the position
+inline Aabb VertexBounds(const std::vector<float>& V, unsigned int floatsPerVertex = 8)
+{
+    Aabb box;
+    for (size_t i = 0; i + 2 < V.size(); i += floatsPerVertex)
+        box.Add(glm::vec3(V[i], V[i + 1], V[i + 2]));
+    return box;
+}
+
+// box around local transformed by model (Arvo: each output axis sums the extremes of the rotated extents)
+inline Aabb TransformAabb(const Aabb& local, const glm::mat4& model)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4(local.Center(), 1.0f));
+    glm::vec3 half = 0.5f * local.Extent(), radius(0.0f);
+    for (int column = 0; column < 3; column++)
+        radius += glm::abs(glm::vec3(model[column])) * half[column];
+    return Aabb(center - radius, center + radius);
+}
+
+enum CullResult { CULL_OUTSIDE, CULL_INTERSECTS, CULL_INSIDE };
+
+struct Frustum {
+    glm::vec4 planes[6]; // a point p is inside plane i when dot(planes[i].xyz, p) + planes[i].w >= 0
+
+    // Gribb/Hartmann: the clip-space inequalities -w <= x, y, z <= w written out in world space
+    static Frustum FromMatrix(const glm::mat4& viewProjection)
+    {
+        glm::mat4 m = glm::transpose(viewProjection); // rows of the matrix as columns
+        Frustum f;
+        for (int axis = 0; axis < 3; axis++) {
+            f.planes[axis * 2] = m[3] + m[axis];
+            f.planes[axis * 2 + 1] = m[3] - m[axis];
+        }
+        for (glm::vec4& plane : f.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return f;
+    }
+
+    // conservative: a box near a frustum corner may be reported as intersecting while entirely outside
+    CullResult Test(const Aabb& box) const
+    {
+        glm::vec3 center = box.Center(), half = 0.5f * box.Extent();
+        CullResult result = CULL_INSIDE;
+        for (const glm::vec4& plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = glm::dot(glm::abs(glm::vec3(plane)), half);
+            if (distance < -radius)
+                return CULL_OUTSIDE;
+            if (distance < radius)
+                result = CULL_INTERSECTS;
+        }
+        return result;
+    }
+};
+
+class BoundingVolumeHierarchy
+{
+public:
+    // work done by the last Cull()
+    unsigned int nodesVisited = 0, boxesTested = 0;
+
+    void Build(const std::vector<Aabb>& boxes, unsigned int leafObjects = 4)
+    {
+        nodes.clear();
+        order.resize(boxes.size());
+        for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+            order[i] = i;
+        leafSize = std::max(1u, leafObjects);
+        if (!boxes.empty())
+            BuildNode(boxes, 0, (uint32_t)boxes.size());
+    }
+
+    // boxes must hold the same objects Build() saw, in the same order
+    void Refit(const std::vector<Aabb>& boxes)
+    {
+        for (size_t n = nodes.size(); n-- > 0;) {
+            Node& node = nodes[n];
+            node.box = Aabb();
+            if (node.count > 0)
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    node.box.Add(boxes[order[i]]);
+            else {
+                node.box.Add(nodes[n + 1].box);
+                node.box.Add(nodes[node.right].box);
+            }
+        }
+    }
+
+    // visible[i] becomes 1 for every object whose box reaches into the frustum, 0 otherwise; returns how many are visible
+    size_t Cull(const Frustum& frustum, const std::vector<Aabb>& boxes, std::vector<uint8_t>& visible)
+    {
+        visible.assign(boxes.size(), 0);
+        nodesVisited = boxesTested = 0;
+        size_t count = 0;
+        if (!nodes.empty())
+            CullNode(0, frustum, boxes, visible, count);
+        return count;
+    }
+
+    size_t Nodes() const { return nodes.size(); }
+
+private:
+    // leaves hold objects order[first, first + count); inner nodes (count 0) have their left child right after them
+    struct Node {
+        Aabb box;
+        uint32_t first = 0, count = 0, right = 0;
+    };
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+    unsigned int leafSize = 4;
+
+    uint32_t BuildNode(const std::vector<Aabb>& boxes, uint32_t first, uint32_t count)
+    {
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+        Aabb box, centers;
+        for (uint32_t i = first; i < first + count; i++) {
+            box.Add(boxes[order[i]]);
+            centers.Add(boxes[order[i]].Center());
+        }
+        nodes[index].box = box;
+        if (count <= leafSize) {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            return index;
+        }
+        glm::vec3 extent = centers.Extent();
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        uint32_t half = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+            [&](uint32_t a, uint32_t b) { return boxes[a].Center()[axis] < boxes[b].Center()[axis]; });
+        BuildNode(boxes, first, half);
+        uint32_t right = BuildNode(boxes, first + half, count - half);
+        nodes[index].right = right; // nodes may have reallocated, so index rather than a reference
+        return index;
+    }
+
+    void CullNode(uint32_t index, const Frustum& frustum, const std::vector<Aabb>& boxes, std::vector<uint8_t>& visible, size_t& count)
+    {
+        nodesVisited++;
+        const Node& node = nodes[index];
+        CullResult result = frustum.Test(node.box);
+        if (result == CULL_OUTSIDE)
+            return;
+        if (result == CULL_INSIDE) {
+            AcceptNode(index, visible, count);
+            return;
+        }
+        if (node.count == 0) {
+            CullNode(index + 1, frustum, boxes, visible, count);
+            CullNode(node.right, frustum, boxes, visible, count);
+            return;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            boxesTested++;
+            if (frustum.Test(boxes[order[i]]) != CULL_OUTSIDE) {
+                visible[order[i]] = 1;
+                count++;
+            }
+        }
+    }
+
+    void AcceptNode(uint32_t index, std::vector<uint8_t>& visible, size_t& count)
+    {
+        const Node& node = nodes[index];
+        if (node.count == 0) {
+            AcceptNode(index + 1, visible, count);
+            AcceptNode(node.right, visible, count);
+            return;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+            visible[order[i]] = 1;
+        count += node.count;
+    }
+};
+
+#endif
@@ -0,0 +1,326 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+// Dynamic resolution
+// ------------------
+// The scene can be drawn into a ScaledTarget at a fraction of the output size and then stretched over the
+// output by one full-screen pass. The pass is plain bilinear, or bilinear followed by an edge-aware sharpen
+// that only adds contrast where the neighbourhood has room for it, so flat areas don't turn grainy and
+// edges don't ring.
+// GPU time per frame comes from two GL_TIMESTAMP queries. Unlike TIME_ELAPSED they can enclose the
+// profiler's per-pass queries. They are read a few frames later, once the GPU is done with them, so
+// measuring never stalls.
+// The ResolutionController turns those times into a scale. It treats cost as proportional to pixels, that
+// is to scale^2, so the scale that would land on target is scale * sqrt(target / measured). Over budget it
+// drops straight there. Well under budget it climbs in small steps. Times measured at a scale it has since
+// left are ignored.
+
+const float RESOLUTION_SCALE_STEP = 0.025f;  // scales are multiples of this, so noise alone never resizes
+const float RESOLUTION_HEADROOM = 0.9f;      // aim this far below the budget...
+const float RESOLUTION_RAISE_BELOW = 0.75f;  // ...and only grow again once this far below it
+const float RESOLUTION_MAX_RAISE = 0.1f;     // largest step up in one adjustment
+const unsigned int RESOLUTION_SETTLE_FRAMES = 3; // frames measured at a new scale before the next adjustment
+const unsigned int RESOLUTION_QUERY_FRAMES = 4;  // frames of timestamp queries in flight
+
+enum UpscaleFilter { UPSCALE_BILINEAR, UPSCALE_SHARP, UPSCALE_FILTERS };
+const char* const UPSCALE_FILTER_NAMES[UPSCALE_FILTERS] = { "bilinear", "sharp" };
+
+// a color texture and a depth buffer at the output size. Frames at a lower scale use the lower-left
+// corner, so a new scale never reallocates; only a new output size does.
+class ScaledTarget
+{
+public:
+    unsigned int fbo = 0, color = 0, depth = 0;
+    int width = 0, height = 0;                 // allocated: the output size
+    int viewportWidth = 0, viewportHeight = 0; // drawn this frame
+
+    // binds the target for a frame of outputWidth x outputHeight drawn at scale
+    bool Bind(int outputWidth, int outputHeight, float scale)
+    {
+        if ((outputWidth != width || outputHeight != height) && !Allocate(outputWidth, outputHeight))
+            return false;
+        viewportWidth = std::min(width, std::max(1, (int)std::lround(width * scale)));
+        viewportHeight = std::min(height, std::max(1, (int)std::lround(height * scale)));
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+        return true;
+    }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        fbo = color = depth = 0;
+        width = height = 0;
+    }
+
+private:
+    bool Allocate(int w, int h)
+    {
+        Destroy();
+        width = w;
+        height = h;
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &color);
+        glGenRenderbuffers(1, &depth);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete) {
+            std::printf("Scaled render target %dx%d is not complete\n", w, h);
+            Destroy();
+        }
+        return complete;
+    }
+};
+
+// stretches the drawn corner of a ScaledTarget over a whole framebuffer (6.upscale.vs/.fs)
+class Upscaler
+{
+public:
+    void Init(unsigned int upscaleProgram)
+    {
+        program = upscaleProgram;
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "image"), 0);
+        uvScaleLocation = glGetUniformLocation(program, "uvScale");
+        texelSizeLocation = glGetUniformLocation(program, "texelSize");
+        sharpnessLocation = glGetUniformLocation(program, "sharpness");
+        glGenVertexArrays(1, &vao); // the triangle comes from gl_VertexID, but core profile draws need a VAO
+    }
+
+    void Draw(const ScaledTarget& target, unsigned int framebuffer, int width, int height, UpscaleFilter filter)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(program);
+        glBindVertexArray(vao);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, target.color);
+        glUniform2f(uvScaleLocation, (float)target.viewportWidth / target.width, (float)target.viewportHeight / target.height);
+        glUniform2f(texelSizeLocation, 1.0f / target.width, 1.0f / target.height);
+        // nothing to restore at full scale, where the bilinear taps land on texel centres and copy the frame exactly
+        bool upscaling = target.viewportWidth < width || target.viewportHeight < height;
+        glUniform1f(sharpnessLocation, filter == UPSCALE_SHARP && upscaling ? 1.0f : 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void Destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+    }
+
+private:
+    unsigned int program = 0, vao = 0;
+    GLint uvScaleLocation = -1, texelSizeLocation = -1, sharpnessLocation = -1;
+};
+
+// GPU time from the start to the end of each frame, read back RESOLUTION_QUERY_FRAMES frames behind at most
+class GpuFrameTimer
+{
+public:
+    // call at the start of the frame's GL work; scale is what the frame is drawn at
+    void Begin(float scale)
+    {
+        Frame& frame = frames[next];
+        timing = !frame.pending; // the GPU is that far behind: leave this frame untimed rather than wait
+        if (!timing) {
+            skipped++;
+            return;
+        }
+        if (!frame.start) {
+            glGenQueries(1, &frame.start);
+            glGenQueries(1, &frame.end);
+        }
+        frame.scale = scale;
+        glQueryCounter(frame.start, GL_TIMESTAMP);
+    }
+
+    void End()
+    {
+        if (timing) {
+            glQueryCounter(frames[next].end, GL_TIMESTAMP);
+            frames[next].pending = true;
+        }
+        next = (next + 1) % RESOLUTION_QUERY_FRAMES;
+        timing = false;
+    }
+
+    // hands every finished frame, oldest first, to callback(gpuMs, scale)
+    template <typename Callback>
+    void Collect(Callback callback)
+    {
+        for (unsigned int i = 0; i < RESOLUTION_QUERY_FRAMES; i++) {
+            Frame& frame = frames[(next + i) % RESOLUTION_QUERY_FRAMES];
+            if (!frame.pending)
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(frame.end, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break; // later frames can't be done either
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(frame.start, GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(frame.end, GL_QUERY_RESULT, &end);
+            frame.pending = false;
+            // the first frame's time includes driver start-up (shader compiles, first uploads): leave it out
+            if (collected++ > 0)
+                callback(end > start ? (end - start) * 1e-6f : 0.0f, frame.scale);
+        }
+    }
+
+    size_t Skipped() const { return skipped; }
+
+    void Destroy()
+    {
+        for (Frame& frame : frames) {
+            glDeleteQueries(1, &frame.start);
+            glDeleteQueries(1, &frame.end);
+            frame = Frame();
+        }
+    }
+
+private:
+    struct Frame {
+        GLuint start = 0, end = 0;
+        float scale = 1.0f;
+        bool pending = false;
+    };
+    Frame frames[RESOLUTION_QUERY_FRAMES];
+    unsigned int next = 0;
+    bool timing = false;
+    size_t skipped = 0, collected = 0;
+};
+
+struct ResolutionController {
+    float budgetMs = 1000.0f / 60.0f;
+    float minScale = 0.5f, maxScale = 1.0f;
+    float scale = 1.0f;
+    float filteredMs = 0.0f; // smoothed GPU time at the current scale
+    unsigned int samples = 0; // frames measured at the current scale
+
+    static float Quantize(float s) { return std::floor(s / RESOLUTION_SCALE_STEP + 1e-3f) * RESOLUTION_SCALE_STEP; }
+
+    void SetScale(float s)
+    {
+        scale = std::min(maxScale, std::max(minScale, Quantize(s)));
+        samples = 0;
+    }
+
+    // one frame's GPU time, drawn at frameScale; true when the scale changed
+    bool Update(float gpuMs, float frameScale)
+    {
+        if (frameScale != scale)
+            return false;
+        filteredMs = samples == 0 ? gpuMs : filteredMs + 0.3f * (gpuMs - filteredMs);
+        if (++samples < RESOLUTION_SETTLE_FRAMES)
+            return false;
+        float wanted = scale;
+        float ideal = scale * std::sqrt(budgetMs * RESOLUTION_HEADROOM / std::max(filteredMs, 1e-3f));
+        if (filteredMs > budgetMs)
+            wanted = ideal;
+        else if (filteredMs < budgetMs * RESOLUTION_RAISE_BELOW)
+            wanted = std::min(ideal, scale + RESOLUTION_MAX_RAISE);
+        float previous = scale;
+        wanted = std::min(maxScale, std::max(minScale, Quantize(wanted)));
+        if (wanted == previous)
+            return false;
+        scale = wanted;
+        samples = 0;
+        return true;
+    }
+};
+
+// GPU frame times and the scales they were drawn at, for the once-a-second line and the end of a counted run
+struct ResolutionStats {
+    std::vector<float> gpuMs, scales;
+    size_t changes = 0;
+
+    void Add(float ms, float scale)
+    {
+        gpuMs.push_back(ms);
+        scales.push_back(scale);
+    }
+
+    float MeanMs() const
+    {
+        double sum = 0.0;
+        for (float ms : gpuMs)
+            sum += ms;
+        return gpuMs.empty() ? 0.0f : (float)(sum / gpuMs.size());
+    }
+
+    float StdDevMs() const
+    {
+        float mean = MeanMs();
+        double sum = 0.0;
+        for (float ms : gpuMs)
+            sum += (ms - mean) * (ms - mean);
+        return gpuMs.empty() ? 0.0f : (float)std::sqrt(sum / gpuMs.size());
+    }
+
+    // nearest-rank, like FrameTimeStats
+    float PercentileMs(float p) const
+    {
+        if (gpuMs.empty())
+            return 0.0f;
+        std::vector<float> sorted = gpuMs;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::ceil(p / 100.0f * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    // budgetMs <= 0: fixed scale, nothing to be over
+    void Print(const char* label, float budgetMs, size_t skipped) const
+    {
+        if (gpuMs.empty()) {
+            std::printf("%s: no GPU frame times (timestamp queries unavailable?)\n", label);
+            return;
+        }
+        float minScale = *std::min_element(scales.begin(), scales.end()), maxScale = *std::max_element(scales.begin(), scales.end());
+        double scaleSum = 0.0, pixelSum = 0.0;
+        size_t over = 0;
+        std::map<int, size_t> perScale; // in steps, highest first
+        for (size_t i = 0; i < scales.size(); i++) {
+            scaleSum += scales[i];
+            pixelSum += scales[i] * scales[i];
+            over += budgetMs > 0.0f && gpuMs[i] > budgetMs;
+            perScale[-(int)std::lround(scales[i] / RESOLUTION_SCALE_STEP)]++;
+        }
+        size_t n = gpuMs.size();
+        std::printf("%s: %zu frames timed | scale min %.3f avg %.3f max %.3f, %.0f%% of the pixels, %zu changes"
+                    " | gpu ms avg %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f, stddev %.3f", label, n,
+            minScale, scaleSum / n, maxScale, 100.0 * pixelSum / n, changes,
+            MeanMs(), PercentileMs(50.0f), PercentileMs(95.0f), PercentileMs(99.0f), PercentileMs(100.0f), StdDevMs());
+        if (budgetMs > 0.0f)
+            std::printf(", budget %.2f, %zu over (%.1f%%)", budgetMs, over, 100.0 * over / n);
+        if (skipped)
+            std::printf(", %zu untimed", skipped);
+        std::printf(" | frames per scale:");
+        for (const auto& s : perScale)
+            std::printf(" %.3f:%zu", -s.first * RESOLUTION_SCALE_STEP, s.second);
+        std::printf("\n");
+    }
+};
+
+#endif
@@ -0,0 +1,372 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frame capture
+// -------------
+// --capture records every frame to disk without waiting on the GPU. Each frame's output is copied by
+// glReadPixels into one of CAPTURE_RING_FRAMES pixel pack buffers, and a fence is placed after it. The copy
+// runs on the GPU after the frame's draws, and glReadPixels returns at once. A few frames later the fence
+// has passed, so the buffer maps without a wait. Its pixels are copied into a frame queued for the writer
+// thread, which converts and writes it while rendering goes on.
+// The render thread only waits when every buffer in the ring is still in flight. Each such wait counts as a
+// stall. When the writer falls behind and its queue is full, the frame is dropped instead of waited for.
+// A Y4M stream then repeats the previous frame so later frames keep their timing, and a PPM sequence skips
+// the frame's number. Frames are taken on a fixed clock of --capture-fps, not the wall clock, so the video
+// plays at the right speed however fast or slow the frames were rendered.
+
+const unsigned int CAPTURE_RING_FRAMES = 3; // readbacks in flight before the render thread would have to wait
+
+enum CaptureFormat { CAPTURE_Y4M, CAPTURE_PPM };
+
+// counters for one capture; the writer's totals are written on its thread and read from any
+struct CaptureStats {
+    size_t frames = 0;                 // readbacks started
+    size_t dropped = 0;                // frames the writer had no room for
+    size_t stalls = 0;                 // frames whose readback buffer was still in flight
+    double stallMs = 0.0;              // render-thread time spent waiting in those stalls
+    // render-thread time in glReadPixels, and mapping and copying the results. Drivers that only draw when flushed,
+    // like llvmpipe, draw the whole frame inside glReadPixels; the frame time, not this, shows what capture adds.
+    double readMs = 0.0, copyMs = 0.0;
+    size_t queuePeak = 0;              // most frames waiting for the writer at once
+    std::atomic<size_t> written{ 0 }, repeated{ 0 };
+    std::atomic<uint64_t> bytes{ 0 }, writeMicros{ 0 };
+};
+
+class FrameCapture
+{
+public:
+    // path ending in .y4m: one YUV 4:2:0 stream; anything else: PATH_<frame>.ppm per frame
+    bool Start(const std::string& outputPath, int w, int h, unsigned int framesPerSecond, unsigned int queueFrames)
+    {
+        path = outputPath;
+        format = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0 ? CAPTURE_Y4M : CAPTURE_PPM;
+        width = w;
+        height = h;
+        fps = std::max(framesPerSecond, 1u);
+        maxQueued = std::max(queueFrames, 1u);
+        if (format == CAPTURE_Y4M) {
+            stream = std::fopen(path.c_str(), "wb");
+            if (!stream) {
+                std::cout << "capture: could not open " << path << std::endl;
+                return false;
+            }
+            // full-range BT.601, the usual JPEG convention (ffmpeg reads it as yuvj420p)
+            std::fprintf(stream, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=FULL\n", width, height, fps);
+        }
+        glGenBuffers(CAPTURE_RING_FRAMES, pbos);
+        for (GLuint pbo : pbos) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, FrameBytes(), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        writer = std::thread([this] { WriterLoop(); });
+        std::cout << "capture: " << width << "x" << height << " at " << fps << " fps to " << path
+                  << (format == CAPTURE_Y4M ? " (Y4M)" : " (PPM sequence)") << std::endl;
+        return true;
+    }
+
+    bool Active() const { return writer.joinable(); }
+    unsigned int Fps() const { return fps; }
+
+    // call once the frame is fully drawn into framebuffer (0: the window's back buffer), before the swap
+    void Capture(GLuint framebuffer, int w, int h)
+    {
+        if (!Active())
+            return;
+        Collect(false);
+        if (w != width || h != height) {
+            // a resized window: the stream has one size, so these frames are lost
+            if (!resizeWarned)
+                std::cout << "capture: output is " << w << "x" << h << ", not " << width << "x" << height << "; dropping frames" << std::endl;
+            resizeWarned = true;
+            stats.dropped++;
+            number++;
+            return;
+        }
+
+        Slot& slot = slots[next];
+        if (slot.fence) {
+            // every buffer is still in flight: this is the one wait the ring exists to avoid
+            auto start = std::chrono::steady_clock::now();
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            stats.stalls++;
+            stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            Collect(false);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        // RGBA8 rows match the framebuffer's layout, so drivers copy them without converting on the CPU
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.number = number++;
+        next = (next + 1) % CAPTURE_RING_FRAMES;
+        stats.frames++;
+        stats.readMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // waits for the readbacks in flight and for the writer to empty its queue, then closes the output
+    void Finish()
+    {
+        if (!Active())
+            return;
+        Collect(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            finalNumber = number;
+        }
+        wake.notify_all();
+        writer.join();
+        // the last buffered frames only reach the file here
+        if (stream && std::fclose(stream) != 0 && !streamFailed)
+            std::cout << "capture: failed to write the end of " << path << std::endl;
+        stream = NULL;
+        glDeleteBuffers(CAPTURE_RING_FRAMES, pbos);
+    }
+
+    void Print(const char* label) const
+    {
+        size_t n = std::max<size_t>(stats.frames, 1);
+        double writeMs = stats.writeMicros / 1000.0;
+        std::printf("%s: %zu frames written (%zu repeated for drops) to %s, %.1f MB | %zu dropped | %zu stalls, %.2f ms waiting"
+                    " | render thread %.3f ms in glReadPixels + %.3f ms copy per frame | writer queue peak %zu of %u, %.1f MB/s\n",
+            label, stats.written.load(), stats.repeated.load(), path.c_str(), stats.bytes / (1024.0 * 1024.0), stats.dropped,
+            stats.stalls, stats.stallMs, stats.readMs / n, stats.copyMs / n, stats.queuePeak, maxQueued,
+            writeMs > 0.0 ? stats.bytes / (1024.0 * 1024.0) / (writeMs / 1000.0) : 0.0);
+    }
+
+    CaptureStats stats;
+
+private:
+    struct Slot {
+        GLsync fence = 0;
+        uint64_t number = 0;
+    };
+    struct QueuedFrame {
+        uint64_t number;
+        std::vector<unsigned char> rgba;
+    };
+
+    std::string path;
+    CaptureFormat format = CAPTURE_PPM;
+    int width = 0, height = 0;
+    unsigned int fps = 60, maxQueued = 16;
+    FILE* stream = NULL;
+    GLuint pbos[CAPTURE_RING_FRAMES] = {};
+    Slot slots[CAPTURE_RING_FRAMES];
+    unsigned int next = 0;  // ring slot the next frame reads into
+    uint64_t number = 0;    // the next frame's number, on the capture clock
+    bool resizeWarned = false;
+    bool streamFailed = false; // writer thread only: the stream write failure was reported
+
+    // writer thread: queued frames in, emptied buffers back out for reuse
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<QueuedFrame> queue;
+    std::vector<std::vector<unsigned char>> spare;
+    unsigned int allocated = 0;
+    bool stopping = false;
+    uint64_t finalNumber = 0; // frames on the capture clock, known once stopping
+
+    size_t FrameBytes() const { return (size_t)width * height * 4; }
+
+    // maps every readback whose fence has passed, oldest first, and queues it for the writer; wait: all of them
+    void Collect(bool wait)
+    {
+        for (unsigned int i = 0; i < CAPTURE_RING_FRAMES; i++) {
+            unsigned int index = (next + i) % CAPTURE_RING_FRAMES;
+            Slot& slot = slots[index];
+            if (!slot.fence)
+                continue;
+            GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+                break; // later readbacks can't be done either
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+
+            std::vector<unsigned char> buffer;
+            if (!TakeBuffer(buffer)) {
+                stats.dropped++;
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[index]);
+            const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, FrameBytes(), GL_MAP_READ_BIT);
+            if (pixels)
+                std::memcpy(buffer.data(), pixels, FrameBytes());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            stats.copyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(QueuedFrame{ slot.number, std::move(buffer) });
+                stats.queuePeak = std::max(stats.queuePeak, queue.size());
+            }
+            wake.notify_one();
+        }
+    }
+
+    // a spare buffer, or a new one while fewer than maxQueued exist; false when the writer holds them all
+    bool TakeBuffer(std::vector<unsigned char>& buffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!spare.empty()) {
+            buffer = std::move(spare.back());
+            spare.pop_back();
+            return true;
+        }
+        if (allocated >= maxQueued)
+            return false;
+        allocated++;
+        buffer.resize(FrameBytes());
+        return true;
+    }
+
+    void WriterLoop()
+    {
+        std::vector<unsigned char> converted; // the last frame written, as YUV or PPM bytes
+        uint64_t expected = 0;                // the number the next frame should have
+        for (;;) {
+            QueuedFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    // frames dropped at the very end still need their place in the stream
+                    for (; format == CAPTURE_Y4M && expected < finalNumber && !converted.empty(); expected++)
+                        if (WriteY4MFrame(converted))
+                            stats.repeated++;
+                    return;
+                }
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+            auto start = std::chrono::steady_clock::now();
+            bool written;
+            if (format == CAPTURE_Y4M) {
+                // a stream has no frame numbers: hold the last picture over the frames that were dropped
+                for (; expected < frame.number && !converted.empty(); expected++)
+                    if (WriteY4MFrame(converted))
+                        stats.repeated++;
+                ConvertToYuv420(frame.rgba, converted);
+                written = WriteY4MFrame(converted);
+            }
+            else
+                written = WritePPMFrame(frame.number, frame.rgba, converted);
+            expected = frame.number + 1;
+            if (written)
+                stats.written++;
+            stats.writeMicros += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                spare.push_back(std::move(frame.rgba));
+            }
+        }
+    }
+
+    // false when the frame did not reach the stream (a full disk, say); reported once, like a resize
+    bool WriteY4MFrame(const std::vector<unsigned char>& yuv)
+    {
+        if (std::fputs("FRAME\n", stream) < 0 || std::fwrite(yuv.data(), 1, yuv.size(), stream) != yuv.size()) {
+            if (!streamFailed)
+                std::cout << "capture: failed to write " << path << "; later frames may be lost too" << std::endl;
+            streamFailed = true;
+            return false;
+        }
+        stats.bytes += 6 + yuv.size();
+        return true;
+    }
+
+    // RGBA rows bottom first, as GL returns them, to top-first Y, Cb, Cr planes with chroma averaged over 2x2 blocks
+    void ConvertToYuv420(const std::vector<unsigned char>& rgba, std::vector<unsigned char>& yuv) const
+    {
+        int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+        yuv.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+        unsigned char* lumaPlane = yuv.data();
+        unsigned char* cbPlane = lumaPlane + (size_t)width * height;
+        unsigned char* crPlane = cbPlane + (size_t)chromaWidth * chromaHeight;
+        auto pixel = [&](int x, int y) { return &rgba[((size_t)(height - 1 - y) * width + x) * 4]; };
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const unsigned char* p = pixel(x, y);
+                lumaPlane[(size_t)y * width + x] = (unsigned char)(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f);
+            }
+        }
+        for (int cy = 0; cy < chromaHeight; cy++) {
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                float r = 0.0f, g = 0.0f, b = 0.0f;
+                int samples = 0;
+                for (int y = 2 * cy; y < std::min(2 * cy + 2, height); y++) {
+                    for (int x = 2 * cx; x < std::min(2 * cx + 2, width); x++) {
+                        const unsigned char* p = pixel(x, y);
+                        r += p[0];
+                        g += p[1];
+                        b += p[2];
+                        samples++;
+                    }
+                }
+                r /= samples;
+                g /= samples;
+                b /= samples;
+                float cb = 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b;
+                float cr = 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b;
+                cbPlane[(size_t)cy * chromaWidth + cx] = (unsigned char)std::min(255.0f, std::max(0.0f, cb + 0.5f));
+                crPlane[(size_t)cy * chromaWidth + cx] = (unsigned char)std::min(255.0f, std::max(0.0f, cr + 0.5f));
+            }
+        }
+    }
+
+    // binary PPM like WritePPM, from RGBA rows; false when the file could not be written in full
+    bool WritePPMFrame(uint64_t frameNumber, const std::vector<unsigned char>& rgba, std::vector<unsigned char>& rgb)
+    {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%05llu.ppm", (unsigned long long)frameNumber);
+        FILE* file = std::fopen((path + suffix).c_str(), "wb");
+        if (!file) {
+            std::cout << "capture: failed to write " << path << suffix << std::endl;
+            return false;
+        }
+        rgb.resize((size_t)width * 3);
+        int header = std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+        bool ok = header > 0;
+        for (int y = height - 1; y >= 0; y--) {
+            const unsigned char* row = &rgba[(size_t)y * width * 4];
+            for (int x = 0; x < width; x++) {
+                rgb[x * 3 + 0] = row[x * 4 + 0];
+                rgb[x * 3 + 1] = row[x * 4 + 1];
+                rgb[x * 3 + 2] = row[x * 4 + 2];
+            }
+            ok = ok && std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+        }
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok) {
+            std::cout << "capture: failed to write " << path << suffix << std::endl;
+            return false;
+        }
+        stats.bytes += (uint64_t)header + (uint64_t)width * height * 3;
+        return true;
+    }
+};
+
+#endif
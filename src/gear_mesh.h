@@ -0,0 +1,319 @@
+#ifndef GEAR_MESH_H
+#define GEAR_MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Baked gears
+// -----------
+// One indexed mesh per gear shape: the hub disc and every tooth come out of a single closed 2D outline
+// (root arcs, involute flanks, tip arcs) that is extruded along Z. Only the outer surface exists, so there
+// are no buried cube faces inside the hub, and the whole gear is one draw from the geometry arena.
+// Tooth i is centred on angle i * 2pi / teeth, matching GearToothModel, so the same gear angle works for both paths.
+
+struct GearParams {
+    int teeth;
+    float rootRadius;  // where the teeth start (the hub radius of the cube-tooth gears)
+    float toothLength; // radial
+    float toothWidth;  // tangential, measured halfway up the tooth
+    float thickness;   // Z
+
+    bool operator<(const GearParams& o) const
+    {
+        return std::tie(teeth, rootRadius, toothLength, toothWidth, thickness)
+             < std::tie(o.teeth, o.rootRadius, o.toothLength, o.toothWidth, o.thickness);
+    }
+};
+
+// detail per LOD: segments along each involute flank and across each tip (none: the flanks meet in a point on
+// the tooth's centre line), and the largest angle one root-gap segment may span. Every outline point costs
+// 4 triangles (two cap fans, one side quad), and each level has fewer points per tooth than the one before:
+// curved flanks with a tip land, straight flanks with a tip land, pointed teeth, and finally a plain disc at
+// mid-tooth radius for gears a few pixels wide.
+const int GEAR_LODS = 4;
+
+struct GearLodDetail {
+    int flankSamples, tipSegments;
+    float rootStep; // radians
+    bool teeth;
+};
+
+const GearLodDetail GEAR_LOD_DETAIL[GEAR_LODS] = {
+    { 2, 1, 0.2f, true },
+    { 1, 1, 0.35f, true },
+    { 1, 0, 100.0f, true },
+    { 0, 0, 0.0f, false },
+};
+
+struct GearMesh {
+    ArenaMesh mesh; // every LOD shares these arena ranges
+    struct Lod {
+        unsigned int firstIndex, indexCount; // relative to mesh.firstIndex
+    } lods[GEAR_LODS];
+};
+
+// involute function inv(a) = tan(a) - a for the pressure angle at radius r on base circle rb
+inline float GearInvolute(float r, float rb)
+{
+    float a = std::acos(std::min(1.0f, rb / r));
+    return std::tan(a) - a;
+}
+
+// appends one LOD (cap fans + side walls) to V/I; vertices are pos(3) + normal(3) + uv(2)
+inline void BuildGearLod(const GearParams& p, const GearLodDetail& detail,
+    std::vector<float>& V, std::vector<unsigned int>& I)
+{
+    const float PI = 3.14159265358979323846f;
+    const float halfZ = p.thickness * 0.5f;
+    const float rr = p.rootRadius;
+    const float ra = p.rootRadius + p.toothLength;
+    const float rm = 0.5f * (rr + ra);
+
+    struct OutlinePoint {
+        glm::vec2 pos;
+        bool arc; // the edge starting here follows a circle (smooth radial normals) rather than a flank
+    };
+    std::vector<OutlinePoint> outline;
+
+    auto polar = [](float angle, float radius) {
+        return glm::vec2(radius * std::cos(angle), radius * std::sin(angle));
+    };
+
+    if (!detail.teeth) {
+        int segments = std::max(12, p.teeth);
+        for (int i = 0; i < segments; i++)
+            outline.push_back({ polar(2.0f * PI * i / segments, rm), true });
+    }
+    else {
+        // involute flanks on a 20 degree base circle; the half-angle of a tooth at radius r is
+        // psi(r) = psi(rm) + inv(rm) - inv(r), so the flank follows the involute and the width at rm is toothWidth
+        const float rb = rr * std::cos(glm::radians(20.0f));
+        const float halfPitch = PI / p.teeth;
+        const float psiMid = 0.5f * p.toothWidth / rm;
+        auto halfAngle = [&](float r) {
+            float psi = psiMid + GearInvolute(rm, rb) - GearInvolute(r, rb);
+            // never let a tooth run to a point or into its neighbour
+            return glm::clamp(psi, 0.15f * psiMid, 0.95f * halfPitch);
+        };
+        const float psiRoot = halfAngle(rr), psiTip = halfAngle(ra);
+
+        for (int k = 0; k < p.teeth; k++) {
+            float c = 2.0f * PI * k / p.teeth;
+            // leading flank, root to tip
+            for (int s = 0; s < detail.flankSamples; s++) {
+                float r = rr + (ra - rr) * s / detail.flankSamples;
+                outline.push_back({ polar(c - halfAngle(r), r), false });
+            }
+            // tip: an arc, or a single point where the flanks meet
+            if (detail.tipSegments == 0)
+                outline.push_back({ polar(c, ra), false });
+            for (int s = 0; s < detail.tipSegments; s++)
+                outline.push_back({ polar(c - psiTip + 2.0f * psiTip * s / detail.tipSegments, ra), true });
+            // trailing flank, tip to root
+            for (int s = detail.tipSegments > 0 ? detail.flankSamples : detail.flankSamples - 1; s > 0; s--) {
+                float r = rr + (ra - rr) * s / detail.flankSamples;
+                outline.push_back({ polar(c + halfAngle(r), r), false });
+            }
+            // root gap up to the next tooth
+            float gapStart = c + psiRoot, gapEnd = c + 2.0f * halfPitch - psiRoot;
+            int rootSegments = std::max(1, (int)std::ceil((gapEnd - gapStart) / detail.rootStep));
+            for (int s = 0; s < rootSegments; s++)
+                outline.push_back({ polar(gapStart + (gapEnd - gapStart) * s / rootSegments, rr), true });
+        }
+    }
+
+    auto push = [&](glm::vec2 xy, float z, glm::vec3 n, float u, float v) {
+        V.push_back(xy.x); V.push_back(xy.y); V.push_back(z);
+        V.push_back(n.x); V.push_back(n.y); V.push_back(n.z);
+        V.push_back(u); V.push_back(v);
+    };
+    const unsigned int count = (unsigned int)outline.size();
+
+    // caps: the outline is star-shaped around the axis, so a fan from the centre covers it exactly
+    for (int side = 0; side < 2; side++) {
+        float z = side == 0 ? halfZ : -halfZ;
+        glm::vec3 n(0.0f, 0.0f, side == 0 ? 1.0f : -1.0f);
+        unsigned int center = (unsigned int)(V.size() / 8);
+        push(glm::vec2(0.0f), z, n, 0.5f, 0.5f);
+        for (const OutlinePoint& o : outline)
+            push(o.pos, z, n, o.pos.x / ra * 0.5f + 0.5f, o.pos.y / ra * 0.5f + 0.5f);
+        for (unsigned int i = 0; i < count; i++) {
+            unsigned int a = center + 1 + i, b = center + 1 + (i + 1) % count;
+            I.push_back(center);
+            I.push_back(side == 0 ? a : b);
+            I.push_back(side == 0 ? b : a);
+        }
+    }
+
+    // side walls: a quad per outline edge; U runs along the perimeter, V across the thickness
+    float perimeter = 0.0f;
+    for (unsigned int i = 0; i < count; i++)
+        perimeter += glm::length(outline[(i + 1) % count].pos - outline[i].pos);
+    float u = 0.0f;
+    for (unsigned int i = 0; i < count; i++) {
+        const OutlinePoint& a = outline[i];
+        const OutlinePoint& b = outline[(i + 1) % count];
+        glm::vec2 edge = b.pos - a.pos;
+        glm::vec3 flat = glm::normalize(glm::vec3(edge.y, -edge.x, 0.0f));
+        glm::vec3 na = a.arc ? glm::vec3(glm::normalize(a.pos), 0.0f) : flat;
+        glm::vec3 nb = a.arc ? glm::vec3(glm::normalize(b.pos), 0.0f) : flat;
+        float u1 = u + glm::length(edge) / perimeter;
+
+        unsigned int t0 = (unsigned int)(V.size() / 8);
+        push(a.pos, halfZ, na, u, 1.0f);
+        push(a.pos, -halfZ, na, u, 0.0f);
+        push(b.pos, halfZ, nb, u1, 1.0f);
+        push(b.pos, -halfZ, nb, u1, 0.0f);
+        unsigned int b0 = t0 + 1, t1 = t0 + 2, b1 = t0 + 3;
+        I.push_back(t0); I.push_back(b0); I.push_back(t1);
+        I.push_back(t1); I.push_back(b0); I.push_back(b1);
+        u = u1;
+    }
+}
+
+// triangles of the gear a baked mesh replaces: a 64-segment hub cylinder and a 12-triangle cube per tooth
+inline unsigned int CubeGearTriangles(int teeth) { return 64 * 4 + 12 * (unsigned int)teeth; }
+
+inline GearMesh CreateGearMesh(const GearParams& p, GeometryArena& arena)
+{
+    std::vector<float> V;
+    std::vector<unsigned int> I;
+    GearMesh gear;
+    for (int lod = 0; lod < GEAR_LODS; lod++) {
+        gear.lods[lod].firstIndex = (unsigned int)I.size();
+        BuildGearLod(p, GEAR_LOD_DETAIL[lod], V, I);
+        gear.lods[lod].indexCount = (unsigned int)I.size() - gear.lods[lod].firstIndex;
+        if (lod == 0 && gear.lods[0].indexCount > 3 * CubeGearTriangles(p.teeth)) {
+            // past about 21 teeth the full profile costs more than the cube teeth did: keep the curved flanks
+            // but let them meet in a point, one outline point per tooth fewer
+            GearLodDetail pointed = GEAR_LOD_DETAIL[0];
+            pointed.tipSegments = 0;
+            V.clear();
+            I.clear();
+            BuildGearLod(p, pointed, V, I);
+            gear.lods[0].indexCount = (unsigned int)I.size();
+        }
+    }
+    gear.mesh = arena.Add(V, I);
+    return gear;
+}
+
+// picks a LOD from the gear's tip radius in pixels on screen
+inline int SelectGearLod(float pixelRadius)
+{
+    if (pixelRadius > 250.0f) return 0;
+    if (pixelRadius > 60.0f) return 1;
+    if (pixelRadius > 12.0f) return 2;
+    return 3;
+}
+
+// gears with identical parameters share one baked mesh, allocated in the arena on first use
+class GearMeshCache
+{
+public:
+    void Init(GeometryArena* geometryArena) { arena = geometryArena; }
+
+    const GearMesh& Get(const GearParams& p)
+    {
+        auto it = meshes.find(p);
+        if (it == meshes.end())
+            it = meshes.emplace(p, CreateGearMesh(p, *arena)).first;
+        return it->second;
+    }
+
+    size_t Size() const { return meshes.size(); }
+
+    void Destroy()
+    {
+        for (auto& entry : meshes)
+            arena->Remove(entry.second.mesh);
+        meshes.clear();
+    }
+
+private:
+    GeometryArena* arena = NULL;
+    std::map<GearParams, GearMesh> meshes;
+};
+
+// --bench-vertex-formats: memory and vertex fetch of dense gear meshes (LOD 0, 32 to 512 teeth) in each
+// arena vertex format. program needs 'view', 'projection' and 'instanced' (the light cube shader): its
+// fragments are a flat colour and the gears are drawn a few pixels wide, so the time goes to vertex work.
+inline void RunVertexFormatBenchmark(GLADloadproc load, unsigned int program, int width, int height,
+    unsigned int grid = 8, unsigned int samples = 5)
+{
+    const int teethCounts[] = { 32, 128, 512 };
+    const float cell = 2.0f; // world units per grid cell, at z = 0 in front of a camera at z = 40
+
+    glUseProgram(program);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 40.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f);
+    glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1i(glGetUniformLocation(program, "instanced"), 1);
+    glViewport(0, 0, width, height);
+
+    std::printf("dense gear meshes (LOD 0 of %d, %d and %d teeth), %ux%u instances each, best of %u draws\n",
+        teethCounts[0], teethCounts[1], teethCounts[2], grid, grid, samples);
+    std::printf("%-8s %7s %9s %11s %10s %10s %7s %14s %9s %9s\n", "format", "stride", "indices", "vertex KB", "index KB",
+        "total KB", "saved", "fetch MB/draw", "ms/draw", "speedup");
+    double floatMs = 0.0;
+    for (int f = 0; f < VERTEX_FORMATS; f++) {
+        GeometryArena arena;
+        arena.Init(load, (VertexFormat)f);
+        std::vector<GearMesh> meshes;
+        std::vector<std::vector<glm::mat4>> models;
+        for (int teeth : teethCounts) {
+            GearParams p = { teeth, teeth * 0.05f, 0.3f, 0.15f, 0.5f };
+            meshes.push_back(CreateGearMesh(p, arena));
+            // a grid of gears shrunk to fit their cell
+            float scale = 0.45f * cell / (p.rootRadius + p.toothLength);
+            std::vector<glm::mat4> gearModels;
+            for (unsigned int y = 0; y < grid; y++)
+                for (unsigned int x = 0; x < grid; x++) {
+                    glm::vec3 at((x - 0.5f * (grid - 1)) * cell, (y - 0.5f * (grid - 1)) * cell, 0.0f);
+                    gearModels.push_back(glm::scale(glm::translate(glm::mat4(1.0f), at), glm::vec3(scale)));
+                }
+            models.push_back(gearModels);
+        }
+        arena.BeginFrame();
+        for (size_t m = 0; m < meshes.size(); m++)
+            arena.AddCommand(meshes[m].mesh, meshes[m].lods[0].firstIndex, meshes[m].lods[0].indexCount, models[m].data(), (uint32_t)models[m].size());
+        arena.Upload();
+        glBindVertexArray(arena.VertexArray());
+
+        arena.Draw(0, (uint32_t)meshes.size()); // warm-up
+        glFinish();
+        arena.ResetCounters();
+        double bestMs = 1.0e30;
+        for (unsigned int s = 0; s < samples; s++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            arena.Draw(0, (uint32_t)meshes.size());
+            glFinish();
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        if (f == VERTEX_FLOAT)
+            floatMs = bestMs;
+
+        size_t total = arena.VertexBytesUsed() + arena.IndexBytesUsed(), fat = arena.FloatLayoutBytesUsed();
+        double fetchMB = (arena.vertexBytesFetched + arena.indexBytesFetched) / (double)samples / (1024.0 * 1024.0);
+        std::printf("%-8s %7zu %6u-bit %11.1f %10.1f %10.1f %6.0f%% %14.2f %9.3f %8.2fx\n", VERTEX_FORMAT_NAMES[f], VertexStride((VertexFormat)f),
+            arena.IndexType() == GL_UNSIGNED_SHORT ? 16u : 32u, arena.VertexBytesUsed() / 1024.0, arena.IndexBytesUsed() / 1024.0,
+            total / 1024.0, 100.0 * (1.0 - (double)total / fat), fetchMB, bestMs, bestMs > 0.0 ? floatMs / bestMs : 0.0);
+        glBindVertexArray(0);
+        arena.Destroy();
+    }
+}
+
+#endif
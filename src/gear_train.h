@@ -0,0 +1,392 @@
+#ifndef GEAR_TRAIN_H
+#define GEAR_TRAIN_H
+
+#include <glm/glm.hpp>
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GEAR_TRAIN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Gear-train kinematics
+// ---------------------
+// Gears are added with their centre, tooth count and pitch radius, and AddMesh says which pairs are
+// in contact. Solve walks the meshing graph breadth-first from a driver gear. Each meshed neighbour turns
+// the other way at omega * N_i / N_j. Its phase is chosen so a tooth of one gear always faces a gap of the
+// other. With f the fraction of a tooth pitch between a gear's tooth 0 and the contact direction, that means
+// f_i + f_j = 1/2 (mod 1), and the sum stays constant while they turn.
+//
+// The per-frame work (angles, cos/sin, gear and tooth transforms) runs over structure-of-arrays storage.
+// It is split across a ThreadPool, with SSE2 kernels for the angles and for sin/cos where available.
+// ComputeAngles only reads the train, so a simulation thread can produce angles while the render thread
+// turns earlier ones into transforms with SetAngles.
+
+struct GearMeshing {
+    unsigned int a, b;
+};
+
+// angle = omega * t + phase, wrapped in double so long run times keep full precision
+inline void GearAnglesScalar(const double* omega, const double* phase, double t, float* angle, size_t begin, size_t end)
+{
+    const double TWO_PI = 6.283185307179586;
+    for (size_t i = begin; i < end; i++) {
+        double a = omega[i] * t + phase[i];
+        a -= TWO_PI * std::floor(a / TWO_PI);
+        angle[i] = (float)a;
+    }
+}
+
+inline void GearSinCosScalar(const float* angle, float* cosA, float* sinA, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        cosA[i] = std::cos(angle[i]);
+        sinA[i] = std::sin(angle[i]);
+    }
+}
+
+#ifdef GEAR_TRAIN_SSE2
+// four gears per iteration; the range wraps to (-2pi, 2pi) rather than [0, 2pi)
+inline void GearAnglesSse2(const double* omega, const double* phase, double t, float* angle, size_t begin, size_t end)
+{
+    const __m128d time = _mm_set1_pd(t);
+    const __m128d twoPi = _mm_set1_pd(6.283185307179586);
+    const __m128d invTwoPi = _mm_set1_pd(0.15915494309189535);
+
+    auto wrap = [&](size_t i) {
+        __m128d a = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(omega + i), time), _mm_loadu_pd(phase + i));
+        __m128d turns = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_mul_pd(a, invTwoPi)));
+        return _mm_cvtpd_ps(_mm_sub_pd(a, _mm_mul_pd(turns, twoPi)));
+    };
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+        _mm_storeu_ps(angle + i, _mm_movelh_ps(wrap(i), wrap(i + 2)));
+    GearAnglesScalar(omega, phase, t, angle, i, end);
+}
+
+// four gears per iteration with Cephes-style quadrant reduction and minimax polynomials on [-pi/4, pi/4]
+// (about 1e-7 absolute error); any angle within a few turns of zero works
+inline void GearSinCosSse2(const float* angle, float* cosA, float* sinA, size_t begin, size_t end)
+{
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(angle + i);
+
+        // x = j * pi/2 + r, r in [-pi/4, pi/4]; pi/2 is split in three so r stays exact
+        __m128i j = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236f)));
+        __m128 jf = _mm_cvtepi32_ps(j);
+        __m128 r = _mm_sub_ps(x, _mm_mul_ps(jf, _mm_set1_ps(1.5703125f)));
+        r = _mm_sub_ps(r, _mm_mul_ps(jf, _mm_set1_ps(4.837512969970703125e-4f)));
+        r = _mm_sub_ps(r, _mm_mul_ps(jf, _mm_set1_ps(7.54978995489188216e-8f)));
+        __m128 r2 = _mm_mul_ps(r, r);
+
+        __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), r2), _mm_set1_ps(8.3321608736e-3f));
+        s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-1.6666654611e-1f));
+        s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+        __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), r2), _mm_set1_ps(-1.388731625493765e-3f));
+        c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(4.166664568298827e-2f));
+        c = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(c, r2), r2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, _mm_set1_ps(0.5f))));
+
+        // quadrant q = j & 3: odd quadrants swap sin and cos, sin flips in q = 2, 3 and cos in q = 1, 2
+        __m128i q = _mm_and_si128(j, _mm_set1_epi32(3));
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 sinFlip = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+        __m128 cosFlip = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+        __m128 sinV = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        __m128 cosV = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+        _mm_storeu_ps(sinA + i, _mm_xor_ps(sinV, sinFlip));
+        _mm_storeu_ps(cosA + i, _mm_xor_ps(cosV, cosFlip));
+    }
+    GearSinCosScalar(angle, cosA, sinA, i, end);
+}
+#endif
+
+class GearTrain
+{
+public:
+    unsigned int AddGear(glm::vec3 center, int teeth, float radius)
+    {
+        const float TWO_PI = 6.28318530717958647692f;
+        x.push_back(center.x);
+        y.push_back(center.y);
+        z.push_back(center.z);
+        toothCount.push_back(teeth);
+        pitchRadius.push_back(radius);
+        stepCos.push_back(std::cos(TWO_PI / teeth));
+        stepSin.push_back(std::sin(TWO_PI / teeth));
+        firstTooth.push_back(teethTotal);
+        teethTotal += teeth;
+        omega.push_back(0.0);
+        phase.push_back(0.0);
+        return (unsigned int)x.size() - 1;
+    }
+
+    void AddMesh(unsigned int a, unsigned int b) { meshes.push_back({ a, b }); }
+
+    // a whole train already solved (a compiled scene): each array is copied in one go, nothing per gear is allocated
+    void Assign(size_t count, const float* cx, const float* cy, const float* cz, const int* teeth, const float* radius,
+        const double* solvedOmega, const double* solvedPhase, size_t meshCount, const uint32_t* meshA, const uint32_t* meshB,
+        unsigned int driver, double driverOmega)
+    {
+        const float TWO_PI = 6.28318530717958647692f;
+        x.assign(cx, cx + count);
+        y.assign(cy, cy + count);
+        z.assign(cz, cz + count);
+        toothCount.assign(teeth, teeth + count);
+        pitchRadius.assign(radius, radius + count);
+        omega.assign(solvedOmega, solvedOmega + count);
+        phase.assign(solvedPhase, solvedPhase + count);
+        stepCos.resize(count);
+        stepSin.resize(count);
+        firstTooth.resize(count);
+        teethTotal = 0;
+        for (size_t i = 0; i < count; i++) {
+            stepCos[i] = std::cos(TWO_PI / teeth[i]);
+            stepSin[i] = std::sin(TWO_PI / teeth[i]);
+            firstTooth[i] = teethTotal;
+            teethTotal += teeth[i];
+        }
+        meshes.resize(meshCount);
+        for (size_t m = 0; m < meshCount; m++)
+            meshes[m] = { meshA[m], meshB[m] };
+        driverGear = driver;
+        driverSpeed = driverOmega;
+    }
+
+    // Derives every gear's angular velocity and phase from the driver. Gears not connected to the driver
+    // stand still. Returns the number of meshes that close a loop with the wrong speed, e.g. an odd loop,
+    // which would lock a real train; those meshes are ignored.
+    unsigned int Solve(unsigned int driver, double driverOmega)
+    {
+        driverGear = driver;
+        driverSpeed = driverOmega;
+        const double PI = 3.141592653589793, TWO_PI = 2.0 * PI;
+        const size_t count = x.size();
+
+        // meshing graph as adjacency lists in one array (CSR)
+        std::vector<unsigned int> start(count + 1, 0), neighbours(meshes.size() * 2);
+        for (const GearMeshing& m : meshes) {
+            start[m.a + 1]++;
+            start[m.b + 1]++;
+        }
+        for (size_t i = 0; i < count; i++)
+            start[i + 1] += start[i];
+        std::vector<unsigned int> fill(start.begin(), start.end() - 1);
+        for (const GearMeshing& m : meshes) {
+            neighbours[fill[m.a]++] = m.b;
+            neighbours[fill[m.b]++] = m.a;
+        }
+
+        std::fill(omega.begin(), omega.end(), 0.0);
+        std::fill(phase.begin(), phase.end(), 0.0);
+        std::vector<bool> solved(count, false);
+        std::queue<unsigned int> open;
+        omega[driver] = driverOmega;
+        solved[driver] = true;
+        open.push(driver);
+
+        unsigned int conflicts = 0;
+        while (!open.empty()) {
+            unsigned int i = open.front();
+            open.pop();
+            for (unsigned int e = start[i]; e < start[i + 1]; e++) {
+                unsigned int j = neighbours[e];
+                double w = -omega[i] * toothCount[i] / toothCount[j];
+                if (solved[j]) {
+                    if (std::fabs(omega[j] - w) > 1e-9 * std::fabs(driverOmega))
+                        conflicts++;
+                    continue;
+                }
+                // contact direction seen from i, and where it falls within i's tooth pitch
+                double contact = std::atan2((double)y[j] - y[i], (double)x[j] - x[i]);
+                double fi = (contact - phase[i]) * toothCount[i] / TWO_PI;
+                fi -= std::floor(fi);
+                // seen from j the contact is at contact + pi; put f_j = 1/2 - f_i there
+                double p = contact + PI - (0.5 - fi) * TWO_PI / toothCount[j];
+                phase[j] = p - TWO_PI * std::floor(p / TWO_PI);
+                omega[j] = w;
+                solved[j] = true;
+                open.push(j);
+            }
+        }
+        // each loop-closing mesh was seen from both ends
+        return conflicts / 2;
+    }
+
+    // angles at time t plus translate(center) * rotateZ(angle) for every gear
+    void Update(double t, ThreadPool* pool = nullptr, bool simd = true)
+    {
+        ComputeAngles(t, angle, pool, simd);
+        BuildGearModels(pool, simd);
+    }
+
+    // every gear's angle at time t into out; reads nothing Update or SetAngles write, so it may run on another thread
+    void ComputeAngles(double t, std::vector<float>& out, ThreadPool* pool = nullptr, bool simd = true) const
+    {
+        out.resize(x.size());
+        auto compute = [&](size_t begin, size_t end) {
+#ifdef GEAR_TRAIN_SSE2
+            if (simd)
+                GearAnglesSse2(omega.data(), phase.data(), t, out.data(), begin, end);
+            else
+#endif
+                GearAnglesScalar(omega.data(), phase.data(), t, out.data(), begin, end);
+            (void)simd;
+        };
+        if (pool)
+            pool->ParallelFor(x.size(), compute, 1024);
+        else
+            compute(0, x.size());
+    }
+
+    // transforms for angles from ComputeAngles (or interpolated between two of its results)
+    void SetAngles(const std::vector<float>& angles, ThreadPool* pool = nullptr, bool simd = true)
+    {
+        angle.assign(angles.begin(), angles.end());
+        BuildGearModels(pool, simd);
+    }
+
+    // one cube transform per tooth (gear-major), the same matrices GearToothModel builds; needs Update first
+    void BuildToothModels(float toothLen, float toothHeight, float thick, ThreadPool* pool = nullptr)
+    {
+        toothModels.resize(teethTotal);
+        auto build = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                // step from tooth to tooth with a fixed rotation instead of a cos/sin per tooth
+                float c = cosA[i], s = sinA[i];
+                float offset = pitchRadius[i] + toothLen * 0.5f;
+                glm::mat4* out = &toothModels[firstTooth[i]];
+                for (int k = 0; k < toothCount[i]; k++) {
+                    out[k][0] = glm::vec4(c * toothLen, s * toothLen, 0.0f, 0.0f);
+                    out[k][1] = glm::vec4(-s * toothHeight, c * toothHeight, 0.0f, 0.0f);
+                    out[k][2] = glm::vec4(0.0f, 0.0f, thick, 0.0f);
+                    out[k][3] = glm::vec4(x[i] + c * offset, y[i] + s * offset, z[i], 1.0f);
+                    float next = c * stepCos[i] - s * stepSin[i];
+                    s = s * stepCos[i] + c * stepSin[i];
+                    c = next;
+                }
+            }
+        };
+        if (pool)
+            pool->ParallelFor(x.size(), build, 256);
+        else
+            build(0, x.size());
+    }
+
+    // axis-aligned box around every gear's pitch circle
+    void Bounds(glm::vec3& lo, glm::vec3& hi) const
+    {
+        lo = glm::vec3(1e30f);
+        hi = glm::vec3(-1e30f);
+        for (size_t i = 0; i < x.size(); i++) {
+            glm::vec3 r(pitchRadius[i], pitchRadius[i], 0.0f);
+            lo = glm::min(lo, Center(i) - r);
+            hi = glm::max(hi, Center(i) + r);
+        }
+    }
+
+    size_t Size() const { return x.size(); }
+    size_t ToothCount() const { return teethTotal; }
+
+    glm::vec3 Center(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+    int Teeth(size_t i) const { return toothCount[i]; }
+    size_t FirstTooth(size_t i) const { return firstTooth[i]; } // index of the gear's first matrix in ToothModels()
+    float Radius(size_t i) const { return pitchRadius[i]; }
+    double Omega(size_t i) const { return omega[i]; }
+    double Phase(size_t i) const { return phase[i]; }
+    float Angle(size_t i) const { return angle[i]; }
+    const std::vector<GearMeshing>& Meshes() const { return meshes; }
+    unsigned int Driver() const { return driverGear; } // what the last Solve started from
+    double DriverOmega() const { return driverSpeed; }
+
+    const std::vector<glm::mat4>& GearModels() const { return gearModels; }
+    const std::vector<glm::mat4>& ToothModels() const { return toothModels; }
+
+private:
+    // cos/sin and transforms from angle[]
+    void BuildGearModels(ThreadPool* pool, bool simd)
+    {
+        const size_t count = x.size();
+        cosA.resize(count);
+        sinA.resize(count);
+        gearModels.resize(count);
+
+        auto build = [&](size_t begin, size_t end) {
+#ifdef GEAR_TRAIN_SSE2
+            if (simd)
+                GearSinCosSse2(angle.data(), cosA.data(), sinA.data(), begin, end);
+            else
+#endif
+                GearSinCosScalar(angle.data(), cosA.data(), sinA.data(), begin, end);
+            (void)simd;
+            for (size_t i = begin; i < end; i++) {
+                glm::mat4& m = gearModels[i];
+                m[0] = glm::vec4(cosA[i], sinA[i], 0.0f, 0.0f);
+                m[1] = glm::vec4(-sinA[i], cosA[i], 0.0f, 0.0f);
+                m[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+                m[3] = glm::vec4(x[i], y[i], z[i], 1.0f);
+            }
+        };
+        if (pool)
+            pool->ParallelFor(count, build, 1024);
+        else
+            build(0, count);
+    }
+
+    // fixed per gear
+    std::vector<float> x, y, z, pitchRadius, stepCos, stepSin;
+    std::vector<int> toothCount;
+    std::vector<size_t> firstTooth;
+    std::vector<double> omega, phase;
+    std::vector<GearMeshing> meshes;
+    size_t teethTotal = 0;
+    unsigned int driverGear = 0;
+    double driverSpeed = 0.0;
+
+    // rewritten every frame
+    std::vector<float> angle, cosA, sinA;
+    std::vector<glm::mat4> gearModels, toothModels;
+};
+
+// rows of touching gears (module 0.1, so pitch radius = 0.05 * teeth) with the first gear of each row
+// meshing the row below, so every gear hangs off gear 0 at the top-left corner. teeth = 0 draws 8..32 per
+// gear from the seed; gap widens every centre distance for tooth geometry that reaches past the pitch circle
+inline GearTrain MakeGearRows(unsigned int count, int teeth = 0, float gap = 0.0f, unsigned int seed = 1)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> randomTeeth(8, 32);
+    const unsigned int rowLength = std::max(1u, (unsigned int)std::sqrt((double)count));
+
+    GearTrain train;
+    float rowY = 0.0f, rowRadius = 0.0f;
+    for (unsigned int i = 0; i < count; i++) {
+        int N = teeth > 0 ? teeth : randomTeeth(rng);
+        float r = 0.05f * N;
+        if (i % rowLength == 0) {
+            if (i > 0)
+                rowY -= rowRadius + r + gap;
+            train.AddGear(glm::vec3(0.0f, rowY, 0.0f), N, r);
+            if (i > 0)
+                train.AddMesh(i - rowLength, i);
+            rowRadius = r;
+        }
+        else {
+            glm::vec3 left = train.Center(i - 1);
+            train.AddGear(glm::vec3(left.x + train.Radius(i - 1) + r + gap, rowY, 0.0f), N, r);
+            train.AddMesh(i - 1, i);
+        }
+    }
+    return train;
+}
+
+#endif
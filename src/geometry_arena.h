@@ -0,0 +1,414 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <vector>
+
+// Geometry arena
+// --------------
+// Every static mesh lives in one vertex buffer and one index buffer behind a single VAO, so switching
+// meshes never switches vertex arrays. A first-fit free list hands out vertex and index ranges and takes
+// them back (merging neighbours); a full buffer doubles in place with glCopyBufferSubData.
+// Draws go out as DrawElementsIndirectCommands. Each command is instanced: the model matrices stream
+// into attributes 3..6 from a per-frame instance buffer, and baseInstance says where the command's
+// matrices start. glMultiDrawElementsIndirect (GL 4.3) sends a whole run of commands in one call. It is
+// resolved through the loader and the arena falls back to a loop over the same commands on a 3.3 context.
+// Vertices are stored in the arena's VertexFormat (see vertex_format.h), encoded as meshes are added.
+// The packed formats also use 16-bit indices: they are relative to each mesh's baseVertex, so they only
+// have to cover the largest mesh. The first mesh with more than 65536 vertices widens the whole index
+// buffer to 32 bits, because a multi-draw has one index type for all of its commands.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// first-fit allocator over [0, capacity) in whatever unit the caller counts
+class RangeAllocator
+{
+public:
+    static const uint32_t FAILED = ~0u;
+
+    void Reset(uint32_t capacity)
+    {
+        freeRanges.clear();
+        if (capacity > 0)
+            freeRanges[0] = capacity;
+        size = capacity;
+        used = 0;
+        allocations = 0;
+    }
+
+    uint32_t Allocate(uint32_t count)
+    {
+        for (std::map<uint32_t, uint32_t>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < count)
+                continue;
+            uint32_t offset = it->first, remaining = it->second - count;
+            freeRanges.erase(it);
+            if (remaining > 0)
+                freeRanges[offset + count] = remaining;
+            used += count;
+            allocations++;
+            return offset;
+        }
+        return FAILED;
+    }
+
+    void Free(uint32_t offset, uint32_t count)
+    {
+        used -= std::min(used, count);
+        allocations--;
+        std::map<uint32_t, uint32_t>::iterator next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + count == next->first) {
+            count += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            std::map<uint32_t, uint32_t>::iterator previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += count;
+                count = 0;
+            }
+        }
+        if (count > 0)
+            freeRanges[offset] = count;
+    }
+
+    // the new space joins the free range at the end, if there is one
+    void Grow(uint32_t capacity)
+    {
+        if (capacity <= size)
+            return;
+        uint32_t added = capacity - size;
+        used += added; // Free() takes it back out
+        allocations++;
+        Free(size, added);
+        size = capacity;
+    }
+
+    uint32_t Capacity() const { return size; }
+    uint32_t Used() const { return used; }
+    uint32_t Allocations() const { return allocations; }
+    size_t FreeRanges() const { return freeRanges.size(); }
+
+    uint32_t LargestFree() const
+    {
+        uint32_t largest = 0;
+        for (const std::pair<const uint32_t, uint32_t>& range : freeRanges)
+            largest = std::max(largest, range.second);
+        return largest;
+    }
+
+    // share of the free space that is not in the largest free range: 0 when it is all in one piece
+    double Fragmentation() const
+    {
+        uint32_t freeTotal = size - used;
+        return freeTotal == 0 ? 0.0 : 1.0 - (double)LargestFree() / freeTotal;
+    }
+
+private:
+    std::map<uint32_t, uint32_t> freeRanges; // offset -> length
+    uint32_t size = 0, used = 0, allocations = 0;
+};
+
+// a mesh's ranges in the arena; indices are relative to baseVertex
+struct ArenaMesh {
+    uint32_t baseVertex = 0, vertexCount = 0;
+    uint32_t firstIndex = 0, indexCount = 0;
+    float positionScale = 1.0f; // applied to every instance's model matrix (snorm16 positions)
+};
+
+class GeometryArena
+{
+public:
+    // instanced draws and commands issued through the arena since the last ResetCounters()
+    unsigned int multiDraws = 0, commandsDrawn = 0;
+    // bytes those commands read: indices, and vertices counted once per index (no post-transform cache reuse)
+    uint64_t indexBytesFetched = 0, vertexBytesFetched = 0;
+
+    // load is the GL loader glad was initialized with (the indirect entry points are resolved through it)
+    void Init(GLADloadproc load, VertexFormat vertexFormat = VERTEX_FLOAT, uint32_t vertexCapacity = 1 << 16, uint32_t indexCapacity = 1 << 18)
+    {
+        format = vertexFormat;
+        vertexBytes = VertexStride(format);
+        SetIndexType(format == VERTEX_FLOAT ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT);
+
+        multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+        drawElementsBaseInstance = (DrawElementsBaseInstanceProc)load("glDrawElementsInstancedBaseVertexBaseInstance");
+        // the entry points alone do not mean the context exposes them
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major * 10 + minor < 43)
+            multiDrawElementsIndirect = NULL;
+        if (major * 10 + minor < 42)
+            drawElementsBaseInstance = NULL;
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glGenBuffers(1, &instanceVbo);
+        glGenBuffers(1, &indirectBuffer);
+        vertices.Reset(vertexCapacity);
+        indices.Reset(indexCapacity);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCapacity * vertexBytes, NULL, GL_STATIC_DRAW);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCapacity * indexBytes, NULL, GL_STATIC_DRAW);
+        PointVertexAttributes();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        PointInstanceAttributes(0);
+        for (unsigned int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    unsigned int VertexArray() const { return vao; }
+    bool MultiDrawIndirect() const { return multiDrawElementsIndirect != NULL; }
+    VertexFormat Format() const { return format; }
+    GLenum IndexType() const { return indexType; }
+
+    // encodes interleaved fat vertices (FAT_VERTEX_FLOATS each) and their indices into the arena
+    ArenaMesh Add(const std::vector<float>& V, const std::vector<unsigned int>& I)
+    {
+        ArenaMesh mesh;
+        mesh.vertexCount = (uint32_t)(V.size() / FAT_VERTEX_FLOATS);
+        mesh.indexCount = (uint32_t)I.size();
+        if (indexType == GL_UNSIGNED_SHORT && mesh.vertexCount > 65536)
+            WidenIndices();
+        std::vector<unsigned char> encoded = EncodeVertices(format, V, mesh.positionScale);
+        mesh.baseVertex = AllocateGrowing(vertices, mesh.vertexCount, true);
+        mesh.firstIndex = AllocateGrowing(indices, mesh.indexCount, false);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)mesh.baseVertex * vertexBytes, (GLsizeiptr)encoded.size(), encoded.data());
+        glBindVertexArray(vao);
+        if (indexType == GL_UNSIGNED_SHORT) {
+            std::vector<uint16_t> shortIndices(I.begin(), I.end());
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)mesh.firstIndex * indexBytes, (GLsizeiptr)I.size() * indexBytes, shortIndices.data());
+        }
+        else
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)mesh.firstIndex * indexBytes, (GLsizeiptr)I.size() * indexBytes, I.data());
+        glBindVertexArray(0);
+        return mesh;
+    }
+
+    void Remove(const ArenaMesh& mesh)
+    {
+        vertices.Free(mesh.baseVertex, mesh.vertexCount);
+        indices.Free(mesh.firstIndex, mesh.indexCount);
+    }
+
+    // starts this frame's command list
+    void BeginFrame()
+    {
+        commands.clear();
+        instanceModels.clear();
+    }
+
+    // count instances of indexCount indices from firstIndex (relative to the mesh); returns the command's index
+    uint32_t AddCommand(const ArenaMesh& mesh, uint32_t firstIndex, uint32_t indexCount, const glm::mat4* models, uint32_t count)
+    {
+        DrawElementsIndirectCommand command;
+        command.count = indexCount;
+        command.instanceCount = count;
+        command.firstIndex = mesh.firstIndex + firstIndex;
+        command.baseVertex = (GLint)mesh.baseVertex;
+        command.baseInstance = (GLuint)instanceModels.size();
+        if (mesh.positionScale != 1.0f) {
+            glm::mat4 scale(mesh.positionScale);
+            scale[3][3] = 1.0f;
+            for (uint32_t i = 0; i < count; i++)
+                instanceModels.push_back(models[i] * scale);
+        }
+        else
+            instanceModels.insert(instanceModels.end(), models, models + count);
+        commands.push_back(command);
+        return (uint32_t)commands.size() - 1;
+    }
+
+    // one upload of every matrix and command queued this frame
+    void Upload()
+    {
+        if (commands.empty())
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        // orphan last frame's storage so the upload never waits on draws still in flight
+        glBufferData(GL_ARRAY_BUFFER, instanceModels.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instanceModels.size() * sizeof(glm::mat4), instanceModels.data());
+        if (multiDrawElementsIndirect) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        }
+    }
+
+    // draws commands [first, first + count) with the arena's VAO bound
+    void Draw(uint32_t first, uint32_t count)
+    {
+        if (count == 0)
+            return;
+        commandsDrawn += count;
+        for (uint32_t i = first; i < first + count; i++) {
+            uint64_t fetched = (uint64_t)commands[i].count * commands[i].instanceCount;
+            indexBytesFetched += fetched * indexBytes;
+            vertexBytesFetched += fetched * vertexBytes;
+        }
+        if (multiDrawElementsIndirect) {
+            multiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+            multiDraws++;
+            return;
+        }
+        for (uint32_t i = first; i < first + count; i++) {
+            const DrawElementsIndirectCommand& c = commands[i];
+            const void* offset = (const void*)(c.firstIndex * indexBytes);
+            if (drawElementsBaseInstance)
+                drawElementsBaseInstance(GL_TRIANGLES, c.count, indexType, offset, c.instanceCount, c.baseVertex, c.baseInstance);
+            else {
+                // GL 3.3 has no base instance: point the matrix attributes at the command's first matrix instead
+                glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+                PointInstanceAttributes(c.baseInstance);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, indexType, offset, c.instanceCount, c.baseVertex);
+            }
+        }
+        if (!drawElementsBaseInstance)
+            PointInstanceAttributes(0);
+    }
+
+    void ResetCounters()
+    {
+        multiDraws = commandsDrawn = 0;
+        indexBytesFetched = vertexBytesFetched = 0;
+    }
+
+    // vertex and index memory in use, against the fat float layout with 32-bit indices
+    size_t VertexBytesUsed() const { return (size_t)vertices.Used() * vertexBytes; }
+    size_t IndexBytesUsed() const { return (size_t)indices.Used() * indexBytes; }
+    size_t FloatLayoutBytesUsed() const { return (size_t)vertices.Used() * VertexStride(VERTEX_FLOAT) + (size_t)indices.Used() * sizeof(GLuint); }
+
+    void PrintStats() const
+    {
+        size_t packed = VertexBytesUsed() + IndexBytesUsed(), fat = FloatLayoutBytesUsed();
+        std::printf("geometry arena: %s vertices (%zu bytes), %u-bit indices | vertex data %.1f KB + index data %.1f KB = %.1f KB, "
+                    "%.1f KB as float vertices with 32-bit indices (%.0f%% saved)\n",
+            VERTEX_FORMAT_NAMES[format], vertexBytes, (unsigned int)indexBytes * 8, VertexBytesUsed() / 1024.0, IndexBytesUsed() / 1024.0,
+            packed / 1024.0, fat / 1024.0, fat ? 100.0 * (1.0 - (double)packed / fat) : 0.0);
+        std::printf("geometry arena: vertices %u/%u used in %u ranges (%zu free, largest %u, %.1f%% fragmented) | "
+                    "indices %u/%u used in %u ranges (%zu free, largest %u, %.1f%% fragmented) | %s\n",
+            vertices.Used(), vertices.Capacity(), vertices.Allocations(), vertices.FreeRanges(), vertices.LargestFree(), 100.0 * vertices.Fragmentation(),
+            indices.Used(), indices.Capacity(), indices.Allocations(), indices.FreeRanges(), indices.LargestFree(), 100.0 * indices.Fragmentation(),
+            multiDrawElementsIndirect ? "glMultiDrawElementsIndirect" : drawElementsBaseInstance ? "per-command draws (no GL 4.3)" : "per-command draws (GL 3.3)");
+    }
+
+    void Destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        glDeleteBuffers(1, &instanceVbo);
+        glDeleteBuffers(1, &indirectBuffer);
+        vao = vbo = ebo = instanceVbo = indirectBuffer = 0;
+    }
+
+private:
+    typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum, GLenum, const void*, GLsizei, GLsizei);
+    typedef void (APIENTRYP DrawElementsBaseInstanceProc)(GLenum, GLsizei, GLenum, const void*, GLsizei, GLint, GLuint);
+
+    VertexFormat format = VERTEX_FLOAT;
+    size_t vertexBytes = 0, indexBytes = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    unsigned int vao = 0, vbo = 0, ebo = 0, instanceVbo = 0, indirectBuffer = 0;
+    RangeAllocator vertices, indices;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::mat4> instanceModels;
+    MultiDrawElementsIndirectProc multiDrawElementsIndirect = NULL;
+    DrawElementsBaseInstanceProc drawElementsBaseInstance = NULL;
+
+    // attributes 0..2 from vbo; the VAO must be bound
+    void PointVertexAttributes()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        SetVertexAttributes(format);
+    }
+
+    void SetIndexType(GLenum type)
+    {
+        indexType = type;
+        indexBytes = type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+    }
+
+    // rewrites the 16-bit index buffer as 32-bit indices; allocator ranges count indices, so they stay valid
+    void WidenIndices()
+    {
+        uint32_t capacity = indices.Capacity();
+        std::vector<uint16_t> shortIndices(capacity);
+        glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)capacity * sizeof(uint16_t), shortIndices.data());
+        std::vector<GLuint> wide(shortIndices.begin(), shortIndices.end());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * sizeof(GLuint), wide.data(), GL_STATIC_DRAW);
+        SetIndexType(GL_UNSIGNED_INT);
+        std::printf("geometry arena: a mesh needs 32-bit indices, widened the index buffer\n");
+    }
+
+    // attributes 3..6 from the instance buffer bound to GL_ARRAY_BUFFER, starting at matrix firstInstance
+    static void PointInstanceAttributes(uint32_t firstInstance)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (void*)(firstInstance * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+    }
+
+    uint32_t AllocateGrowing(RangeAllocator& allocator, uint32_t count, bool vertexRange)
+    {
+        uint32_t offset = allocator.Allocate(count);
+        while (offset == RangeAllocator::FAILED) {
+            uint32_t capacity = std::max(allocator.Capacity() * 2, allocator.Capacity() + count);
+            GrowBuffer(vertexRange ? vbo : ebo, vertexRange ? vertexBytes : indexBytes, allocator.Capacity(), capacity, vertexRange);
+            allocator.Grow(capacity);
+            offset = allocator.Allocate(count);
+        }
+        return offset;
+    }
+
+    // moves the buffer's contents into a larger one and points the VAO at it
+    void GrowBuffer(unsigned int& buffer, size_t elementBytes, uint32_t oldCapacity, uint32_t newCapacity, bool vertexRange)
+    {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)newCapacity * elementBytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)oldCapacity * elementBytes);
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+        glBindVertexArray(vao);
+        if (vertexRange)
+            PointVertexAttributes();
+        else
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+        glBindVertexArray(0);
+    }
+};
+
+#endif
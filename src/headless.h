@@ -0,0 +1,214 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Headless rendering
+// ------------------
+// --headless renders without a window or display: a surfaceless EGL context (no pbuffer, no X server)
+// drawing into an offscreen framebuffer. Mesa's llvmpipe supports this on machines without a GPU
+// (EGL_PLATFORM=surfaceless or the EGL_MESA_platform_surfaceless display used below).
+// The EGL path is only compiled when CMake finds libEGL (HAVE_EGL).
+
+class HeadlessContext
+{
+public:
+    bool Create()
+    {
+#ifdef HAVE_EGL
+        // prefer the surfaceless platform; fall back to the default display (which may still work headless)
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            std::cout << "EGL: no display" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "EGL: desktop OpenGL not supported" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_SURFACE_TYPE, 0, // never rendered to a surface, only to our framebuffer object
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+            std::cout << "EGL: no OpenGL config" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            std::cout << "EGL: could not create a surfaceless OpenGL 3.3 core context" << std::endl;
+            return false;
+        }
+        std::cout << "EGL " << major << "." << minor << ": " << eglQueryString(display, EGL_VENDOR) << std::endl;
+        return true;
+#else
+        std::cout << "Headless mode needs EGL; this build was configured without it" << std::endl;
+        return false;
+#endif
+    }
+
+    // loader for gladLoadGLLoader
+    static void* GetProcAddress(const char* name)
+    {
+#ifdef HAVE_EGL
+        return (void*)eglGetProcAddress(name);
+#else
+        (void)name;
+        return NULL;
+#endif
+    }
+
+    void Destroy()
+    {
+#ifdef HAVE_EGL
+        if (display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+#endif
+    }
+
+private:
+#ifdef HAVE_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
+
+// color + depth renderbuffers the headless frames are drawn into
+class OffscreenTarget
+{
+public:
+    unsigned int fbo = 0, color = 0, depth = 0;
+    int width = 0, height = 0;
+
+    bool Create(int w, int h)
+    {
+        width = w;
+        height = h;
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "Offscreen framebuffer is not complete" << std::endl;
+        return complete;
+    }
+
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+    }
+
+    // tightly packed RGB rows, bottom row first as GL returns them
+    std::vector<unsigned char> ReadPixels() const
+    {
+        std::vector<unsigned char> pixels((size_t)width * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        fbo = color = depth = 0;
+    }
+};
+
+// binary PPM (P6) from bottom-up RGB rows; PPM needs no image library and diffs byte for byte
+inline bool WritePPM(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cout << "Failed to write " << path << std::endl;
+        return false;
+    }
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = height - 1; y >= 0; y--)
+        std::fwrite(&rgb[(size_t)y * width * 3], 1, (size_t)width * 3, file);
+    std::fclose(file);
+    return true;
+}
+
+// wall-clock frame times of a headless or benchmark run, summarized at the end
+struct FrameTimeStats {
+    std::vector<double> frameMs;
+
+    // nearest-rank percentile, p in [0, 100]
+    double Percentile(double p) const
+    {
+        if (frameMs.empty())
+            return 0.0;
+        std::vector<double> sorted = frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    double Mean() const
+    {
+        double sum = 0.0;
+        for (double ms : frameMs)
+            sum += ms;
+        return frameMs.empty() ? 0.0 : sum / frameMs.size();
+    }
+
+    void Print(const char* label, double totalMs) const
+    {
+        if (frameMs.empty())
+            return;
+        std::printf("%s: %zu frames in %.1f ms | %.1f fps | frame ms min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+            label, frameMs.size(), totalMs, 1000.0 * frameMs.size() / totalMs,
+            Percentile(0.0), Percentile(50.0), Percentile(95.0), Percentile(99.0), Percentile(100.0));
+    }
+};
+
+#endif
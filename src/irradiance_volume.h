@@ -0,0 +1,149 @@
+#ifndef IRRADIANCE_VOLUME_H
+#define IRRADIANCE_VOLUME_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "light_rig.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Irradiance volume
+// -----------------
+// The directional light and the rig's point lights never move or change colour, so their ambient and diffuse
+// terms depend only on where a fragment is and which way it faces. The bake stores that as a grid of probes
+// around the gears. Each probe is an ambient cube: the exact irradiance (the shader's ambient plus
+// diffuse * max(dot(n, l), 0) over every static light) for the six normals +x, -x, +y, -y, +z, -z.
+// A fragment blends the three faces its normal points towards, weighted by the squared components of the
+// normal, after trilinear interpolation between probes.
+// Why not L1 spherical harmonics: the point lights sit in the gears' plane, so they graze the flat faces.
+// L1 spreads a grazing light onto those faces, which made them far too bright (12.5 dB against the live
+// lights). The cube is exact for the faces and for any other normal along an axis.
+// The bake ignores occlusion. The turning gears' shadows can't be baked, so the baked variant is only used
+// with shadows off. Specular terms, the flashlight and the starlight are still evaluated live.
+
+const unsigned int IRRADIANCE_VOLUME_UNIT = 15; // texture unit, after the shadow maps
+const int IRRADIANCE_MAX_PROBES = 256;          // per axis
+
+// the cube faces in the order they are stacked along the texture's z axis
+const glm::vec3 IRRADIANCE_CUBE_FACES[6] = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+
+class IrradianceVolume
+{
+public:
+    glm::ivec3 size = glm::ivec3(0);
+    glm::vec3 origin = glm::vec3(0.0f); // the first probe
+    float spacing = 0.0f;
+    double bakeMs = 0.0;
+    unsigned int threads = 1;
+
+    // probes spaced evenly over bounds plus one spacing on every side, `probes` of them along the longest side
+    void Bake(const LightRigStd140& rig, const Aabb& bounds, int probes, ThreadPool* pool = nullptr)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        glm::vec3 extent = bounds.hi - bounds.lo;
+        probes = std::min(std::max(probes, 2), IRRADIANCE_MAX_PROBES - 2);
+        spacing = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-3f)) / (float)(probes - 1);
+        for (int axis = 0; axis < 3; axis++)
+            size[axis] = std::min((int)std::ceil(extent[axis] / spacing) + 3, IRRADIANCE_MAX_PROBES);
+        origin = 0.5f * (bounds.lo + bounds.hi) - 0.5f * spacing * glm::vec3(size - 1);
+
+        size_t count = (size_t)size.x * size.y * size.z;
+        probeData.assign(6 * count, glm::vec3(0.0f));
+        auto bake = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                BakeProbe(rig, i);
+        };
+        threads = pool ? pool->Size() : 1;
+        if (pool)
+            pool->ParallelFor(count, bake, 256);
+        else
+            bake(0, count);
+        bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // one RGB16F 3D texture, the six faces' grids stacked along z, left bound to its unit for the whole run
+    void Upload()
+    {
+        if (!texture)
+            glGenTextures(1, &texture);
+        glActiveTexture(GL_TEXTURE0 + IRRADIANCE_VOLUME_UNIT);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, size.x, size.y, 6 * size.z, 0, GL_RGB, GL_FLOAT, probeData.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // sampler unit and the world-to-probe mapping of a lighting program (6.multiple_lights.fs)
+    void Attach(unsigned int lightingProgram) const
+    {
+        glUniform1i(glGetUniformLocation(lightingProgram, "irradianceVolume"), IRRADIANCE_VOLUME_UNIT);
+        // in texels of one face's grid, where probe i sits at the centre of texel i: (p - origin) / spacing + 0.5
+        glm::vec3 scale(1.0f / spacing);
+        glm::vec3 offset = glm::vec3(0.5f) - origin * scale;
+        glm::vec3 probes(size);
+        glUniform3fv(glGetUniformLocation(lightingProgram, "irradianceVolumeScale"), 1, &scale.x);
+        glUniform3fv(glGetUniformLocation(lightingProgram, "irradianceVolumeOffset"), 1, &offset.x);
+        glUniform3fv(glGetUniformLocation(lightingProgram, "irradianceVolumeSize"), 1, &probes.x);
+    }
+
+    size_t Bytes() const { return probeData.size() * 3 * 2; } // on the GPU, as half floats
+
+    void Print(int staticLights) const
+    {
+        std::printf("irradiance volume: %dx%dx%d probes %.3f apart, %d static lights baked in %.3f ms on %u threads, %.1f KB\n",
+            size.x, size.y, size.z, spacing, staticLights, bakeMs, threads, Bytes() / 1024.0);
+    }
+
+    void Destroy()
+    {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+private:
+    std::vector<glm::vec3> probeData; // six grids of size.x * size.y * size.z, one per cube face
+    GLuint texture = 0;
+
+    // x fastest, then y, then z: the order glTexImage3D reads texels in
+    void BakeProbe(const LightRigStd140& rig, size_t index)
+    {
+        glm::ivec3 cell((int)(index % size.x), (int)(index / size.x % size.y), (int)(index / ((size_t)size.x * size.y)));
+        glm::vec3 p = origin + spacing * glm::vec3(cell);
+        glm::vec3 faces[6] = {};
+        auto add = [&](const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& l) {
+            for (int f = 0; f < 6; f++)
+                faces[f] += ambient + diffuse * std::max(glm::dot(IRRADIANCE_CUBE_FACES[f], l), 0.0f);
+        };
+
+        const DirLightStd140& sun = rig.dirLight;
+        add(sun.ambient, sun.diffuse, glm::normalize(-sun.direction));
+        for (int i = 0; i < NR_POINT_LIGHTS; i++) {
+            const PointLightStd140& light = rig.pointLights[i];
+            glm::vec3 toLight = light.position - p;
+            float distance = glm::length(toLight);
+            float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+            glm::vec3 l = distance > 1e-6f ? toLight / distance : glm::vec3(0.0f); // on the light itself: ambient only
+            add(light.ambient * attenuation, light.diffuse * attenuation, l);
+        }
+        size_t count = (size_t)size.x * size.y * size.z;
+        for (int f = 0; f < 6; f++)
+            probeData[f * count + index] = faces[f];
+    }
+};
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Clustered forward lighting
+// --------------------------
+// The view frustum is cut into X*Y screen tiles and Z exponentially spaced depth slices. Each frame
+// the CPU tests every point light's sphere of influence against the clusters and builds, per cluster,
+// an (offset, count) pair into one flat light index list. The fragment shader finds its cluster from
+// gl_FragCoord and view depth and only shades the lights listed there.
+//
+// LightClusterGrid is pure CPU code (no GL calls) so it can be run and benchmarked headless;
+// ClusterLightBuffers moves its output into texture buffers for 6.multiple_lights.fs.
+
+// point light as stored in the light texture buffer: 4 RGBA32F texels, same order as the GLSL PointLight
+// with the light's range in the last slot
+struct ClusterPointLight {
+    glm::vec3 position; float constant;
+    glm::vec3 ambient;  float linear;
+    glm::vec3 diffuse;  float quadratic;
+    glm::vec3 specular; float range;
+};
+
+static_assert(sizeof(ClusterPointLight) == 64, "ClusterPointLight must be 4 vec4 texels");
+
+// distance at which 1 / (constant + linear*d + quadratic*d^2) scaled by the light's brightest channel
+// drops below 5/256, i.e. where the light stops making a visible difference
+inline float PointLightRange(float constant, float linear, float quadratic, float maxChannel)
+{
+    const float threshold = 256.0f / 5.0f;
+    if (quadratic <= 0.0f)
+        return linear > 0.0f ? std::max(0.0f, (maxChannel * threshold - constant) / linear) : 1e30f;
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - maxChannel * threshold))) / (2.0f * quadratic);
+}
+
+inline float PointLightRange(const ClusterPointLight& light)
+{
+    glm::vec3 peak = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+    return PointLightRange(light.constant, light.linear, light.quadratic, std::max(peak.x, std::max(peak.y, peak.z)));
+}
+
+// small coloured lights scattered through a box (seeded, so runs are repeatable)
+inline std::vector<ClusterPointLight> ScatterPointLights(unsigned int count, glm::vec3 boxMin, glm::vec3 boxMax, unsigned int seed = 1)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<ClusterPointLight> lights(count);
+    for (ClusterPointLight& light : lights) {
+        light.position = boxMin + (boxMax - boxMin) * glm::vec3(unit(rng), unit(rng), unit(rng));
+        glm::vec3 color(unit(rng), unit(rng), unit(rng));
+        color /= std::max(color.x, std::max(color.y, color.z));
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = color * 0.6f;
+        light.specular = color * 0.6f;
+        light.constant = 1.0f;
+        light.linear = 1.4f;
+        light.quadratic = 7.2f;
+        light.range = PointLightRange(light);
+    }
+    return lights;
+}
+
+struct ClusterConfig {
+    unsigned int x = 16, y = 9, z = 24;
+    float nearZ = 0.1f, farZ = 100.0f;
+};
+
+class LightClusterGrid
+{
+public:
+    // rebuilds the view-space cluster bounds; call again whenever the projection changes
+    void Configure(const ClusterConfig& c, const glm::mat4& projection)
+    {
+        config = c;
+        // glm::perspective is symmetric: ndc.x = P[0][0] * x / -z, ndc.y = P[1][1] * y / -z
+        projX = projection[0][0];
+        projY = projection[1][1];
+
+        unsigned int count = config.x * config.y * config.z;
+        boundsMin.resize(count);
+        boundsMax.resize(count);
+        for (unsigned int k = 0; k < config.z; k++) {
+            float zn = SliceDepth(k), zf = SliceDepth(k + 1);
+            for (unsigned int j = 0; j < config.y; j++) {
+                float y0 = -1.0f + 2.0f * j / config.y, y1 = -1.0f + 2.0f * (j + 1) / config.y;
+                for (unsigned int i = 0; i < config.x; i++) {
+                    float x0 = -1.0f + 2.0f * i / config.x, x1 = -1.0f + 2.0f * (i + 1) / config.x;
+                    // the tile's corners at the slice's near and far depth bound the cluster
+                    float xs[4] = { x0 * zn / projX, x1 * zn / projX, x0 * zf / projX, x1 * zf / projX };
+                    float ys[4] = { y0 * zn / projY, y1 * zn / projY, y0 * zf / projY, y1 * zf / projY };
+                    unsigned int c = Index(i, j, k);
+                    boundsMin[c] = glm::vec3(*std::min_element(xs, xs + 4), *std::min_element(ys, ys + 4), -zf);
+                    boundsMax[c] = glm::vec3(*std::max_element(xs, xs + 4), *std::max_element(ys, ys + 4), -zn);
+                }
+            }
+        }
+        sliceLists.assign(config.z, std::vector<std::vector<unsigned int> >(config.x * config.y));
+        grid.assign(count, glm::uvec2(0));
+    }
+
+    // builds the per-cluster light lists for this view; pool may be null to run single-threaded
+    void Assign(const std::vector<ClusterPointLight>& lights, const glm::mat4& view, ThreadPool* pool)
+    {
+        viewLights.resize(lights.size());
+        auto transform = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].range);
+        };
+        auto assignSlices = [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++)
+                AssignSlice((unsigned int)k);
+        };
+        if (pool) {
+            pool->ParallelFor(lights.size(), transform, 1024);
+            pool->ParallelFor(config.z, assignSlices);
+        }
+        else {
+            transform(0, lights.size());
+            assignSlices(0, config.z);
+        }
+
+        // flatten the per-slice lists into (offset, count) pairs plus one index list, slice-major
+        unsigned int tilesPerSlice = config.x * config.y;
+        unsigned int offset = 0;
+        for (unsigned int k = 0; k < config.z; k++)
+            for (unsigned int t = 0; t < tilesPerSlice; t++) {
+                unsigned int n = (unsigned int)sliceLists[k][t].size();
+                grid[k * tilesPerSlice + t] = glm::uvec2(offset, n);
+                offset += n;
+            }
+        indices.resize(offset);
+        auto gather = [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++)
+                for (unsigned int t = 0; t < tilesPerSlice; t++) {
+                    const std::vector<unsigned int>& list = sliceLists[k][t];
+                    std::copy(list.begin(), list.end(), indices.begin() + grid[k * tilesPerSlice + t].x);
+                }
+        };
+        if (pool)
+            pool->ParallelFor(config.z, gather);
+        else
+            gather(0, config.z);
+    }
+
+    const ClusterConfig& Config() const { return config; }
+    unsigned int ClusterCount() const { return config.x * config.y * config.z; }
+    const std::vector<glm::uvec2>& Grid() const { return grid; }
+    const std::vector<unsigned int>& Indices() const { return indices; }
+
+    float AverageLightsPerCluster() const
+    {
+        return ClusterCount() ? (float)indices.size() / (float)ClusterCount() : 0.0f;
+    }
+
+    // average over clusters that contain at least one light
+    float AverageLightsPerOccupiedCluster() const
+    {
+        unsigned int occupied = 0;
+        for (const glm::uvec2& g : grid)
+            occupied += g.y > 0;
+        return occupied ? (float)indices.size() / (float)occupied : 0.0f;
+    }
+
+    unsigned int MaxLightsPerCluster() const
+    {
+        unsigned int most = 0;
+        for (const glm::uvec2& g : grid)
+            most = std::max(most, g.y);
+        return most;
+    }
+
+    // slice = log(depth) * scale - bias, as evaluated in the fragment shader
+    glm::vec2 DepthSliceParams() const
+    {
+        float logRatio = std::log(config.farZ / config.nearZ);
+        return glm::vec2(config.z / logRatio, config.z * std::log(config.nearZ) / logRatio);
+    }
+
+private:
+    ClusterConfig config;
+    float projX = 1.0f, projY = 1.0f;
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    std::vector<glm::vec4> viewLights; // view-space position + range
+    std::vector<std::vector<std::vector<unsigned int> > > sliceLists; // [slice][tile] -> light indices
+    std::vector<glm::uvec2> grid;
+    std::vector<unsigned int> indices;
+
+    unsigned int Index(unsigned int i, unsigned int j, unsigned int k) const
+    {
+        return (k * config.y + j) * config.x + i;
+    }
+
+    float SliceDepth(unsigned int k) const
+    {
+        return config.nearZ * std::pow(config.farZ / config.nearZ, (float)k / (float)config.z);
+    }
+
+    static int TileOf(float ndc, unsigned int tiles)
+    {
+        int t = (int)std::floor((ndc * 0.5f + 0.5f) * tiles);
+        return std::min(std::max(t, 0), (int)tiles - 1);
+    }
+
+    void AssignSlice(unsigned int k)
+    {
+        std::vector<std::vector<unsigned int> >& lists = sliceLists[k];
+        for (std::vector<unsigned int>& list : lists)
+            list.clear();
+
+        float zn = SliceDepth(k), zf = SliceDepth(k + 1);
+        for (size_t l = 0; l < viewLights.size(); l++) {
+            const glm::vec4& s = viewLights[l];
+            float depth = -s.z, r = s.w;
+            if (depth + r < zn || depth - r > zf)
+                continue;
+
+            // conservative tile range: the sphere's x/y extent divided by the nearest and farthest depth it covers in this slice
+            float dNear = std::max(zn, depth - r), dFar = std::min(zf, depth + r);
+            float nx0 = projX * std::min((s.x - r) / dNear, (s.x - r) / dFar);
+            float nx1 = projX * std::max((s.x + r) / dNear, (s.x + r) / dFar);
+            float ny0 = projY * std::min((s.y - r) / dNear, (s.y - r) / dFar);
+            float ny1 = projY * std::max((s.y + r) / dNear, (s.y + r) / dFar);
+            if (nx1 < -1.0f || nx0 > 1.0f || ny1 < -1.0f || ny0 > 1.0f)
+                continue;
+            int i0 = TileOf(nx0, config.x), i1 = TileOf(nx1, config.x);
+            int j0 = TileOf(ny0, config.y), j1 = TileOf(ny1, config.y);
+
+            glm::vec3 center(s);
+            for (int j = j0; j <= j1; j++)
+                for (int i = i0; i <= i1; i++) {
+                    unsigned int c = Index(i, j, k);
+                    glm::vec3 closest = glm::clamp(center, boundsMin[c], boundsMax[c]);
+                    glm::vec3 d = closest - center;
+                    if (glm::dot(d, d) <= r * r)
+                        lists[j * config.x + i].push_back((unsigned int)l);
+                }
+        }
+    }
+};
+
+// GPU side: lights (4 texels each), the per-cluster (offset, count) grid and the index list,
+// each in a buffer texture so a GLSL 3.30 shader can texelFetch them
+class ClusterLightBuffers
+{
+public:
+    void Init()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // the lights only change when the scene does
+    void UploadLights(const std::vector<ClusterPointLight>& lights)
+    {
+        Upload(LIGHTS, lights.data(), lights.size() * sizeof(ClusterPointLight), GL_STATIC_DRAW);
+    }
+
+    // the grid and index list are rebuilt every frame
+    void UploadClusters(const LightClusterGrid& clusters)
+    {
+        Upload(GRID, clusters.Grid().data(), clusters.Grid().size() * sizeof(glm::uvec2), GL_STREAM_DRAW);
+        Upload(INDICES, clusters.Indices().data(), clusters.Indices().size() * sizeof(unsigned int), GL_STREAM_DRAW);
+    }
+
+    // binds lights, grid and indices to three consecutive texture units starting at firstUnit
+    void Bind(unsigned int firstUnit) const
+    {
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Destroy()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+private:
+    enum { LIGHTS, GRID, INDICES };
+    unsigned int buffers[3] = { 0, 0, 0 };
+    unsigned int textures[3] = { 0, 0, 0 };
+
+    void Upload(int which, const void* data, size_t bytes, GLenum usage)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[which]);
+        // never hand GL an empty store: texelFetch on a zero-sized buffer texture is undefined
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), NULL, usage);
+        if (bytes)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif
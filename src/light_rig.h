@@ -0,0 +1,167 @@
+#ifndef LIGHT_RIG_H
+#define LIGHT_RIG_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+
+// C++ mirror of the std140 'LightRig' uniform block in 6.multiple_lights.fs.
+// Every vec3 occupies 16 bytes under std140, so the scalar terms are packed
+// into the fourth component slot of the preceding vec3 (same order as the GLSL structs).
+#define NR_POINT_LIGHTS 4
+
+struct DirLightStd140 {
+    glm::vec3 direction; float pad0;
+    glm::vec3 ambient;   float pad1;
+    glm::vec3 diffuse;   float pad2;
+    glm::vec3 specular;  float pad3;
+};
+
+struct PointLightStd140 {
+    glm::vec3 position; float constant;
+    glm::vec3 ambient;  float linear;
+    glm::vec3 diffuse;  float quadratic;
+    glm::vec3 specular; float pad0;
+};
+
+struct SpotLightStd140 {
+    glm::vec3 position;  float cutOff;
+    glm::vec3 direction; float outerCutOff;
+    glm::vec3 ambient;   float constant;
+    glm::vec3 diffuse;   float linear;
+    glm::vec3 specular;  float quadratic;
+};
+
+struct LightRigStd140 {
+    DirLightStd140 dirLight;
+    PointLightStd140 pointLights[NR_POINT_LIGHTS];
+    SpotLightStd140 spotLight;
+};
+
+static_assert(sizeof(DirLightStd140) == 64, "DirLight must match the std140 layout");
+static_assert(sizeof(PointLightStd140) == 64, "PointLight must match the std140 layout");
+static_assert(sizeof(SpotLightStd140) == 80, "SpotLight must match the std140 layout");
+static_assert(offsetof(LightRigStd140, pointLights) == 64, "LightRig must match the std140 layout");
+static_assert(offsetof(LightRigStd140, spotLight) == 64 + 64 * NR_POINT_LIGHTS, "LightRig must match the std140 layout");
+
+// Owns the uniform buffer behind the 'LightRig' block. Setters only mark a light dirty when its
+// data actually changed; Upload() then sends the dirty lights with one glBufferSubData per contiguous run.
+class LightRigBuffer
+{
+public:
+    static const unsigned int BINDING = 0;
+
+    LightRigStd140 data;
+
+    LightRigBuffer() : data() {}
+
+    void Init()
+    {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightRigStd140), &data, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+        dirtyMask = 0;
+    }
+
+    // points the program's 'LightRig' block at our binding point; call once per program after linking
+    void Attach(unsigned int program) const
+    {
+        unsigned int blockIndex = glGetUniformBlockIndex(program, "LightRig");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, blockIndex, BINDING);
+    }
+
+    void SetDirLight(const DirLightStd140& light)
+    {
+        if (std::memcmp(&data.dirLight, &light, sizeof(light)) != 0) {
+            data.dirLight = light;
+            dirtyMask |= 1u << 0;
+        }
+    }
+
+    void SetPointLight(int i, const PointLightStd140& light)
+    {
+        if (std::memcmp(&data.pointLights[i], &light, sizeof(light)) != 0) {
+            data.pointLights[i] = light;
+            dirtyMask |= 1u << (1 + i);
+        }
+    }
+
+    void SetSpotLight(const SpotLightStd140& light)
+    {
+        if (std::memcmp(&data.spotLight, &light, sizeof(light)) != 0) {
+            data.spotLight = light;
+            dirtyMask |= 1u << SPOT_BIT;
+        }
+    }
+
+    // the only per-frame change: the flashlight follows the camera
+    void SetSpotPose(const glm::vec3& position, const glm::vec3& direction)
+    {
+        if (data.spotLight.position != position || data.spotLight.direction != direction) {
+            data.spotLight.position = position;
+            data.spotLight.direction = direction;
+            dirtyMask |= 1u << SPOT_BIT;
+        }
+    }
+
+    // returns the number of bytes sent to the GPU
+    size_t Upload()
+    {
+        if (dirtyMask == 0)
+            return 0;
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        size_t uploaded = 0;
+        int bit = 0;
+        while (bit <= SPOT_BIT) {
+            if (!(dirtyMask & (1u << bit))) { bit++; continue; }
+            int first = bit;
+            while (bit <= SPOT_BIT && (dirtyMask & (1u << bit)))
+                bit++;
+            size_t begin = SectionOffset(first);
+            size_t end = SectionOffset(bit - 1) + SectionSize(bit - 1);
+            glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, reinterpret_cast<const char*>(&data) + begin);
+            uploaded += end - begin;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirtyMask = 0;
+        return uploaded;
+    }
+
+    void Destroy()
+    {
+        glDeleteBuffers(1, &ubo);
+        ubo = 0;
+    }
+
+private:
+    // bit 0: dirLight, bits 1..NR_POINT_LIGHTS: pointLights[i], last bit: spotLight
+    static const int SPOT_BIT = 1 + NR_POINT_LIGHTS;
+
+    unsigned int ubo = 0;
+    unsigned int dirtyMask = 0;
+
+    static size_t SectionOffset(int bit)
+    {
+        if (bit == 0)
+            return offsetof(LightRigStd140, dirLight);
+        if (bit == SPOT_BIT)
+            return offsetof(LightRigStd140, spotLight);
+        return offsetof(LightRigStd140, pointLights) + (bit - 1) * sizeof(PointLightStd140);
+    }
+
+    static size_t SectionSize(int bit)
+    {
+        if (bit == 0)
+            return sizeof(DirLightStd140);
+        if (bit == SPOT_BIT)
+            return sizeof(SpotLightStd140);
+        return sizeof(PointLightStd140);
+    }
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "geometry_arena.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Screen-space LOD for round geometry
+// -----------------------------------
+// A LodChain holds several tessellations of one shape in a single arena mesh, finest first. Each level
+// records the largest on-screen radius it can serve. A circle of r pixels cut into n segments sags between
+// vertices by r * (1 - cos(pi / n)) ~ r * pi^2 / (2 n^2). Keeping that under LOD_MAX_SAG_PIXELS gives
+// r <= 2 * sag * n^2 / pi^2. Selection refines as soon as an object outgrows its level. It coarsens only
+// once the object is LOD_HYSTERESIS below the coarser level's limit, so an object hovering at a boundary
+// does not pop back and forth every frame.
+
+const float LOD_MAX_SAG_PIXELS = 0.5f;
+const float LOD_HYSTERESIS = 0.15f;
+
+struct LodChain {
+    struct Level {
+        int segments;
+        uint32_t firstIndex, indexCount; // relative to mesh.firstIndex
+        float maxPixelRadius;
+    };
+    ArenaMesh mesh; // every level shares these arena ranges
+    Aabb bounds;    // of the finest level
+    std::vector<Level> levels; // finest first
+
+    // level for an object pixelRadius wide on screen; previous is the level it was drawn at last frame (-1: none)
+    int Select(float pixelRadius, int previous = -1) const
+    {
+        int ideal = 0;
+        while (ideal + 1 < (int)levels.size() && pixelRadius <= levels[ideal + 1].maxPixelRadius)
+            ideal++;
+        if (previous < 0 || ideal <= previous)
+            return ideal;
+        // coarsening: only as far as the margin allows
+        int level = previous;
+        while (level < ideal && pixelRadius <= levels[level + 1].maxPixelRadius * (1.0f - LOD_HYSTERESIS))
+            level++;
+        return level;
+    }
+
+    // the level with that many segments, or -1
+    int Find(int segments) const
+    {
+        for (size_t i = 0; i < levels.size(); i++)
+            if (levels[i].segments == segments)
+                return (int)i;
+        return -1;
+    }
+
+    unsigned int Triangles(int level) const { return levels[level].indexCount / 3; }
+};
+
+// radius in pixels of a sphere of worldRadius at distance from the eye
+inline float ProjectedRadius(float worldRadius, float distance, const glm::mat4& projection, int viewportHeight)
+{
+    return worldRadius * viewportHeight * projection[1][1] * 0.5f / std::max(distance, 0.1f);
+}
+
+// any finite chain of segment counts works; the fixed mesh the demo used before had 64
+const int CYLINDER_LOD_SEGMENTS[] = { 96, 64, 32, 16, 8 };
+const int CYLINDER_FIXED_SEGMENTS = 64;
+
+// the unit cylinder of BuildCylinderGeometry at every segment count, finest first, in one arena mesh
+inline LodChain CreateCylinderLods(GeometryArena& arena, const int* segments = CYLINDER_LOD_SEGMENTS,
+    int count = (int)(sizeof(CYLINDER_LOD_SEGMENTS) / sizeof(CYLINDER_LOD_SEGMENTS[0])))
+{
+    const float PI = 3.14159265358979323846f;
+    std::vector<float> V;
+    std::vector<unsigned int> I;
+    LodChain chain;
+    for (int i = 0; i < count; i++) {
+        LodChain::Level level;
+        level.segments = segments[i];
+        level.firstIndex = (uint32_t)I.size();
+        size_t firstVertex = V.size();
+        BuildCylinderGeometry(segments[i], V, I);
+        level.indexCount = (uint32_t)I.size() - level.firstIndex;
+        float n = (float)segments[i];
+        level.maxPixelRadius = i == 0 ? 1e30f : 2.0f * LOD_MAX_SAG_PIXELS * n * n / (PI * PI);
+        if (i == 0)
+            chain.bounds = VertexBounds(std::vector<float>(V.begin() + firstVertex, V.end()));
+        chain.levels.push_back(level);
+    }
+    chain.mesh = arena.Add(V, I);
+    return chain;
+}
+
+// objects drawn at each level and their triangles, against drawing every one at a fixed level
+struct LodStats {
+    std::vector<size_t> perLevel;
+    size_t triangles = 0, fixedTriangles = 0, frames = 0;
+
+    void Count(const LodChain& chain, int level, int fixedLevel)
+    {
+        perLevel.resize(chain.levels.size());
+        perLevel[level]++;
+        triangles += chain.Triangles(level);
+        fixedTriangles += chain.Triangles(fixedLevel);
+    }
+
+    void Print(const char* label, const LodChain& chain, int fixedLevel) const
+    {
+        size_t n = std::max<size_t>(frames, 1);
+        std::printf("%s: %zu triangles per frame, %zu with every one at %d segments (%.0f%%) | objects per level:", label,
+            triangles / n, fixedTriangles / n, chain.levels[fixedLevel].segments, fixedTriangles ? 100.0 * triangles / fixedTriangles : 100.0);
+        for (size_t i = 0; i < chain.levels.size(); i++)
+            std::printf(" %d:%zu", chain.levels[i].segments, i < perLevel.size() ? perLevel[i] / n : 0);
+        std::printf("\n");
+    }
+};
+
+#endif
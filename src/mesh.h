@@ -0,0 +1,92 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// appends a unit cylinder (radius 1, height 1 along Z) to V and I
+inline void BuildCylinderGeometry(int segments, std::vector<float>& V, std::vector<unsigned int>& I) { // Make Cylinder
+    // pos(3) + normal(3) + uv(2) = 8 floats
+    auto push = [&](float x, float y, float z, float nx, float ny, float nz, float u, float v) {
+        V.push_back(x); V.push_back(y); V.push_back(z);
+        V.push_back(nx); V.push_back(ny); V.push_back(nz);
+        V.push_back(u); V.push_back(v);
+        };
+
+    const float PI = 3.14159265358979323846f;
+    const float halfZ = 0.5f;
+
+    // TOP CAP
+    int topCenter = (int)(V.size() / 8);
+    push(0, 0, halfZ, 0, 0, 1, 0.5f, 0.5f); // center
+    int topRingStart = (int)(V.size() / 8);
+    for (int i = 0; i < segments; i++) {
+        float a = (float)i / segments * 2 * PI;
+        float x = cos(a), y = sin(a);
+        push(x, y, halfZ, 0, 0, 1, x * 0.5f + 0.5f, y * 0.5f + 0.5f); // ring
+    }
+    for (int i = 0; i < segments; i++) {
+        I.push_back(topCenter);
+        I.push_back(topRingStart + i);
+        I.push_back(topRingStart + ((i + 1) % segments));
+    }
+
+    // BOTTOM CAP
+    int bottomCenter = (int)(V.size() / 8);
+    push(0, 0, -halfZ, 0, 0, -1, 0.5f, 0.5f);
+    int bottomRingStart = (int)(V.size() / 8);
+    for (int i = 0; i < segments; i++) {
+        float a = (float)i / segments * 2 * PI;
+        float x = cos(a), y = sin(a);
+        push(x, y, -halfZ, 0, 0, -1, x * 0.5f + 0.5f, y * 0.5f + 0.5f);
+    }
+    for (int i = 0; i < segments; i++) {
+        I.push_back(bottomCenter);
+        I.push_back(bottomRingStart + ((i + 1) % segments));
+        I.push_back(bottomRingStart + i);
+    }
+
+    // SIDE
+    int sideStart = (int)(V.size() / 8);
+    for (int i = 0; i <= segments; i++) {
+        float a = (float)i / segments * 2 * PI;
+        float x = cos(a), y = sin(a);
+        float u = (float)i / segments;
+        // top row
+        push(x, y, halfZ, x, y, 0, u, 1.0f);
+        // bottom row
+        push(x, y, -halfZ, x, y, 0, u, 0.0f);
+    }
+    for (int i = 0; i < segments; i++) {
+        int t0 = sideStart + i * 2;
+        int b0 = t0 + 1;
+        int t1 = sideStart + (i + 1) * 2;
+        int b1 = t1 + 1;
+        I.push_back(t0); I.push_back(b0); I.push_back(t1);
+        I.push_back(t1); I.push_back(b0); I.push_back(b1);
+    }
+}
+
+// reverses every triangle whose winding disagrees with its first vertex's normal, so that all front faces are
+// counter-clockwise (culling depends on it); returns how many were flipped
+inline unsigned int OrientTriangles(const std::vector<float>& V, std::vector<unsigned int>& I)
+{
+    unsigned int flipped = 0;
+    for (size_t t = 0; t + 2 < I.size(); t += 3) {
+        const float* a = &V[I[t] * 8];
+        const float* b = &V[I[t + 1] * 8];
+        const float* c = &V[I[t + 2] * 8];
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float facing = (e1[1] * e2[2] - e1[2] * e2[1]) * a[3] + (e1[2] * e2[0] - e1[0] * e2[2]) * a[4]
+                     + (e1[0] * e2[1] - e1[1] * e2[0]) * a[5];
+        if (facing < 0.0f) {
+            std::swap(I[t + 1], I[t + 2]);
+            flipped++;
+        }
+    }
+    return flipped;
+}
+
+#endif
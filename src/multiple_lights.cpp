@@ -10,13 +10,44 @@
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 
+#include "benchmark_report.h"
+#include "benchmarks.h"
+#include "camera_path.h"
+#include "culling.h"
+#include "dynamic_resolution.h"
+#include "frame_capture.h"
+#include "light_clusters.h"
+#include "gear_mesh.h"
+#include "gear_train.h"
+#include "headless.h"
+#include "irradiance_volume.h"
+#include "light_rig.h"
+#include "lod.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "scene.h"
+#include "shader_cache.h"
+#include "shader_variants.h"
+#include "shadows.h"
+#include "simulation.h"
+#include "star_irradiance.h"
+#include "starfield.h"
+#include "texture_loader.h"
+#include "thread_pool.h"
+#include "uniforms.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-unsigned int loadTexture(const char *path);
+bool keyPressedOnce(GLFWwindow *window, int key);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -28,105 +59,274 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// timing: the steady clock both threads read, and the render loop's own time (a fixed 1/60 s per frame in
+// fixed-clock runs) with the length of the last frame
+SteadyClock steadyClock;
+FrameClock frameClock;
 
-// lighting
-glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+// how gears are drawn (cycle with I): one baked mesh per gear, or a cylinder hub plus cube teeth drawn
+// with one instanced call for every tooth of every gear, or with the old one-draw-per-tooth path
+enum GearRenderMode { GEARS_BAKED, GEARS_INSTANCED_TEETH, GEARS_PER_TOOTH, GEAR_RENDER_MODES };
+const char* const GEAR_RENDER_MODE_NAMES[GEAR_RENDER_MODES] = { "baked", "instanced teeth", "per-tooth" };
+GearRenderMode gearRenderMode = GEARS_BAKED;
+unsigned int drawCalls = 0; // draw calls issued this frame
+unsigned int trianglesDrawn = 0; // triangles submitted this frame (stars are points and not counted)
+
+// per-pass profiler summary with the once-a-second stats (toggle with P; needs a build with PROFILER on)
+bool showProfile = false;
+
+// point lights: the fixed 4-light loop, or clustered forward shading over any number of lights (toggle with C)
+bool clusteredLighting = false;
+
+// lighting shader: variants specialized for the lights in use, or the uber-shader (toggle with V)
+bool shaderVariants = true;
+// the camera's flashlight (toggle with F); while it is off the variants leave the spotlight out entirely
+bool flashlightOn = true;
+
+// frustum culling of gears, lamps and star cells against the scene's bounding-volume hierarchy (toggle with B)
+bool frustumCulling = true;
+
+// cylinders (hubs, lamps) tessellated for their size on screen, or always at 64 segments (toggle with L)
+bool cylinderLod = true;
+
+// shadows from the directional and point lights: static layers cached, redrawn every frame, or off (cycle with H)
+ShadowMode shadowMode = SHADOWS_CACHED;
+
+// scene resolution steered by the GPU frame time (toggle with R), and the filter that upscales it (cycle with U)
+bool dynamicResolution = false;
+UpscaleFilter upscaleFilter = UPSCALE_BILINEAR;
 
-struct Mesh {
-    unsigned int vao = 0, vbo = 0, ebo = 0;
-    int indexCount = 0;
+// the static lights' ambient and diffuse read from the baked irradiance volume instead of evaluated per fragment
+// (toggle with K); only used by the lighting variants, and only while shadows and clustered lighting are off
+bool bakedLighting = false;
+
+// the benchmark target (GEARS_BENCHMARK) is this demo with --benchmark on by default
+#ifdef GEARS_BENCHMARK
+const bool BENCHMARK_BUILD = true;
+#else
+const bool BENCHMARK_BUILD = false;
+#endif
+
+// command line options
+// --------------------
+struct AppOptions {
+    bool benchmark = BENCHMARK_BUILD; // --benchmark: fixed clock, scripted camera, frame-time report, then exit
+    bool benchClusters = false;     // --bench-clusters: headless light-assignment benchmark, then exit
+    bool benchGears = false;        // --bench-gears: headless gear-train kinematics benchmark, then exit
+    bool benchStars = false;        // --bench-stars: headless starfield generation benchmark, then exit
+    bool clustered = false;         // --clustered: start in clustered lighting mode
+    unsigned int extraLights = 0;   // --point-lights N: small lights scattered around the gears (clustered mode only)
+    unsigned int stars = 50;        // --stars N
+    unsigned int starSeed = 1;      // --star-seed S
+    bool headless = false;          // --headless: offscreen EGL rendering, no window, vsync or input
+    unsigned int frames = 300;      // --frames N: frames rendered in headless and benchmark mode
+    unsigned int warmup = 30;       // --warmup N: benchmark frames rendered before measuring
+    int width = SCR_WIDTH;          // --size WxH: window or offscreen resolution
+    int height = SCR_HEIGHT;
+    std::string dumpPrefix;         // --dump PREFIX: write the last headless frame to PREFIX.ppm
+    unsigned int dumpEvery = 0;     // --dump-every N: also write every Nth frame to PREFIX_<frame>.ppm
+    std::string profileTrace;       // --profile-trace FILE: Chrome trace JSON of every profiled zone, written at exit
+    std::string profileCsv;         // --profile-csv FILE: the same events as CSV
+    unsigned int gears = 0;         // --gears N: rows of N generated gears instead of the seven-gear demo train
+    unsigned int teeth = 0;         // --teeth T: teeth per generated gear (0: 8..32, picked per gear)
+    int gearMode = GEARS_BAKED;     // --gear-mode baked|instanced|per-tooth: starting gear render mode
+    std::string cameraPath;         // --camera-path FILE: camera keys replayed in benchmark mode (default: an orbit)
+    std::string recordCamera;       // --record-camera FILE: write this run's camera path at exit
+    std::string report = "benchmark_report.json"; // --report FILE: benchmark report JSON ("-": stdout)
+    bool syncTextures = false;      // --sync-textures: finish loading textures before the first frame
+    bool textureCache = true;       // --no-texture-cache: always decode, never read or write cooked .gtex files
+    bool cookTextures = false;      // --cook-textures: cook every image in resources/textures, then exit
+    bool shaderCache = true;        // --no-shader-cache: compile and link every program from source
+    bool uberShader = false;        // --uber-shader: start with the uber-shader instead of specialized variants
+    bool benchVariants = false;     // --bench-variants: lighting fragment cost, uber-shader against each variant, then exit
+    int vertexFormat = VERTEX_FLOAT; // --vertex-format float|packed|snorm16: how the geometry arena stores vertices
+    bool benchVertexFormats = false; // --bench-vertex-formats: memory and vertex fetch of dense gears in each format, then exit
+    bool culling = true;            // --no-culling: start with frustum culling off
+    bool cylinderLod = true;        // --no-lod: start with every cylinder at the fixed 64 segments
+    int shadows = SHADOWS_CACHED;   // --shadows off|cached|uncached: starting shadow mode
+    int shadowPcf = 1;              // --shadow-pcf R: shadow filter radius in texels (0: one hardware-filtered tap)
+    bool benchShadows = false;      // --bench-shadows: shadow pass time with cached and with uncached static layers, then exit
+    double simHz = 120.0;           // --sim-hz N: simulation ticks per second
+    bool lockstep = false;          // --lockstep: step the simulation on the render thread instead of its own
+    bool realtime = false;          // --realtime: headless and benchmark runs on the wall clock, with the simulation thread
+    double simLoadMs = 0.0;         // --sim-load MS: busy work added to every simulation tick
+    double frameLoadMs = 0.0;       // --frame-load MS: busy work added to every rendered frame
+    float resolutionBudgetMs = 0.0f; // --resolution-budget MS: start with dynamic resolution aiming at MS of GPU time per frame
+    float renderScale = 1.0f;       // --render-scale S: scene resolution as a fraction of the output (fixed, or where dynamic starts)
+    float minRenderScale = 0.5f;    // --min-render-scale S: lowest scale dynamic resolution may choose
+    int upscale = UPSCALE_BILINEAR; // --upscale bilinear|sharp: filter from the scene resolution to the output
+    std::string scene;              // --scene FILE: gears, lights, stars and material from a scene file instead of the built-in demo
+    std::string exportScene;        // --export-scene FILE: write the scene as text, then exit
+    std::string capture;            // --capture FILE: record every frame to FILE (.y4m) or FILE_<frame>.ppm, on a fixed clock
+    unsigned int captureFps = 60;   // --capture-fps N: frame rate of the capture clock
+    unsigned int captureQueue = 16; // --capture-queue N: frames waiting for the writer before frames are dropped
+    bool bakedLighting = false;     // --baked-lighting: start with the static lights read from the irradiance volume
+    int irradianceProbes = 64;      // --irradiance-probes N: probes along the longest side of the volume
 };
 
-static Mesh CreateCylinderMesh(int segments = 64) { // Make Cylinder
-    Mesh m;
-    std::vector<float> V; // pos(3) + normal(3) + uv(2) = 8 floats
-    std::vector<unsigned int> I;
-
-    auto push = [&](float x, float y, float z, float nx, float ny, float nz, float u, float v) {
-        V.push_back(x); V.push_back(y); V.push_back(z);
-        V.push_back(nx); V.push_back(ny); V.push_back(nz);
-        V.push_back(u); V.push_back(v);
-        };
-
-    const float PI = 3.14159265358979323846f;
-    const float halfZ = 0.5f;
-
-    // TOP CAP
-    int topCenter = (int)(V.size() / 8);
-    push(0, 0, halfZ, 0, 0, 1, 0.5f, 0.5f); // center
-    int topRingStart = (int)(V.size() / 8);
-    for (int i = 0; i < segments; i++) {
-        float a = (float)i / segments * 2 * PI;
-        float x = cos(a), y = sin(a);
-        push(x, y, halfZ, 0, 0, 1, x * 0.5f + 0.5f, y * 0.5f + 0.5f); // ring
-    }
-    for (int i = 0; i < segments; i++) {
-        I.push_back(topCenter);
-        I.push_back(topRingStart + i);
-        I.push_back(topRingStart + ((i + 1) % segments));
-    }
-
-    // BOTTOM CAP
-    int bottomCenter = (int)(V.size() / 8);
-    push(0, 0, -halfZ, 0, 0, -1, 0.5f, 0.5f);
-    int bottomRingStart = (int)(V.size() / 8);
-    for (int i = 0; i < segments; i++) {
-        float a = (float)i / segments * 2 * PI;
-        float x = cos(a), y = sin(a);
-        push(x, y, -halfZ, 0, 0, -1, x * 0.5f + 0.5f, y * 0.5f + 0.5f);
-    }
-    for (int i = 0; i < segments; i++) {
-        I.push_back(bottomCenter);
-        I.push_back(bottomRingStart + ((i + 1) % segments));
-        I.push_back(bottomRingStart + i);
-    }
-
-    // SIDE
-    int sideStart = (int)(V.size() / 8);
-    for (int i = 0; i <= segments; i++) {
-        float a = (float)i / segments * 2 * PI;
-        float x = cos(a), y = sin(a);
-        float u = (float)i / segments;
-        // top row
-        push(x, y, halfZ, x, y, 0, u, 1.0f);
-        // bottom row
-        push(x, y, -halfZ, x, y, 0, u, 0.0f);
-    }
-    for (int i = 0; i < segments; i++) {
-        int t0 = sideStart + i * 2;
-        int b0 = t0 + 1;
-        int t1 = sideStart + (i + 1) * 2;
-        int b1 = t1 + 1;
-        I.push_back(t0); I.push_back(b0); I.push_back(t1);
-        I.push_back(t1); I.push_back(b0); I.push_back(b1);
-    }
-
-    glGenVertexArrays(1, &m.vao);
-    glGenBuffers(1, &m.vbo);
-    glGenBuffers(1, &m.ebo);
-
-    glBindVertexArray(m.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
-    glBufferData(GL_ARRAY_BUFFER, V.size() * sizeof(float), V.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, I.size() * sizeof(unsigned int), I.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    m.indexCount = (int)I.size();
-    glBindVertexArray(0);
-    return m;
+AppOptions ParseOptions(int argc, char* argv[])
+{
+    AppOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--benchmark") == 0)
+            options.benchmark = true;
+        else if (std::strcmp(argv[i], "--bench-clusters") == 0)
+            options.benchClusters = true;
+        else if (std::strcmp(argv[i], "--bench-gears") == 0)
+            options.benchGears = true;
+        else if (std::strcmp(argv[i], "--bench-stars") == 0)
+            options.benchStars = true;
+        else if (std::strcmp(argv[i], "--stars") == 0 && i + 1 < argc)
+            options.stars = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--star-seed") == 0 && i + 1 < argc)
+            options.starSeed = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--clustered") == 0)
+            options.clustered = true;
+        else if (std::strcmp(argv[i], "--point-lights") == 0 && i + 1 < argc)
+            options.extraLights = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            options.frames = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+            {
+                std::cout << "Bad --size, expected WxH: " << argv[i] << std::endl;
+                options.width = SCR_WIDTH;
+                options.height = SCR_HEIGHT;
+            }
+        }
+        else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            options.dumpPrefix = argv[++i];
+        else if (std::strcmp(argv[i], "--dump-every") == 0 && i + 1 < argc)
+            options.dumpEvery = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc)
+            options.profileTrace = argv[++i];
+        else if (std::strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+            options.profileCsv = argv[++i];
+        else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            options.warmup = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--gears") == 0 && i + 1 < argc)
+            options.gears = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--teeth") == 0 && i + 1 < argc)
+            options.teeth = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--gear-mode") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (std::strcmp(mode, "baked") == 0)
+                options.gearMode = GEARS_BAKED;
+            else if (std::strcmp(mode, "instanced") == 0)
+                options.gearMode = GEARS_INSTANCED_TEETH;
+            else if (std::strcmp(mode, "per-tooth") == 0)
+                options.gearMode = GEARS_PER_TOOTH;
+            else
+                std::cout << "Unknown --gear-mode " << mode << ", expected baked, instanced or per-tooth" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc)
+            options.cameraPath = argv[++i];
+        else if (std::strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc)
+            options.recordCamera = argv[++i];
+        else if (std::strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+            options.report = argv[++i];
+        else if (std::strcmp(argv[i], "--sync-textures") == 0)
+            options.syncTextures = true;
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            options.textureCache = false;
+        else if (std::strcmp(argv[i], "--cook-textures") == 0)
+            options.cookTextures = true;
+        else if (std::strcmp(argv[i], "--no-shader-cache") == 0)
+            options.shaderCache = false;
+        else if (std::strcmp(argv[i], "--uber-shader") == 0)
+            options.uberShader = true;
+        else if (std::strcmp(argv[i], "--bench-variants") == 0)
+            options.benchVariants = true;
+        else if (std::strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+        {
+            const char* format = argv[++i];
+            int found = -1;
+            for (int f = 0; f < VERTEX_FORMATS; f++)
+                if (std::strcmp(format, VERTEX_FORMAT_NAMES[f]) == 0)
+                    found = f;
+            if (found >= 0)
+                options.vertexFormat = found;
+            else
+                std::cout << "Unknown --vertex-format " << format << ", expected float, packed or snorm16" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--bench-vertex-formats") == 0)
+            options.benchVertexFormats = true;
+        else if (std::strcmp(argv[i], "--no-culling") == 0)
+            options.culling = false;
+        else if (std::strcmp(argv[i], "--no-lod") == 0)
+            options.cylinderLod = false;
+        else if (std::strcmp(argv[i], "--shadows") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            int found = -1;
+            for (int m = 0; m < SHADOW_MODES; m++)
+                if (std::strcmp(mode, SHADOW_MODE_NAMES[m]) == 0)
+                    found = m;
+            if (found >= 0)
+                options.shadows = found;
+            else
+                std::cout << "Unknown --shadows " << mode << ", expected off, cached or uncached" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--shadow-pcf") == 0 && i + 1 < argc)
+            options.shadowPcf = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--bench-shadows") == 0)
+            options.benchShadows = true;
+        else if (std::strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc)
+            options.simHz = std::max(1.0, std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--lockstep") == 0)
+            options.lockstep = true;
+        else if (std::strcmp(argv[i], "--realtime") == 0)
+            options.realtime = true;
+        else if (std::strcmp(argv[i], "--sim-load") == 0 && i + 1 < argc)
+            options.simLoadMs = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--frame-load") == 0 && i + 1 < argc)
+            options.frameLoadMs = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--resolution-budget") == 0 && i + 1 < argc)
+            options.resolutionBudgetMs = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+            options.renderScale = std::min(1.0f, std::max(0.25f, (float)std::atof(argv[++i])));
+        else if (std::strcmp(argv[i], "--min-render-scale") == 0 && i + 1 < argc)
+            options.minRenderScale = std::min(1.0f, std::max(0.25f, (float)std::atof(argv[++i])));
+        else if (std::strcmp(argv[i], "--upscale") == 0 && i + 1 < argc)
+        {
+            const char* filter = argv[++i];
+            int found = -1;
+            for (int u = 0; u < UPSCALE_FILTERS; u++)
+                if (std::strcmp(filter, UPSCALE_FILTER_NAMES[u]) == 0)
+                    found = u;
+            if (found >= 0)
+                options.upscale = found;
+            else
+                std::cout << "Unknown --upscale " << filter << ", expected bilinear or sharp" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            options.scene = argv[++i];
+        else if (std::strcmp(argv[i], "--export-scene") == 0 && i + 1 < argc)
+            options.exportScene = argv[++i];
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            options.capture = argv[++i];
+        else if (std::strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc)
+            options.captureFps = (unsigned int)std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--capture-queue") == 0 && i + 1 < argc)
+            options.captureQueue = (unsigned int)std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--baked-lighting") == 0)
+            options.bakedLighting = true;
+        else if (std::strcmp(argv[i], "--irradiance-probes") == 0 && i + 1 < argc)
+            options.irradianceProbes = std::atoi(argv[++i]);
+        else
+            std::cout << "Ignoring unknown option: " << argv[i] << std::endl;
+    }
+    return options;
 }
 
+// lighting
+glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+
 // GEAR PARAMS
 int   N1 = 18;      // teeth count gear 1
 int   N2 = 28;      // teeth count gear 2
@@ -148,84 +348,238 @@ float toothLen = 0.25f;   // radial
 float toothHeight = 0.20f;   // Y
 float thickness = 0.20f;   // Z
 
-void DrawGearHub(Shader& shader, const Mesh& cyl,
-    const glm::mat4& parent, glm::vec3 center,
-    float radius, float thick)
+// which gears touch; speeds and tooth phases are solved from gear 1 turning at omega1
+GearTrain BuildDemoGearTrain()
 {
-    glm::mat4 model = parent;
-    model = glm::translate(model, center);
-    model = glm::scale(model, glm::vec3(radius, radius, thick));
-    shader.setMat4("model", model);
+    const double omega1 = 0.5; // rad/s
+    const float z = 0.05f;
+    GearTrain train;
+    unsigned int g1 = train.AddGear(glm::vec3(-(R1 + R2 + 0.25f) * 0.5f, 0.0f, z), N1, R1);
+    unsigned int g2 = train.AddGear(glm::vec3((R1 + R2 + 0.25f) * 0.5f, 0.0f, z), N2, R2);
+    unsigned int g3 = train.AddGear(glm::vec3(-(R1 + R2 + R3), 0.5f, z), N3, R3);
+    unsigned int g4 = train.AddGear(glm::vec3(-((R3 * 2.0f) + R1), ((R3 * 2.0f) - 0.25f), z), N4, R4);
+    unsigned int g5 = train.AddGear(glm::vec3((R1 + R2) * 0.5f, (R1 * 2.0f) + 0.5f, z), N5, R5);
+    unsigned int g6 = train.AddGear(glm::vec3(-((R3 * 2.0f) + R1 + 0.25f), (-(R3 * 1.0f + 0.25f)), z), N6, R6);
+    unsigned int g7 = train.AddGear(glm::vec3((R1 + R2) * 0.5f, -((R1 * 2.0f) + 0.5f), z), N7, R7);
+    train.AddMesh(g1, g2);
+    train.AddMesh(g1, g3);
+    train.AddMesh(g3, g4);
+    train.AddMesh(g3, g6);
+    train.AddMesh(g2, g5);
+    train.AddMesh(g2, g7);
+    if (unsigned int conflicts = train.Solve(g1, omega1))
+        std::cout << "Gear train: " << conflicts << " meshes would lock the train and are ignored" << std::endl;
+    return train;
+}
 
-    glBindVertexArray(cyl.vao);
-    glDrawElements(GL_TRIANGLES, cyl.indexCount, GL_UNSIGNED_INT, 0);
+// --gears / --teeth: generated rows of meshing gears for scaling runs, driven from the top-left gear
+GearTrain BuildGeneratedGearTrain(unsigned int count, unsigned int teeth)
+{
+    // the cube and baked teeth stick out past the pitch circle, so space the gears a tooth length apart
+    GearTrain train = MakeGearRows(count, (int)teeth, toothLen);
+    train.Solve(0, 0.5);
+    return train;
 }
 
-void DrawGearTeeth(Shader& shader, unsigned int vao,
-    const glm::mat4& parent, glm::vec3 center, int N,
-    float baseRadius, float toothLen, float toothHeight,
-    float thick, float angleRad)
+// The Draw* helpers below submit to the render queue; item carries the program, textures and uniform
+// locations of the pass, and each helper fills in the geometry (all of it in the geometry arena).
+
+// hub cylinder scaled out to the pitch radius, turning with its gear
+void DrawGearHub(RenderQueue& queue, DrawItem item, const LodChain& cyl, int level, const glm::mat4& gearModel, float radius, float thick, float depth)
 {
-    glBindVertexArray(vao);
-    for (int i = 0; i < N; ++i) {
-        float a = angleRad + (float)i * (2.0f * glm::pi<float>() / (float)N);
-        glm::mat4 model = parent;
-        model = glm::translate(model, center);
-        model = glm::rotate(model, a, glm::vec3(0, 0, 1));
-        float offset = baseRadius + toothLen * 0.5f; // ???????????????
-        model = glm::translate(model, glm::vec3(offset, 0, 0));
-        model = glm::scale(model, glm::vec3(toothLen, toothHeight, thick));
-        shader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+    item.arenaMesh = &cyl.mesh;
+    item.firstIndex = cyl.levels[level].firstIndex;
+    item.indexCount = cyl.levels[level].indexCount;
+    item.model = glm::scale(gearModel, glm::vec3(radius, radius, thick));
+    queue.Submit(item, depth);
+    drawCalls++;
+    trianglesDrawn += cyl.Triangles(level);
+}
+
+// one draw per tooth cube, from the transforms GearTrain::BuildToothModels wrote
+void DrawGearTeeth(RenderQueue& queue, DrawItem item, const ArenaMesh& cube, const glm::mat4* toothModels, size_t count, const glm::vec3& eye)
+{
+    item.arenaMesh = &cube;
+    item.indexCount = cube.indexCount;
+    for (size_t t = 0; t < count; t++) {
+        const glm::mat4& tooth = toothModels[t];
+        item.model = tooth;
+        queue.Submit(item, glm::length(glm::vec3(tooth[3]) - eye));
+        drawCalls++;
+        trianglesDrawn += 12;
     }
 }
 
-int main()
+// draws every collected tooth with a single instanced command; the matrices go into the arena's instance stream
+void DrawGearTeethInstanced(RenderQueue& queue, DrawItem item, const ArenaMesh& cube, const std::vector<glm::mat4>& instances)
+{
+    if (instances.empty())
+        return;
+    item.arenaMesh = &cube;
+    item.indexCount = cube.indexCount;
+    item.instanceModels = instances.data();
+    item.instances = (GLsizei)instances.size();
+    queue.Submit(item, 0.0f);
+    drawCalls++;
+    trianglesDrawn += 12 * (unsigned int)instances.size();
+}
+
+// a gear's box for culling: a cylinder reaching the tooth tips (the outer corners of a cube tooth), thickness deep
+Aabb GearBounds(const glm::vec3& center, float radius)
+{
+    float tip = std::sqrt((radius + toothLen) * (radius + toothLen) + 0.25f * toothHeight * toothHeight);
+    glm::vec3 half(tip, tip, 0.5f * thickness);
+    return Aabb(center - half, center + half);
+}
+
+// objects and stars that survived culling, and what it cost, summed over frames
+struct CullStats {
+    size_t gears = 0, lamps = 0, starCells = 0, stars = 0, nodes = 0, frames = 0;
+    double ms = 0.0;
+
+    void Print(const char* label, size_t totalGears, size_t totalLamps, size_t totalCells, size_t totalStars) const
+    {
+        size_t n = std::max<size_t>(frames, 1);
+        size_t submitted = (gears + lamps + starCells) / n, total = totalGears + totalLamps + totalCells;
+        std::printf("%s: %zu of %zu objects submitted per frame (%zu culled) | gears %zu/%zu, lamps %zu/%zu, star cells %zu/%zu with %zu/%zu stars"
+                    " | %.3f ms and %zu BVH nodes per frame\n", label, submitted, total, total - submitted,
+            gears / n, totalGears, lamps / n, totalLamps, starCells / n, totalCells, stars / n, totalStars, ms / n, nodes / n);
+    }
+};
+
+int main(int argc, char* argv[])
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    auto appStart = std::chrono::high_resolution_clock::now();
+    steadyClock.Start();
+    AppOptions options = ParseOptions(argc, argv);
+    if (options.benchClusters)
+    {
+        RunClusterBenchmark();
+        return 0;
+    }
+    if (options.benchGears)
+    {
+        RunGearTrainBenchmark();
+        return 0;
+    }
+    if (options.benchStars)
+    {
+        RunStarfieldBenchmark();
+        return 0;
+    }
+    if (options.cookTextures)
+    {
+        CookTextureDirectory(FileSystem::getPath("resources/textures"));
+        return 0;
+    }
+
+    // --scene: the gear layout, lights, stars and material come from a scene file (compiled on first use, then
+    // memory-mapped) instead of the built-in demo train and the globals above
+    CompiledScene scene;
+    if (!options.scene.empty())
+    {
+        if (!LoadScene(options.scene, scene))
+            return -1;
+        toothLen = scene.header->toothLength;
+        toothHeight = scene.header->toothHeight;
+        thickness = scene.header->toothThickness;
+    }
+    clusteredLighting = options.clustered;
+    gearRenderMode = (GearRenderMode)options.gearMode;
+    shaderVariants = !options.uberShader;
+    frustumCulling = options.culling;
+    cylinderLod = options.cylinderLod;
+    shadowMode = (ShadowMode)options.shadows;
+    dynamicResolution = options.resolutionBudgetMs > 0.0f;
+    upscaleFilter = (UpscaleFilter)options.upscale;
+    bakedLighting = options.bakedLighting;
+
+    // headless and benchmark runs render a set number of frames on a fixed 60 Hz clock, so every run renders the same
+    // frames (--realtime keeps the count but uses the wall clock); --bench-variants, --bench-vertex-formats and
+    // --bench-shadows render none, they only need the scene set up. A capture runs every frame on a fixed clock of
+    // its frame rate, windowed or not, so the recording plays back at the scene's own speed.
+    const bool sceneBenchmark = options.benchVariants || options.benchVertexFormats || options.benchShadows || !options.exportScene.empty();
+    const bool countedRun = options.headless || options.benchmark || sceneBenchmark;
+    const bool capturing = !options.capture.empty() && !sceneBenchmark;
+    const bool fixedClock = (countedRun && !options.realtime) || capturing;
+    const double fixedClockHz = capturing ? options.captureFps : 60.0;
+    const unsigned int warmupFrames = options.benchmark ? options.warmup : 0;
+    const unsigned int totalFrames = sceneBenchmark ? 0 : warmupFrames + options.frames;
+
+    // create the GL context: a GLFW window, or a surfaceless EGL context for --headless
+    // -----------------------------------------------------------------------------------
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
+    if (options.headless)
+    {
+        if (!headlessContext.Create())
+            return -1;
+    }
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
         glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(options.width, options.height, "LearnOpenGL", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    GLADloadproc glLoader = options.headless ? (GLADloadproc)HeadlessContext::GetProcAddress : (GLADloadproc)glfwGetProcAddress;
+    if (!gladLoadGLLoader(glLoader))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
 
+    // headless frames go to an offscreen framebuffer at the requested size
+    OffscreenTarget offscreen;
+    if (options.headless && !offscreen.Create(options.width, options.height))
+        return -1;
+
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
+    glEnable(GL_PROGRAM_POINT_SIZE); // stars set gl_PointSize in 6.light_cube.vs
 
     // build and compile our shader zprogram
     // ------------------------------------
-    Shader lightingShader("6.multiple_lights.vs", "6.multiple_lights.fs");
-    Shader lightCubeShader("6.light_cube.vs", "6.light_cube.fs");
+    // linked programs are kept as driver binaries in shader_cache/ and reloaded while sources and driver match
+    ProgramBinaryCache programCache;
+    if (options.shaderCache)
+        programCache.Init(glLoader, "shader_cache");
+    auto shaderStart = std::chrono::high_resolution_clock::now();
+    // the lighting shader starts as the uber-shader; specialized variants are built the first time they are drawn
+    LightingVariants lightingVariants;
+    lightingVariants.Init("6.multiple_lights.vs", "6.multiple_lights.fs", &programCache);
+    CachedShader lightCubeShader("6.light_cube.vs", "6.light_cube.fs", &programCache);
+    CachedShader shadowDepthShader("6.shadow_depth.vs", "6.shadow_depth.fs", &programCache);
+    CachedShader upscaleShader("6.upscale.vs", "6.upscale.fs", &programCache);
+    std::cout << "shaders ready in " << ElapsedMs(shaderStart) << " ms" << std::endl;
+    programCache.PrintStats();
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -293,302 +647,1022 @@ int main()
         glm::vec3(3.0f,  -3.0f, 0.0f),
         glm::vec3( -6.0f,  -3.0f, 0.0f)
     };
-    // first, configure the cube's VAO (and VBO)
-    unsigned int VBO, cubeVAO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &VBO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindVertexArray(cubeVAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
-    unsigned int lightCubeVAO;
-    glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // note that we update the lamp's position attribute's stride to reflect the updated buffer data
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // Mesh
-    Mesh hubMesh = CreateCylinderMesh(64); // config segments more smooth (3296)
-
-    // load textures (we now use a utility function to keep the code more organized)
-    // -----------------------------------------------------------------------------
-    unsigned int diffuseMap = loadTexture(FileSystem::getPath("resources/textures/oxidized-coppper-roughness.png").c_str());
-    unsigned int specularMap = loadTexture(FileSystem::getPath("resources/textures/oxidized-copper-albedo.png").c_str());
+    if (scene.Loaded())
+        for (int i = 0; i < NR_POINT_LIGHTS; i++)
+            pointLightPositions[i] = scene.Array<glm::vec3>(SCENE_LIGHT_POSITION)[i];
+    // all static geometry lives in one arena: one vertex buffer, one index buffer and one VAO for the cube,
+    // the cylinder and every baked gear, so the whole lit scene can go out as a few multi-draws
+    GeometryArena geometryArena;
+    geometryArena.Init(glLoader, (VertexFormat)options.vertexFormat);
+    std::vector<unsigned int> cubeIndices(36);
+    for (unsigned int i = 0; i < 36; i++)
+        cubeIndices[i] = i;
+    // the cube's faces are not all wound the same way, and the shadow pass culls front faces
+    std::vector<float> cubeVertices(vertices, vertices + sizeof(vertices) / sizeof(float));
+    OrientTriangles(cubeVertices, cubeIndices);
+    ArenaMesh cubeMesh = geometryArena.Add(cubeVertices, cubeIndices);
+
+    // gear positions, speeds and phases; angles and transforms are recomputed from this each frame
+    const bool generatedGears = !scene.Loaded() && (options.gears > 0 || options.teeth > 0);
+    auto gearTrainStart = std::chrono::high_resolution_clock::now();
+    GearTrain gearTrain = scene.Loaded() ? scene.MakeGearTrain()
+                        : generatedGears ? BuildGeneratedGearTrain(options.gears > 0 ? options.gears : 7, options.teeth)
+                        : BuildDemoGearTrain();
+    std::cout << "gear train: " << gearTrain.Size() << " gears, " << gearTrain.ToothCount() << " teeth "
+              << (scene.Loaded() ? "from the scene" : generatedGears ? "generated and solved" : "built and solved")
+              << " in " << ElapsedMs(gearTrainStart) << " ms" << std::endl;
+    glm::vec3 gearsMin, gearsMax;
+    gearTrain.Bounds(gearsMin, gearsMax);
+
+    // baked gear meshes (hub + involute teeth in one mesh, several LODs), shared by gears with the same shape
+    GearMeshCache gearMeshes;
+    gearMeshes.Init(&geometryArena);
+
+    // cylinders for the hubs and lamps: one arena mesh with every tessellation from 96 down to 8 segments;
+    // each object remembers its level from the last frame for the hysteresis
+    LodChain cylinderLods = CreateCylinderLods(geometryArena);
+    const int cylinderFixedLevel = cylinderLods.Find(CYLINDER_FIXED_SEGMENTS);
+    std::vector<int> hubLevels(gearTrain.Size(), -1);
+    int lampLevels[4] = { -1, -1, -1, -1 };
+    LodStats lodStats; // since the last stats line, or over the whole run with a fixed clock
+
+    // load textures: decoded on worker threads and streamed in over the first frames, with a flat colour
+    // bound until each is resident. Golden-image runs and --sync-textures wait for them here instead.
+    // -----------------------------------------------------------------------------------------------
+    AsyncTextureLoader textureLoader;
+    textureLoader.useCache = options.textureCache;
+    SceneMaterial material;
+    material.diffuse = "resources/textures/oxidized-coppper-roughness.png";
+    material.specular = "resources/textures/oxidized-copper-albedo.png";
+    if (scene.Loaded() && scene.header->materials > 0)
+        material = scene.Material(0);
+    int diffuseMap = textureLoader.Load(FileSystem::getPath(material.diffuse), glm::vec3(0.45f, 0.32f, 0.22f));
+    int specularMap = textureLoader.Load(FileSystem::getPath(material.specular), glm::vec3(0.3f));
+    double texturesLoadedMs = -1.0, firstFrameMs = -1.0; // since startup
+    if (options.syncTextures || (options.headless && !options.dumpPrefix.empty()))
+    {
+        textureLoader.Finish();
+        texturesLoadedMs = ElapsedMs(appStart);
+    }
 
     // shader configuration
     // --------------------
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
-    lightingShader.setInt("material.specular", 1);
-
-    glfwMakeContextCurrent(window);
-    glfwSwapInterval(1);   // ???? VSync ????????????
-
-    const unsigned int NR_STARS = 50; // match shader
-    glm::vec3 starPositions[NR_STARS];
-    glm::vec3 starColors[NR_STARS];
-
-    for (unsigned int i = 0; i < NR_STARS; i++) {
-        float rad = 30.0f; // radius of sphere (distance from center/camera)
-    
-        float theta = glm::radians((float)(rand() % 360)); // 0  360
-        float phi   = glm::radians((float)(rand() % 180)); // 0  180
-    
-        float x = (float)rad * sin(phi) * cos(theta);
-        float y = (float)rad * cos(phi);
-        float z = (float)rad * sin(phi) * sin(theta);
-    
-        starPositions[i] = glm::vec3(x, y, z);
-
-        // random star color but still bright
-        float hue = (rand() % 360) / 360.0f; // 0.0  1.0
-        float s = 0.8f;  // saturation
-        float v = 1.0f;  // brightness
-
-        // Convert HSV ? RGB
-        float c = v * s;
-        float d = c * (1 - fabs(fmod(hue * 6.0f, 2.0f) - 1));
-        float m = v - c;
-
-        float r, g, b;
-        if (hue < 1.0 / 6.0) { r = c; g = d; b = 0; }
-        else if (hue < 2.0 / 6.0) { r = d; g = c; b = 0; }
-        else if (hue < 3.0 / 6.0) { r = 0; g = c; b = d; }
-        else if (hue < 4.0 / 6.0) { r = 0; g = d; b = c; }
-        else if (hue < 5.0 / 6.0) { r = d; g = 0; b = c; }
-        else { r = c; g = 0; b =d; }
-
-        starColors[i] = glm::vec3(r + m, g + m, b + m);
+    // resolve uniform locations once; the render loop never looks a uniform up by name
+    // (each lighting program resolves its own, see LightingProgram)
+    LightCubeUniforms lightCubeUniforms;
+    lightCubeUniforms.Resolve(lightCubeShader.ID);
+
+    // light rig
+    // ---------
+    // All lights live in the std140 'LightRig' uniform block. Only the spotlight pose changes per frame,
+    // so the rest is uploaded once here and never touched again.
+    LightRigBuffer lightRig;
+
+    // directional light
+    // default: direction (-0.2, -1.0, -0.3), ambient 0.05, diffuse 0.4, specular 0.5
+    // cool:    direction (-0.5, -1.0, -0.5), ambient (0.1, 0.1, 0.2), diffuse (0.3, 0.3, 0.8), specular (0.5, 0.5, 1.0)
+    // warm
+    DirLightStd140 dirLight = {};
+    dirLight.direction = glm::vec3(-0.3f, -1.0f, -0.1f);
+    dirLight.ambient = glm::vec3(0.3f, 0.25f, 0.2f);
+    dirLight.diffuse = glm::vec3(0.9f, 0.85f, 0.7f);
+    dirLight.specular = glm::vec3(1.0f, 0.95f, 0.8f);
+    if (scene.Loaded())
+    {
+        const SceneDirLight& d = scene.header->dirLight;
+        dirLight.direction = d.direction;
+        dirLight.ambient = d.ambient;
+        dirLight.diffuse = d.diffuse;
+        dirLight.specular = d.specular;
+    }
+    lightRig.SetDirLight(dirLight);
+
+    // point lights
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        PointLightStd140 pointLight = {};
+        pointLight.position = pointLightPositions[i];
+        pointLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+        pointLight.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        pointLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        pointLight.constant = 1.0f;
+        pointLight.linear = 0.09f;
+        pointLight.quadratic = 0.032f;
+        if (scene.Loaded())
+        {
+            ScenePointLight p = scene.PointLight(i);
+            pointLight.ambient = p.ambient;
+            pointLight.diffuse = p.diffuse;
+            pointLight.specular = p.specular;
+            pointLight.constant = p.attenuation.x;
+            pointLight.linear = p.attenuation.y;
+            pointLight.quadratic = p.attenuation.z;
+        }
+        lightRig.SetPointLight(i, pointLight);
+    }
+
+    // spotlight
+    SpotLightStd140 spotLight = {};
+    spotLight.position = camera.Position;
+    spotLight.direction = camera.Front;
+    spotLight.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+    spotLight.diffuse = glm::vec3(1.5f, 1.5f, 1.5f);
+    spotLight.specular = glm::vec3(5.0f, 5.0f, 5.0f);
+    spotLight.constant = 1.0f;
+    spotLight.linear = 0.02f;
+    spotLight.quadratic = 0.001f;
+    float flashlightCutOffDegrees = 5.0f, flashlightOuterCutOffDegrees = 10.0f;
+    if (scene.Loaded())
+    {
+        const SceneSpotLight& s = scene.header->spotLight;
+        spotLight.ambient = s.ambient;
+        spotLight.diffuse = s.diffuse;
+        spotLight.specular = s.specular;
+        spotLight.constant = s.attenuation.x;
+        spotLight.linear = s.attenuation.y;
+        spotLight.quadratic = s.attenuation.z;
+        flashlightCutOffDegrees = s.cutOffDegrees;
+        flashlightOuterCutOffDegrees = s.outerCutOffDegrees;
+    }
+    spotLight.cutOff = glm::cos(glm::radians(flashlightCutOffDegrees));
+    spotLight.outerCutOff = glm::cos(glm::radians(flashlightOuterCutOffDegrees));
+    lightRig.SetSpotLight(spotLight);
+
+    lightRig.Init();
 
+    // clustered point lights
+    // ----------------------
+    // the rig's four point lights plus any extra small lights; their ranges follow from the attenuation terms
+    std::vector<ClusterPointLight> clusterLights;
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        const PointLightStd140& p = lightRig.data.pointLights[i];
+        ClusterPointLight light;
+        light.position = p.position;
+        light.ambient = p.ambient;
+        light.diffuse = p.diffuse;
+        light.specular = p.specular;
+        light.constant = p.constant;
+        light.linear = p.linear;
+        light.quadratic = p.quadratic;
+        light.range = PointLightRange(light);
+        clusterLights.push_back(light);
+    }
+    // a scene's lights past the rig's four
+    for (uint32_t i = NR_POINT_LIGHTS; scene.Loaded() && i < scene.header->pointLights; i++)
+    {
+        ScenePointLight p = scene.PointLight(i);
+        ClusterPointLight light;
+        light.position = p.position;
+        light.ambient = p.ambient;
+        light.diffuse = p.diffuse;
+        light.specular = p.specular;
+        light.constant = p.attenuation.x;
+        light.linear = p.attenuation.y;
+        light.quadratic = p.attenuation.z;
+        light.range = PointLightRange(light);
+        clusterLights.push_back(light);
+    }
+    if (clusterLights.size() > NR_POINT_LIGHTS && !clusteredLighting)
+        std::cout << "The scene's lights past the first " << NR_POINT_LIGHTS << " are only shaded in clustered mode (press C)" << std::endl;
+    // extra lights fill the box around the demo gears, or around the generated rows or the scene's gears
+    glm::vec3 scatterMin(-8.0f, -5.0f, -1.5f), scatterMax(6.0f, 5.0f, 1.5f);
+    if (generatedGears || scene.Loaded())
+    {
+        scatterMin = gearsMin - glm::vec3(1.0f, 1.0f, 1.5f);
+        scatterMax = gearsMax + glm::vec3(1.0f, 1.0f, 1.5f);
+    }
+    std::vector<ClusterPointLight> extraLights = ScatterPointLights(options.extraLights, scatterMin, scatterMax);
+    clusterLights.insert(clusterLights.end(), extraLights.begin(), extraLights.end());
+    if (options.extraLights > 0 && !clusteredLighting)
+        std::cout << "Extra point lights are only shaded in clustered mode (press C)" << std::endl;
+
+    ThreadPool threadPool;
+    ClusterConfig clusterConfig;
+    LightClusterGrid lightClusters;
+    glm::mat4 clusterProjection(0.0f); // projection the cluster bounds were built for
+    ClusterLightBuffers clusterBuffers;
+    clusterBuffers.Init();
+    clusterBuffers.UploadLights(clusterLights);
+
+    // irradiance volume: the directional light and the rig's point lights baked into probes around the gears, once,
+    // on the pool; the lighting variants with BAKED_LIGHTS read their ambient and diffuse from it
+    Aabb volumeBounds;
+    for (size_t g = 0; g < gearTrain.Size(); g++)
+    {
+        Aabb box = GearBounds(gearTrain.Center(g), gearTrain.Radius(g));
+        volumeBounds.Add(box.lo);
+        volumeBounds.Add(box.hi);
+    }
+    IrradianceVolume irradianceVolume;
+    irradianceVolume.Bake(lightRig.data, volumeBounds, options.irradianceProbes, &threadPool);
+    irradianceVolume.Upload();
+    irradianceVolume.Print(1 + NR_POINT_LIGHTS);
+    if (bakedLighting && (shadowMode != SHADOWS_OFF || clusteredLighting))
+        std::cout << "The irradiance volume is only used while shadows and clustered lighting are off (press H, C)" << std::endl;
+
+    if (window)
+    {
+        glfwMakeContextCurrent(window);
+        // benchmark runs measure the frame itself, so they never wait for vsync
+        glfwSwapInterval(options.benchmark ? 0 : 1);
+    }
+
+    // starfield: generated in parallel from a seed (or read from the scene, which generated them when it was compiled),
+    // then kept in one GPU buffer
+    auto starStart = std::chrono::high_resolution_clock::now();
+    std::vector<Star> stars = scene.Loaded() ? scene.Stars() : GenerateStars(options.stars, 30.0f, options.starSeed, &threadPool);
+    double starGenerateMs = ElapsedMs(starStart);
+    if (scene.Loaded())
+        std::cout << "starfield: " << stars.size() << " stars read from the scene in " << starGenerateMs << " ms" << std::endl;
+    else
+        std::cout << "starfield: " << stars.size() << " stars generated in " << starGenerateMs << " ms on "
+                  << threadPool.Size() << " threads" << std::endl;
+
+    // starlight reaches the gears as a faint ambient term: projected onto spherical harmonics here,
+    // once per starfield, and evaluated in O(1) per fragment
+    const float STARLIGHT_INTENSITY = 0.2f;
+    StarlightSH starlight = ProjectStarlight(stars, STARLIGHT_INTENSITY, &threadPool);
+
+    // the buffer holds the stars grouped into patches of sky, so culling can drop the ones behind the camera
+    std::vector<StarCell> starCells = SortStarsIntoCells(stars);
+    StarfieldMesh starfield;
+    starfield.Upload(stars);
+
+    // culling: every gear, lamp and star cell has a box in one BVH, numbered in that order.
+    // The gear boxes are refit each frame; lamps and stars don't move.
+    glm::mat4 lampModels[NR_POINT_LIGHTS];
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+        lampModels[i] = glm::scale(glm::translate(glm::mat4(1.0f), pointLightPositions[i]), glm::vec3(0.1f, 0.1f, 0.3f)); // cylinder slender shape
+    const size_t firstLamp = gearTrain.Size(), firstStarCell = firstLamp + NR_POINT_LIGHTS;
+    std::vector<Aabb> sceneBoxes;
+    for (size_t g = 0; g < gearTrain.Size(); g++)
+        sceneBoxes.push_back(GearBounds(gearTrain.Center(g), gearTrain.Radius(g)));
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+        sceneBoxes.push_back(TransformAabb(cylinderLods.bounds, lampModels[i]));
+    for (const StarCell& cell : starCells)
+    {
+        // pad by a star's size; empty cells keep their inverted box and are never visible
+        glm::vec3 pad(0.07f);
+        sceneBoxes.push_back(cell.count ? Aabb(cell.bounds.lo - pad, cell.bounds.hi + pad) : cell.bounds);
+    }
+    BoundingVolumeHierarchy sceneBvh;
+    sceneBvh.Build(sceneBoxes);
+    std::vector<uint8_t> visible(sceneBoxes.size(), 1);
+    std::vector<glm::mat4> visibleTeeth;
+    CullStats cullStats; // since the last stats line, or over the whole run with a fixed clock
+
+    // shadow maps: the hubs only spin and are round, so they go into the cached static layers with the lamps;
+    // the directional map covers the gears and lamps
+    Aabb shadowBounds;
+    for (size_t i = 0; i < firstStarCell; i++)
+        shadowBounds.Add(sceneBoxes[i]);
+    ShadowMaps shadowMaps;
+    shadowMaps.Init(shadowDepthShader.ID, dirLight.direction, shadowBounds, pointLightPositions);
+    std::vector<glm::mat4> hubModels;
+    for (size_t g = 0; g < gearTrain.Size(); g++)
+        hubModels.push_back(glm::scale(glm::translate(glm::mat4(1.0f), gearTrain.Center(g)), glm::vec3(gearTrain.Radius(g), gearTrain.Radius(g), thickness)));
+    for (size_t i = 0; i < firstStarCell; i++)
+    {
+        // the finest hub, so no receiver is rounder than its caster; the lamps hold the point lights, so only the sun sees them
+        ShadowCaster caster;
+        caster.mesh = &cylinderLods.mesh;
+        caster.firstIndex = cylinderLods.levels[0].firstIndex;
+        caster.indexCount = cylinderLods.levels[0].indexCount;
+        caster.models = i < firstLamp ? &hubModels[i] : &lampModels[i - firstLamp];
+        caster.bounds = sceneBoxes[i];
+        caster.pointLights = i < firstLamp;
+        shadowMaps.AddStaticCaster(caster);
+    }
+
+    // shadow casters that move: each gear's cube teeth, or each baked gear at the level of detail the camera
+    // draws it with. They are culled per shadow view, not against the camera, since off-screen gears cast too.
+    std::vector<ShadowCaster> shadowCasters;
+    auto gatherShadowCasters = [&](const glm::mat4& projection, int viewportHeight)
+    {
+        shadowCasters.clear();
+        const std::vector<glm::mat4>& gearModels = gearTrain.GearModels();
+        const std::vector<glm::mat4>& toothModels = gearTrain.ToothModels();
+        for (size_t g = 0; g < gearTrain.Size(); g++)
+        {
+            ShadowCaster caster;
+            caster.bounds = sceneBoxes[g];
+            if (gearRenderMode == GEARS_BAKED)
+            {
+                const GearMesh& gearMesh = gearMeshes.Get(GearParams{ gearTrain.Teeth(g), gearTrain.Radius(g), toothLen, toothHeight, thickness });
+                float distance = std::max(glm::length(camera.Position - gearTrain.Center(g)), 0.1f);
+                int lod = SelectGearLod((gearTrain.Radius(g) + toothLen) * viewportHeight * projection[1][1] * 0.5f / distance);
+                caster.mesh = &gearMesh.mesh;
+                caster.firstIndex = gearMesh.lods[lod].firstIndex;
+                caster.indexCount = gearMesh.lods[lod].indexCount;
+                caster.models = &gearModels[g];
+            }
+            else
+            {
+                caster.mesh = &cubeMesh;
+                caster.indexCount = cubeMesh.indexCount;
+                caster.models = &toothModels[gearTrain.FirstTooth(g)];
+                caster.instances = (uint32_t)gearTrain.Teeth(g);
+            }
+            shadowCasters.push_back(caster);
+        }
+    };
+
+    // what every lighting program needs once after linking: run for the uber-shader now, and for each variant as it is built
+    lightingVariants.Configure([&](const CachedShader& shader, const LightingUniforms& uniforms)
+    {
+        shader.setInt("material.diffuse", 0);
+        shader.setInt("material.specular", 1);
+        shader.setFloat("material.shininess", material.shininess);
+        lightRig.Attach(shader.ID);
+        shader.setInt("clusterLights", 2);
+        shader.setInt("clusterGrid", 3);
+        shader.setInt("clusterIndices", 4);
+        SetUniform(uniforms.clusterDims, glm::uvec3(clusterConfig.x, clusterConfig.y, clusterConfig.z));
+        glUniform3fv(uniforms.starlightSH, 9, glm::value_ptr(starlight.coeffs[0]));
+        shadowMaps.Attach(shader.ID);
+        irradianceVolume.Attach(shader.ID);
+    });
+
+    // the flashlight with its colours zeroed stands in for "off", so the uber-shader keeps rendering the same image
+    SpotLightStd140 flashlightOff = spotLight;
+    flashlightOff.ambient = flashlightOff.diffuse = flashlightOff.specular = glm::vec3(0.0f);
+
+    if (options.benchVariants)
+    {
+        // the whole rig, flashlight off, directional light with starlight, directional light alone, the whole rig with its
+        // shadow lookups compiled in, then the first two with the static lights' ambient and diffuse from the irradiance volume
+        textureLoader.Finish();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textureLoader.Texture(diffuseMap));
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, textureLoader.Texture(specularMap));
+        lightRig.Upload();
+        std::vector<LightingFeatures> configs(7);
+        configs[1].spotLight = false;
+        configs[2].spotLight = false;
+        configs[2].pointLights = 0;
+        configs[3] = configs[2];
+        configs[3].starlight = false;
+        configs[4].shadows = true;
+        configs[5].bakedLights = true;
+        configs[6] = configs[1];
+        configs[6].bakedLights = true;
+        if (options.headless)
+            offscreen.Bind();
+        RunLightingVariantBenchmark(lightingVariants, configs, options.width, options.height, options.shadowPcf);
+    }
+    if (!options.exportScene.empty())
+    {
+        // everything the scene format covers, as it was set up above (from the built-in demo, --gears or --scene)
+        SceneSource source;
+        source.toothLength = toothLen;
+        source.toothHeight = toothHeight;
+        source.toothThickness = thickness;
+        for (size_t g = 0; g < gearTrain.Size(); g++)
+            source.AddGear(gearTrain.Center(g), gearTrain.Teeth(g), gearTrain.Radius(g));
+        for (const GearMeshing& m : gearTrain.Meshes())
+        {
+            source.meshA.push_back(m.a);
+            source.meshB.push_back(m.b);
+        }
+        source.driver = gearTrain.Driver();
+        source.driverOmega = gearTrain.DriverOmega();
+        source.dirLight.direction = dirLight.direction;
+        source.dirLight.ambient = dirLight.ambient;
+        source.dirLight.diffuse = dirLight.diffuse;
+        source.dirLight.specular = dirLight.specular;
+        size_t sceneLights = scene.Loaded() ? scene.header->pointLights : NR_POINT_LIGHTS; // the --point-lights scatter is not part of it
+        for (size_t i = 0; i < sceneLights; i++)
+        {
+            const ClusterPointLight& l = clusterLights[i];
+            ScenePointLight p;
+            p.position = l.position;
+            p.ambient = l.ambient;
+            p.diffuse = l.diffuse;
+            p.specular = l.specular;
+            p.attenuation = glm::vec3(l.constant, l.linear, l.quadratic);
+            source.pointLights.push_back(p);
+        }
+        source.spotLight.ambient = spotLight.ambient;
+        source.spotLight.diffuse = spotLight.diffuse;
+        source.spotLight.specular = spotLight.specular;
+        source.spotLight.attenuation = glm::vec3(spotLight.constant, spotLight.linear, spotLight.quadratic);
+        source.spotLight.cutOffDegrees = flashlightCutOffDegrees;
+        source.spotLight.outerCutOffDegrees = flashlightOuterCutOffDegrees;
+        source.stars = (uint32_t)stars.size();
+        source.starSeed = scene.Loaded() ? scene.header->starSeed : options.starSeed;
+        source.starRadius = scene.Loaded() ? scene.header->starRadius : 30.0f;
+        source.materials.push_back(material);
+        if (WriteSceneText(options.exportScene, source))
+            std::cout << "scene: wrote " << options.exportScene << " (" << gearTrain.Size() << " gears)" << std::endl;
+        else
+            std::cout << "scene: could not write " << options.exportScene << std::endl;
+    }
+    if (options.benchVertexFormats)
+    {
+        if (options.headless)
+            offscreen.Bind();
+        RunVertexFormatBenchmark(glLoader, lightCubeShader.ID, options.width, options.height);
+    }
+    if (options.benchShadows)
+    {
+        // the same two seconds of gear motion through the shadow pass, with the static layers cached and redrawn every frame
+        glm::mat4 benchProjection = glm::perspective(glm::radians(camera.Zoom), (float)options.width / (float)options.height, 0.1f, 100.0f);
+        for (int mode = SHADOWS_CACHED; mode <= SHADOWS_UNCACHED; mode++)
+        {
+            shadowMaps.stats = ShadowStats();
+            shadowMaps.Invalidate();
+            for (unsigned int frame = 0; frame < 120; frame++)
+            {
+                gearTrain.Update(frame / 60.0, &threadPool);
+                if (gearRenderMode != GEARS_BAKED)
+                    gearTrain.BuildToothModels(toothLen, toothHeight, thickness, &threadPool);
+                gatherShadowCasters(benchProjection, options.height);
+                shadowMaps.Render(geometryArena, shadowCasters, mode == SHADOWS_CACHED, true);
+            }
+            std::string label = std::string("shadows, ") + GEAR_RENDER_MODE_NAMES[gearRenderMode] + " gears (" + SHADOW_MODE_NAMES[mode] + ")";
+            shadowMaps.stats.Print(label.c_str(), options.shadowPcf);
+        }
+    }
+
+    // draws are collected per frame, sorted by state and issued through a cache of the bound GL state
+    RenderQueue renderQueue;
+    renderQueue.SetArena(&geometryArena);
+
+    // draw-call statistics, printed once per second so both teeth paths can be compared
+    float statsTimer = 0.0f;
+    unsigned int statsFrames = 0, statsDrawCalls = 0;
+    double statsClusterMs = 0.0;
+
+    // benchmark camera: a recorded path when given, otherwise an orbit that frames the whole gear train
+    float farPlane = 100.0f;
+    CameraPath cameraPath, recordedPath;
+    std::string cameraPathName = "orbit";
+    if (options.benchmark)
+    {
+        if (!options.cameraPath.empty())
+        {
+            if (cameraPath.Load(options.cameraPath))
+                cameraPathName = options.cameraPath;
+            else
+                std::cout << "Could not read camera path " << options.cameraPath << ", orbiting the gears instead" << std::endl;
+        }
+        if (cameraPath.Empty())
+        {
+            float halfExtent = 0.5f * std::max(gearsMax.x - gearsMin.x, gearsMax.y - gearsMin.y) + toothLen;
+            float distance = 1.1f * halfExtent / std::tan(glm::radians(0.5f * camera.Zoom));
+            cameraPath = CameraPath::Orbit(0.5f * (gearsMin + gearsMax), distance, (float)(totalFrames / fixedClockHz));
+            farPlane = std::max(farPlane, distance + halfExtent);
+        }
     }
+    clusterConfig.farZ = farPlane; // the depth slices have to reach the far plane, or lights past 100 drop out of the last one
+
+    // gear kinematics run as a fixed-timestep simulation: on their own thread, or stepped inline by the render
+    // loop in fixed-clock and --lockstep runs. The inline steps may share the render thread's pool; the
+    // thread computes alone rather than queue behind the render thread's parallel loops.
+    const bool simulationThread = !fixedClock && !options.lockstep;
+    Simulation simulation;
+    simulation.loadMs = options.simLoadMs;
+    simulation.Init(options.simHz, [&gearTrain, &threadPool, simulationThread](double t, std::vector<float>& angles)
+    {
+        gearTrain.ComputeAngles(t, angles, simulationThread ? nullptr : &threadPool);
+    }, &steadyClock);
+    if (simulationThread)
+        simulation.StartThread();
+    std::vector<float> gearAngles;
+    SimulationStats simulationStats; // since the last stats line, or over the measured frames of a counted run
+
+    // dynamic resolution: the scene is drawn at resolution.scale of the output and upscaled whenever that is below 1 or
+    // the budget is steering it. GPU frame times are measured either way, for the stats.
+    ResolutionController resolution;
+    resolution.budgetMs = options.resolutionBudgetMs > 0.0f ? options.resolutionBudgetMs : 1000.0f / 60.0f;
+    resolution.minScale = std::min(options.minRenderScale, options.renderScale);
+    resolution.SetScale(options.renderScale);
+    bool resolutionWasDynamic = dynamicResolution;
+    ScaledTarget scaledTarget;
+    Upscaler upscaler;
+    upscaler.Init(upscaleShader.ID);
+    GpuFrameTimer resolutionTimer;
+    ResolutionStats resolutionStats; // since the last stats line, or over the measured frames of a counted run
+
+    // --capture: each finished frame is read back asynchronously and written by its own thread
+    FrameCapture frameCapture;
+    if (capturing)
+    {
+        int captureWidth = options.width, captureHeight = options.height;
+        if (window)
+            glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+        if (!frameCapture.Start(options.capture, captureWidth, captureHeight, options.captureFps, options.captureQueue))
+            return -1;
+    }
+
+    // counted runs: wall-clock time, draw calls and triangles per measured frame, summarized after the last one
+    BenchmarkReport report;
+    unsigned int frameIndex = 0;
+    auto runStart = std::chrono::high_resolution_clock::now();
+    PROFILE_CAPTURE(!options.profileTrace.empty() || !options.profileCsv.empty());
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (countedRun ? frameIndex < totalFrames && !(window && glfwWindowShouldClose(window)) : !glfwWindowShouldClose(window))
     {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        if (frameIndex == warmupFrames)
+        {
+            runStart = frameStart;
+            simulation.ResetStats();
+            simulationStats = SimulationStats();
+            simulationStats.start = steadyClock.Now();
+            resolutionStats = ResolutionStats();
+        }
+
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        double currentTime = fixedClock ? frameIndex / fixedClockHz : steadyClock.Now();
+        float currentFrame = static_cast<float>(currentTime);
+        frameClock.Tick(currentTime);
+        drawCalls = 0;
+        trianglesDrawn = 0;
 
-        // input
+        // input; benchmark runs follow the camera path instead
         // -----
-        processInput(window);
+        if (options.benchmark)
+            ApplyCameraKey(camera, cameraPath.Sample(currentFrame));
+        else if (window)
+            processInput(window);
+        if (!options.recordCamera.empty())
+            recordedPath.Record(currentFrame, camera);
+
+        // output size: the offscreen target, or the window's framebuffer as it is now (resizes change it)
+        int outputWidth, outputHeight;
+        if (options.headless)
+        {
+            outputWidth = offscreen.width;
+            outputHeight = offscreen.height;
+        }
+        else
+            glfwGetFramebufferSize(window, &outputWidth, &outputHeight);
+        const unsigned int outputFramebuffer = options.headless ? offscreen.fbo : 0;
+
+        // dynamic resolution: adjust the scale from the frames the GPU has finished, then draw this one into the scaled
+        // target (upscaled at the end of the frame) or straight to the output. fbWidth x fbHeight is the size the scene
+        // is drawn at, which cluster tiles, cylinder LOD and star sizes follow.
+        if (dynamicResolution != resolutionWasDynamic)
+        {
+            resolution.SetScale(options.renderScale);
+            resolutionWasDynamic = dynamicResolution;
+        }
+        resolutionTimer.Collect([&](float gpuMs, float scale)
+        {
+            resolutionStats.Add(gpuMs, scale);
+            if (dynamicResolution && resolution.Update(gpuMs, scale))
+            {
+                resolutionStats.changes++;
+                std::printf("resolution scale %.3f -> %.3f (gpu %.2f ms, budget %.2f ms)\n", scale, resolution.scale, resolution.filteredMs, resolution.budgetMs);
+            }
+        });
+        bool scaledFrame = (dynamicResolution || resolution.scale < 1.0f) && outputWidth > 0 && outputHeight > 0
+                           && scaledTarget.Bind(outputWidth, outputHeight, resolution.scale);
+        int fbWidth = outputWidth, fbHeight = outputHeight;
+        if (scaledFrame)
+        {
+            fbWidth = scaledTarget.viewportWidth;
+            fbHeight = scaledTarget.viewportHeight;
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+            glViewport(0, 0, outputWidth, outputHeight);
+        }
+        resolutionTimer.Begin(scaledFrame ? resolution.scale : 1.0f);
 
         // render
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-        lightingShader.setFloat("material.shininess", 32.0f);
-
-        /*
-           Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index 
-           the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-           by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-           by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-        */
-        // directional light
-        /*lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);*/
-        // Cool 
-        /*lightingShader.setVec3("dirLight.direction", -0.5f, -1.0f, -0.5f);
-        lightingShader.setVec3("dirLight.ambient", 0.1f, 0.1f, 0.2f);
-        lightingShader.setVec3("dirLight.diffuse", 0.3f, 0.3f, 0.8f);
-        lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 1.0f);*/
-        // Warm 
-        lightingShader.setVec3("dirLight.direction", -0.3f, -1.0f, -0.1f);  
-        lightingShader.setVec3("dirLight.ambient", 0.3f, 0.25f, 0.2f);     
-        lightingShader.setVec3("dirLight.diffuse", 0.9f, 0.85f, 0.7f);    
-        lightingShader.setVec3("dirLight.specular", 1.0f, 0.95f, 0.8f);
-
-
-        // point light 1
-        lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-        lightingShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[0].constant", 1.0f);
-        lightingShader.setFloat("pointLights[0].linear", 0.09f);
-        lightingShader.setFloat("pointLights[0].quadratic", 0.032f);
-        // point light 2
-        lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-        lightingShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[1].constant", 1.0f);
-        lightingShader.setFloat("pointLights[1].linear", 0.09f);
-        lightingShader.setFloat("pointLights[1].quadratic", 0.032f);
-        // point light 3
-        lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-        lightingShader.setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[2].constant", 1.0f);
-        lightingShader.setFloat("pointLights[2].linear", 0.09f);
-        lightingShader.setFloat("pointLights[2].quadratic", 0.032f);
-        // point light 4
-        lightingShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-        lightingShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLights[3].constant", 1.0f);
-        lightingShader.setFloat("pointLights[3].linear", 0.09f);
-        lightingShader.setFloat("pointLights[3].quadratic", 0.032f);
-        
-        // spotlight
-        lightingShader.setVec3("spotLight.position", camera.Position);
-        lightingShader.setVec3("spotLight.direction", camera.Front);
-        lightingShader.setVec3("spotLight.ambient", 0.2f, 0.2f, 0.2f);
-        lightingShader.setVec3("spotLight.diffuse", 1.5f, 1.5f, 1.5f);
-        lightingShader.setVec3("spotLight.specular", 5.0f, 5.0f, 5.0f);
-        lightingShader.setFloat("spotLight.constant", 1.0f);
-        lightingShader.setFloat("spotLight.linear", 0.02f);
-        lightingShader.setFloat("spotLight.quadratic", 0.001f);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(5.0f)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(10.0f)));
-
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        // the aspect ratio is the output's, since a scaled frame is stretched back over all of it
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)outputWidth / (float)std::max(outputHeight, 1), 0.1f, farPlane);
         glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
 
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setMat4("model", model);
+        // the flashlight follows the camera; only its range of the light rig is re-uploaded, and only when it moved or was switched
+        SpotLightStd140 flashlight = flashlightOn ? spotLight : flashlightOff;
+        flashlight.position = camera.Position;
+        flashlight.direction = camera.Front;
+        lightRig.SetSpotLight(flashlight);
+
+        // lighting program for the lights in use this frame: its specialized variant, or the uber-shader
+        LightingFeatures lightingFeatures = LightingFeatures::FromRig(lightRig.data, clusteredLighting, starfield.count > 0,
+                                                                      shadowMode != SHADOWS_OFF, bakedLighting);
+        const LightingProgram& lighting = shaderVariants ? lightingVariants.Get(lightingFeatures) : lightingVariants.Uber();
+        const LightingUniforms& lightingUniforms = lighting.uniforms;
+
+        // frame setup: clear, light rig, camera uniforms, cluster lists, material textures
+        {
+            PROFILE_PASS("setup");
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // be sure to activate shader when setting uniforms/drawing objects
+            lighting.shader->use();
+            SetUniform(lightingUniforms.viewPos, camera.Position);
+            lightRig.Upload();
+
+            // view/projection transformations
+            SetUniform(lightingUniforms.projection, projection);
+            SetUniform(lightingUniforms.view, view);
+            SetUniform(lightingUniforms.shadows, shadowMode != SHADOWS_OFF);
+            SetUniform(lightingUniforms.shadowPcf, options.shadowPcf);
+
+            // clustered lighting: rebuild the per-cluster light lists for this view
+            SetUniform(lightingUniforms.clustered, clusteredLighting);
+            if (clusteredLighting)
+            {
+                PROFILE_CPU("cluster assign");
+                auto clusterStart = std::chrono::high_resolution_clock::now();
+                if (projection != clusterProjection)
+                {
+                    lightClusters.Configure(clusterConfig, projection);
+                    clusterProjection = projection;
+                }
+                lightClusters.Assign(clusterLights, view, &threadPool);
+                statsClusterMs += ElapsedMs(clusterStart);
+
+                clusterBuffers.UploadClusters(lightClusters);
+                clusterBuffers.Bind(2);
+                SetUniform(lightingUniforms.clusterTileSize, glm::vec2((float)fbWidth / clusterConfig.x, (float)fbHeight / clusterConfig.y));
+                SetUniform(lightingUniforms.clusterDepthParams, lightClusters.DepthSliceParams());
+            }
+
+            // stream pending texture levels; whatever is resident is bound by the draws that use it
+            if (textureLoader.Update())
+            {
+                texturesLoadedMs = ElapsedMs(appStart);
+                std::cout << "textures: all resident " << texturesLoadedMs << " ms after startup (frame " << frameIndex << ")" << std::endl;
+            }
+        }
+
+        // everything below is submitted to the render queue and drawn, sorted by state, once the frame is complete
+        renderQueue.Clear();
+
+        // lit geometry: diffuse map on unit 0, specular map on unit 1
+        DrawItem lit;
+        lit.program = lighting.shader->ID;
+        lit.textures[0] = textureLoader.Texture(diffuseMap);
+        lit.textures[1] = textureLoader.Texture(specularMap);
+        lit.vertexArray = geometryArena.VertexArray();
+        lit.flagLocations[0] = lightingUniforms.instanced; // arena draws take their model matrices from the instance stream
+        lit.flags[0] = true;
+
+        // gear angles and transforms for this frame: the threaded simulation is drawn one tick in the past, so the
+        // newest snapshot has a tick on either side of that time; inline stepping runs up to the frame itself
+        {
+            PROFILE_CPU("gear kinematics");
+            double simulationTime = currentTime;
+            if (simulation.Threaded())
+                simulationTime -= simulation.TickSeconds();
+            else
+                simulation.AdvanceTo(currentTime);
+            const SimSnapshot& snapshot = simulation.Latest();
+            simulationStats.Frame(snapshot, simulationTime, steadyClock.Now());
+            InterpolateAngles(snapshot, simulationTime, gearAngles);
+            gearTrain.SetAngles(gearAngles, &threadPool);
+            if (gearRenderMode != GEARS_BAKED)
+                gearTrain.BuildToothModels(toothLen, toothHeight, thickness, &threadPool);
+        }
+        const std::vector<glm::mat4>& gearModels = gearTrain.GearModels();
+
+        // frustum culling: refit the gear boxes to this frame's transforms, then walk the BVH
+        {
+            PROFILE_CPU("culling");
+            auto cullStart = std::chrono::high_resolution_clock::now();
+            for (size_t g = 0; g < gearTrain.Size(); g++)
+                sceneBoxes[g] = GearBounds(glm::vec3(gearModels[g][3]), gearTrain.Radius(g));
+            sceneBvh.Refit(sceneBoxes);
+            if (frustumCulling)
+                sceneBvh.Cull(Frustum::FromMatrix(projection * view), sceneBoxes, visible);
+            else
+                visible.assign(sceneBoxes.size(), 1);
+            cullStats.ms += ElapsedMs(cullStart);
+            cullStats.nodes += frustumCulling ? sceneBvh.nodesVisited : 0;
+            cullStats.frames++;
+        }
+
+        {
+            PROFILE_CPU("gears");
+            for (size_t g = 0; g < gearTrain.Size(); g++)
+                cullStats.gears += visible[g];
+            if (gearRenderMode == GEARS_BAKED)
+            {
+                for (size_t g = 0; g < gearTrain.Size(); g++)
+                {
+                    if (!visible[g])
+                        continue;
+                    const GearMesh& gearMesh = gearMeshes.Get(GearParams{ gearTrain.Teeth(g), gearTrain.Radius(g), toothLen, toothHeight, thickness });
+                    // tip radius in pixels picks the level of detail
+                    float distance = std::max(glm::length(camera.Position - gearTrain.Center(g)), 0.1f);
+                    float pixelRadius = (gearTrain.Radius(g) + toothLen) * fbHeight * projection[1][1] * 0.5f / distance;
+                    int lod = SelectGearLod(pixelRadius);
+                    DrawItem item = lit;
+                    item.arenaMesh = &gearMesh.mesh;
+                    item.firstIndex = gearMesh.lods[lod].firstIndex;
+                    item.indexCount = gearMesh.lods[lod].indexCount;
+                    item.model = gearModels[g];
+                    renderQueue.Submit(item, distance);
+                    drawCalls++;
+                    trianglesDrawn += gearMesh.lods[lod].indexCount / 3;
+                }
+            }
+            else
+            {
+                for (size_t g = 0; g < gearTrain.Size(); g++)
+                {
+                    if (!visible[g])
+                        continue;
+                    float distance = glm::length(camera.Position - gearTrain.Center(g));
+                    int level = cylinderFixedLevel;
+                    if (cylinderLod)
+                        level = hubLevels[g] = cylinderLods.Select(ProjectedRadius(gearTrain.Radius(g), distance, projection, fbHeight), hubLevels[g]);
+                    lodStats.Count(cylinderLods, level, cylinderFixedLevel);
+                    DrawGearHub(renderQueue, lit, cylinderLods, level, gearModels[g], gearTrain.Radius(g), thickness, distance);
+                }
+            }
+
+            // the teeth of the visible gears; the instanced path copies them out only when some gear was culled
+            const std::vector<glm::mat4>& toothModels = gearTrain.ToothModels();
+            if (gearRenderMode == GEARS_INSTANCED_TEETH)
+            {
+                bool allVisible = std::find(visible.begin(), visible.begin() + firstLamp, 0) == visible.begin() + firstLamp;
+                visibleTeeth.clear();
+                for (size_t g = 0; g < gearTrain.Size() && !allVisible; g++)
+                    if (visible[g])
+                        visibleTeeth.insert(visibleTeeth.end(), toothModels.begin() + gearTrain.FirstTooth(g),
+                            toothModels.begin() + gearTrain.FirstTooth(g) + gearTrain.Teeth(g));
+                DrawGearTeethInstanced(renderQueue, lit, cubeMesh, allVisible ? toothModels : visibleTeeth);
+            }
+            else if (gearRenderMode == GEARS_PER_TOOTH)
+            {
+                for (size_t g = 0; g < gearTrain.Size(); g++)
+                    if (visible[g])
+                        DrawGearTeeth(renderQueue, lit, cubeMesh, &toothModels[gearTrain.FirstTooth(g)], gearTrain.Teeth(g), camera.Position);
+            }
+        }
+
+        // the lamps and the stars share the light cube program; its per-frame uniforms are written here
+        lightCubeShader.use();
+        SetUniform(lightCubeUniforms.projection, projection);
+        SetUniform(lightCubeUniforms.view, view);
+        SetUniform(lightCubeUniforms.pointSize, 0.07f);
+        SetUniform(lightCubeUniforms.pointScale, fbHeight * projection[1][1] * 0.5f);
+        DrawItem unlit;
+        unlit.program = lightCubeShader.ID;
+        unlit.modelLocation = lightCubeUniforms.model;
+        unlit.flagLocations[0] = lightCubeUniforms.instanced;
+        unlit.flagLocations[1] = lightCubeUniforms.pointSprites;
+
+        // also draw the lamp object(s)
+        {
+            PROFILE_CPU("lamps");
+            // we now draw as many light bulbs as we have point lights.
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                if (!visible[firstLamp + i])
+                    continue;
+                cullStats.lamps++;
+                float distance = glm::length(camera.Position - pointLightPositions[i]);
+                int level = cylinderFixedLevel;
+                if (cylinderLod)
+                    level = lampLevels[i] = cylinderLods.Select(ProjectedRadius(0.1f, distance, projection, fbHeight), lampLevels[i]);
+                lodStats.Count(cylinderLods, level, cylinderFixedLevel);
+                DrawItem item = unlit;
+                item.vertexArray = geometryArena.VertexArray();
+                item.flags[0] = true; // 'instanced'
+                item.arenaMesh = &cylinderLods.mesh;
+                item.firstIndex = cylinderLods.levels[level].firstIndex;
+                item.indexCount = cylinderLods.levels[level].indexCount;
+                item.model = lampModels[i];
+                renderQueue.Submit(item, distance);
+                drawCalls++;
+                trianglesDrawn += cylinderLods.Triangles(level);
+            }
+        }
+
+        // the visible star cells as point sprites sized like the old 0.07 cubes, one draw per contiguous run of cells
+        {
+            DrawItem item = unlit;
+            item.vertexArray = starfield.vao;
+            item.mode = GL_POINTS;
+            item.flags[1] = true; // 'pointSprites'
+            item.count = 0;
+            for (size_t c = 0; c <= starCells.size(); c++)
+            {
+                bool cellVisible = c < starCells.size() && visible[firstStarCell + c] && starCells[c].count > 0;
+                if (cellVisible)
+                {
+                    if (item.count == 0)
+                        item.first = starCells[c].first;
+                    item.count += (GLsizei)starCells[c].count;
+                    cullStats.starCells++;
+                    cullStats.stars += starCells[c].count;
+                }
+                else if (item.count > 0 && (c == starCells.size() || starCells[c].count > 0))
+                {
+                    renderQueue.Submit(item, 30.0f); // the star sphere's radius
+                    drawCalls++;
+                    item.count = 0;
+                }
+            }
+        }
+
+        // shadow maps for this frame's gear transforms, before anything samples them
+        if (shadowMode != SHADOWS_OFF)
+        {
+            PROFILE_PASS("shadows");
+            gatherShadowCasters(projection, fbHeight);
+            shadowMaps.Render(geometryArena, shadowCasters, shadowMode == SHADOWS_CACHED, countedRun);
+        }
+
+        {
+            PROFILE_PASS("draw");
+            renderQueue.Execute();
+        }
+        if (scaledFrame)
+        {
+            PROFILE_PASS("upscale");
+            upscaler.Draw(scaledTarget, outputFramebuffer, outputWidth, outputHeight, upscaleFilter);
+        }
+        resolutionTimer.End();
+        if (frameCapture.Active())
+        {
+            PROFILE_PASS("capture");
+            frameCapture.Capture(outputFramebuffer, outputWidth, outputHeight);
+        }
+        BusyWait(options.frameLoadMs);
+
+        PROFILE_FRAME_END();
+
+        statsTimer += frameClock.delta;
+        statsFrames++;
+        lodStats.frames++;
+        statsDrawCalls += drawCalls;
+        if (!countedRun && statsTimer >= 1.0f)
+        {
+            std::cout << "frame: " << 1000.0f * statsTimer / statsFrames << " ms"
+                      << " | stars: " << starfield.count
+                      << " | gears: " << GEAR_RENDER_MODE_NAMES[gearRenderMode]
+                      << " | draw calls/frame: " << statsDrawCalls / statsFrames
+                      << " | lighting: " << lighting.name
+                      << " | binds+uniforms issued/skipped per frame: " << renderQueue.state.Issued() / statsFrames
+                      << "/" << renderQueue.state.Skipped() / statsFrames
+                      << " | multi-draws/frame: " << geometryArena.multiDraws / statsFrames
+                      << " | objects submitted/frame: " << (cullStats.gears + cullStats.lamps + cullStats.starCells) / statsFrames
+                      << " of " << sceneBoxes.size() << (frustumCulling ? "" : " (culling off)")
+                      << " | cylinder triangles/frame: " << lodStats.triangles / statsFrames
+                      << (cylinderLod ? "" : " (LOD off)") << ", " << lodStats.fixedTriangles / statsFrames << " at 64 segments"
+                      << " | shadows: " << SHADOW_MODE_NAMES[shadowMode];
+            if (shadowMode != SHADOWS_OFF)
+                std::cout << " " << shadowMaps.stats.ms / std::max<size_t>(shadowMaps.stats.frames, 1) << " ms submit";
+            std::cout << " | simulation: " << simulation.Ticks() / statsTimer << " ticks/s, render " << statsFrames / statsTimer
+                      << " frames/s, snapshot age " << simulationStats.ageMs / std::max<size_t>(simulationStats.frames, 1) << " ms";
+            std::cout << " | resolution: " << (scaledFrame ? resolution.scale : 1.0f) << " (" << fbWidth << "x" << fbHeight << ", "
+                      << (scaledFrame ? UPSCALE_FILTER_NAMES[upscaleFilter] : "native") << "), gpu " << resolutionStats.MeanMs()
+                      << " ms +- " << resolutionStats.StdDevMs();
+            if (dynamicResolution)
+                std::cout << " of " << resolution.budgetMs << " budget";
+            if (frameCapture.Active())
+                std::cout << " | capture: " << frameCapture.stats.written.load() << " frames written, " << frameCapture.stats.dropped
+                          << " dropped, " << frameCapture.stats.stalls << " stalls";
+            if (clusteredLighting)
+                std::cout << " | clustered: " << clusterLights.size() << " lights, assign " << statsClusterMs / statsFrames
+                          << " ms, " << lightClusters.AverageLightsPerCluster() << " lights/cluster";
+            std::cout << std::endl;
+            if (showProfile)
+                PROFILE_PRINT_SUMMARY();
+            statsTimer = 0.0f;
+            statsFrames = statsDrawCalls = 0;
+            statsClusterMs = 0.0;
+            renderQueue.state.ResetCounters();
+            geometryArena.ResetCounters();
+            cullStats = CullStats();
+            lodStats = LodStats();
+            shadowMaps.stats = ShadowStats();
+            simulation.ResetStats();
+            simulationStats = SimulationStats();
+            simulationStats.start = steadyClock.Now();
+            resolutionStats = ResolutionStats();
+        }
+
+        if (window)
+        {
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        if (countedRun)
+        {
+            // nothing throttles these runs, so wait for the frame here; otherwise the times would only cover submission
+            glFinish();
+
+            // golden-image dumps: the last frame, plus every Nth frame when asked
+            bool lastFrameOfRun = frameIndex + 1 == totalFrames;
+            if (options.headless && !options.dumpPrefix.empty() && (lastFrameOfRun || (options.dumpEvery && frameIndex % options.dumpEvery == 0)))
+            {
+                char suffix[32];
+                std::snprintf(suffix, sizeof(suffix), lastFrameOfRun ? ".ppm" : "_%05u.ppm", frameIndex);
+                WritePPM(options.dumpPrefix + suffix, offscreen.width, offscreen.height, offscreen.ReadPixels());
+            }
+            if (frameIndex >= warmupFrames)
+            {
+                report.AddFrame(ElapsedMs(frameStart), drawCalls, trianglesDrawn);
+                report.width = outputWidth;
+                report.height = outputHeight;
+            }
+        }
+        frameIndex++;
+
+        if (firstFrameMs < 0.0)
+        {
+            firstFrameMs = ElapsedMs(appStart);
+            std::cout << "first frame " << firstFrameMs << " ms after startup"
+                      << (textureLoader.Done() ? "" : ", textures still streaming") << std::endl;
+        }
+    }
 
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        glBindVertexArray(cubeVAO);
-
-        glm::mat4 I(1.0f);
-
-        // position of gear (x,y,z)
-        glm::vec3 G1 = glm::vec3(- (R1 + R2 + 0.25)* 0.5f, 0.0f, 0.05f);
-        glm::vec3 G2 = glm::vec3((R1 + R2 + 0.25) * 0.5f, 0.0f, 0.05f);
-        glm::vec3 G3 = glm::vec3(- (R1 + R2 + R3), 0.5f, 0.05f);
-        glm::vec3 G4 = glm::vec3(-((R3 * 2.0f)+R1), ((R3 * 2.0f) - 0.25f), 0.05f);
-        glm::vec3 G5 = glm::vec3((R1+R2) * 0.5f, (R1 * 2.0f)+0.5f, 0.05f);
-        glm::vec3 G6 = glm::vec3(-((R3 * 2.0f) + R1 + 0.25f ), (-(R3 * 1.0f +0.25f)), 0.05f);
-        glm::vec3 G7 = glm::vec3((R1 + R2) * 0.5f, -((R1 * 2.0f) + 0.5f), 0.05f);
-     
-        const double TWO_PI = 6.283185307179586;
-        double phase2 = glm::pi<double>() / double(N2); // half of tooth gear
-        double phase5 = glm::pi<double>() / double(N5); 
-        double phase7 = glm::pi<double>() / double(N7); 
-        
-        // spin velocity
-        const double t = glfwGetTime();
-        const double omega1 = 0.5; // rad/s
-        double ang1 = omega1 * t;
-        double ang2 = -(omega1 * ((float)N1 / (float)N2)) * t;   // spin another way
-        double ang3 = (- (omega1 * ((float)N1 / (float)N3)) * t ) + phase2;
-        double ang4 = (omega1 * ((float)N1 / (float)N4)) * t ;
-        double ang5 = (omega1 * ((float)N1 / (float)N5)) * t + phase5;
-        double ang6 = (omega1 * ((float)N1 / (float)N6)) * t;
-        double ang7 = (omega1 * ((float)N1 / (float)N7)) * t + phase7;
-
-        // prevent oversize
-        ang1 = std::fmod(ang1, TWO_PI);
-        ang2 = std::fmod(ang2, TWO_PI);
-        ang3 = std::fmod(ang3, TWO_PI);
-        ang4 = std::fmod(ang4, TWO_PI);
-        ang5 = std::fmod(ang5, TWO_PI);
-        ang6 = std::fmod(ang6, TWO_PI);
-        ang7 = std::fmod(ang7, TWO_PI);
-
-        
-        DrawGearHub(lightingShader, hubMesh, I, G1, R1, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G1, N1, R1, toothLen, toothHeight, thickness, (float)ang1);
-
-        DrawGearHub(lightingShader, hubMesh, I, G2, R2, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G2, N2, R2, toothLen, toothHeight, thickness, (float)(ang2 + phase2));
-
-        DrawGearHub(lightingShader, hubMesh, I, G3, R3, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G3, N3, R3, toothLen, toothHeight, thickness, (float)ang3);
-
-        DrawGearHub(lightingShader, hubMesh, I, G4, R4, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G4, N4, R4, toothLen, toothHeight, thickness, (float)ang4);
-
-        DrawGearHub(lightingShader, hubMesh, I, G5, R5, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G5, N5, R5, toothLen, toothHeight, thickness, (float)ang5);
-
-        DrawGearHub(lightingShader, hubMesh, I, G6, R6, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G6, N6, R6, toothLen, toothHeight, thickness, (float)ang6);
-
-        DrawGearHub(lightingShader, hubMesh, I, G7, R7, thickness);
-        DrawGearTeeth(lightingShader, cubeVAO, I, G7, N7, R7, toothLen, toothHeight, thickness, (float)ang7);
-
-
-         // also draw the lamp object(s)
-         lightCubeShader.use();
-         lightCubeShader.setMat4("projection", projection);
-         lightCubeShader.setMat4("view", view);
-    
-         // we now draw as many light bulbs as we have point lights.
-         glBindVertexArray(lightCubeVAO);
-         for (unsigned int i = 0; i < 4; i++)
-         {
-             model = glm::mat4(1.0f);
-             model = glm::translate(model, pointLightPositions[i]);
-             model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.3f)); // cylinder slender shape
-             lightCubeShader.setMat4("model", model);
-
-             glBindVertexArray(hubMesh.vao);
-             glDrawElements(GL_TRIANGLES, hubMesh.indexCount, GL_UNSIGNED_INT, 0);
-         }
-         
-         for (unsigned int i = 0; i < NR_STARS; i++) {
-             model = glm::mat4(1.0f);
-             model = glm::translate(model, starPositions[i]);
-             model = glm::scale(model, glm::vec3(0.07f)); // very tiny dot
-             lightCubeShader.setMat4("model", model);
-
-             glBindVertexArray(lightCubeVAO);
-             glDrawArrays(GL_TRIANGLES, 0, 36);
-         }
-
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    if (countedRun && frameIndex > 0)
+    {
+        glFinish();
+        report.frames.Print(options.benchmark ? "benchmark" : "headless", ElapsedMs(runStart));
+        std::cout << (options.benchmark ? "benchmark: " : "headless: ") << options.width << "x" << options.height << " | stars: " << starfield.count
+                  << " | gears: " << GEAR_RENDER_MODE_NAMES[gearRenderMode] << " | draw calls/frame: " << drawCalls
+                  << " | triangles/frame: " << trianglesDrawn << std::endl;
+        renderQueue.state.PrintCounters("state cache", frameIndex);
+        std::printf("indirect: %u multi-draws, %u commands per frame | fetched per frame: %.1f KB vertices, %.1f KB indices\n",
+            geometryArena.multiDraws / frameIndex, geometryArena.commandsDrawn / frameIndex,
+            geometryArena.vertexBytesFetched / 1024.0 / frameIndex, geometryArena.indexBytesFetched / 1024.0 / frameIndex);
+        geometryArena.PrintStats();
+        size_t occupiedCells = starCells.size() - std::count_if(starCells.begin(), starCells.end(), [](const StarCell& c) { return c.count == 0; });
+        cullStats.Print(frustumCulling ? "culling" : "culling (off)", gearTrain.Size(), NR_POINT_LIGHTS, occupiedCells, stars.size());
+        lodStats.Print(cylinderLod ? "cylinder LOD" : "cylinder LOD (off)", cylinderLods, cylinderFixedLevel);
+        if (shadowMode != SHADOWS_OFF)
+            shadowMaps.stats.Print(shadowMode == SHADOWS_CACHED ? "shadows (cached)" : "shadows (uncached)", options.shadowPcf);
+        simulationStats.Print("simulation", simulation, steadyClock.Now());
+        std::string resolutionLabel = std::string(dynamicResolution ? "dynamic resolution, " : "resolution, ")
+                                      + (resolution.scale < 1.0f || dynamicResolution ? UPSCALE_FILTER_NAMES[upscaleFilter] : "native");
+        resolutionStats.Print(resolutionLabel.c_str(), dynamicResolution ? resolution.budgetMs : 0.0f, resolutionTimer.Skipped());
+        PROFILE_PRINT_SUMMARY();
+    }
+    if (options.benchmark)
+    {
+        report.renderer = (const char*)glGetString(GL_RENDERER);
+        report.gearMode = GEAR_RENDER_MODE_NAMES[gearRenderMode];
+        report.cameraPath = cameraPathName;
+        report.warmupFrames = warmupFrames;
+        report.gears = (unsigned int)gearTrain.Size();
+        report.teeth = (unsigned int)gearTrain.ToothCount();
+        report.pointLights = (unsigned int)clusterLights.size();
+        report.clustered = clusteredLighting;
+        report.stars = starfield.count;
+        report.timeToFirstFrameMs = firstFrameMs;
+        report.timeToTexturesMs = texturesLoadedMs;
+        report.Write(options.report);
+    }
+    if (frameCapture.Active())
+    {
+        frameCapture.Finish();
+        frameCapture.Print("capture");
     }
+    if (!options.recordCamera.empty() && !recordedPath.Save(options.recordCamera))
+        std::cout << "Failed to write camera path " << options.recordCamera << std::endl;
+
+    // profiler exports (a build without PROFILER writes nothing)
+    if (!options.profileTrace.empty() && !PROFILE_WRITE_TRACE(options.profileTrace))
+        std::cout << "No trace written to " << options.profileTrace << " (profiler not built in, or the file could not be opened)" << std::endl;
+    if (!options.profileCsv.empty() && !PROFILE_WRITE_CSV(options.profileCsv))
+        std::cout << "No CSV written to " << options.profileCsv << " (profiler not built in, or the file could not be opened)" << std::endl;
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &lightCubeVAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteVertexArrays(1, &hubMesh.vao);
-    glDeleteBuffers(1, &hubMesh.vbo);
-    glDeleteBuffers(1, &hubMesh.ebo);
-
+    simulation.Stop();
+    lightingVariants.Destroy();
+    lightRig.Destroy();
+    clusterBuffers.Destroy();
+    starfield.Destroy();
+    gearMeshes.Destroy();
+    shadowMaps.Destroy();
+    irradianceVolume.Destroy();
+    upscaler.Destroy();
+    scaledTarget.Destroy();
+    resolutionTimer.Destroy();
+    geometryArena.Destroy();
+    textureLoader.Destroy();
+    offscreen.Destroy();
+    PROFILE_DESTROY();
+
+    if (options.headless)
+    {
+        headlessContext.Destroy();
+        return 0;
+    }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -604,13 +1678,48 @@ void processInput(GLFWwindow *window)
         glfwSetWindowShouldClose(window, true);
 
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        camera.ProcessKeyboard(FORWARD, frameClock.delta);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        camera.ProcessKeyboard(BACKWARD, frameClock.delta);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        camera.ProcessKeyboard(LEFT, frameClock.delta);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        camera.ProcessKeyboard(RIGHT, frameClock.delta);
+
+    // mode toggles
+    if (keyPressedOnce(window, GLFW_KEY_I))
+        gearRenderMode = (GearRenderMode)((gearRenderMode + 1) % GEAR_RENDER_MODES);
+    if (keyPressedOnce(window, GLFW_KEY_C))
+        clusteredLighting = !clusteredLighting;
+    if (keyPressedOnce(window, GLFW_KEY_P))
+        showProfile = !showProfile;
+    if (keyPressedOnce(window, GLFW_KEY_V))
+        shaderVariants = !shaderVariants;
+    if (keyPressedOnce(window, GLFW_KEY_F))
+        flashlightOn = !flashlightOn;
+    if (keyPressedOnce(window, GLFW_KEY_B))
+        frustumCulling = !frustumCulling;
+    if (keyPressedOnce(window, GLFW_KEY_L))
+        cylinderLod = !cylinderLod;
+    if (keyPressedOnce(window, GLFW_KEY_H))
+        shadowMode = (ShadowMode)((shadowMode + 1) % SHADOW_MODES);
+    if (keyPressedOnce(window, GLFW_KEY_R))
+        dynamicResolution = !dynamicResolution;
+    if (keyPressedOnce(window, GLFW_KEY_U))
+        upscaleFilter = (UpscaleFilter)((upscaleFilter + 1) % UPSCALE_FILTERS);
+    if (keyPressedOnce(window, GLFW_KEY_K))
+        bakedLighting = !bakedLighting;
+}
+
+// true only on the frame a key goes down, so toggles don't flicker while the key is held
+// ---------------------------------------------------------------------------------------
+bool keyPressedOnce(GLFWwindow *window, int key)
+{
+    static bool keyDown[GLFW_KEY_LAST + 1] = {};
+    bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+    bool wentDown = pressed && !keyDown[key];
+    keyDown[key] = pressed;
+    return wentDown;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -619,6 +1728,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
+    // (the render loop reads the new size itself each frame, for the viewport, the aspect ratio and the scaled target)
     glViewport(0, 0, width, height);
 }
 
@@ -651,42 +1761,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
@@ -0,0 +1,421 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler
+// --------------
+// PROFILE_CPU("name") times the rest of the enclosing scope on the calling thread (any thread).
+// PROFILE_PASS("name") does that too, plus a GL_TIME_ELAPSED query around the same GL commands. Use it
+// only on the GL thread and never nested, since only one TIME_ELAPSED query may be active at a time.
+// PROFILE_FRAME_END() once per frame collects everything: queries alternate between two sets per frame
+// and are read one frame late, so collection never waits on the GPU.
+//
+// Zones push their events into a fixed-size lock-free ring, which the frame end drains into rolling
+// per-zone statistics (min / avg / p99 over the last PROFILER_WINDOW frames) and, when a capture is on,
+// into a list that PROFILE_WRITE_TRACE / PROFILE_WRITE_CSV export as Chrome trace JSON (chrome://tracing,
+// Perfetto) or CSV.
+//
+// Everything here is compiled only with ENABLE_PROFILER (CMake option PROFILER); otherwise every macro
+// expands to nothing and none of the code below exists in the binary.
+
+#ifdef ENABLE_PROFILER
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const int PROFILER_MAX_ZONES = 32;
+const size_t PROFILER_RING_SIZE = 1 << 14; // events between two frame ends; power of two
+const size_t PROFILER_WINDOW = 240;        // frames in the rolling summary
+const size_t PROFILER_MAX_CAPTURE = 1 << 21;
+const unsigned int PROFILER_GPU_TID = 1000; // Chrome trace lane for GPU timings
+
+struct ProfileEvent {
+    int zone;
+    unsigned int thread;
+    uint64_t startNs, endNs;
+};
+
+// multi-producer, single-consumer ring: a producer claims a ticket by advancing the head with a CAS, writes
+// the slot and then publishes it through the slot's sequence number; the frame end consumes in ticket order.
+// When the ring is full the event is dropped and counted instead of overwriting one not yet read.
+class ProfileEventRing
+{
+public:
+    ProfileEventRing() : slots(PROFILER_RING_SIZE)
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    void Push(const ProfileEvent& e)
+    {
+        size_t ticket = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[ticket & (PROFILER_RING_SIZE - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == ticket) {
+                if (head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed)) {
+                    slot.event = e;
+                    slot.sequence.store(ticket + 1, std::memory_order_release);
+                    return;
+                }
+            }
+            else if (sequence < ticket) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+                ticket = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    template <typename Fn>
+    void Drain(Fn&& fn)
+    {
+        for (;;) {
+            Slot& slot = slots[tail & (PROFILER_RING_SIZE - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+                return;
+            fn(slot.event);
+            slot.sequence.store(tail + PROFILER_RING_SIZE, std::memory_order_release);
+            tail++;
+        }
+    }
+
+    size_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        ProfileEvent event;
+    };
+    std::vector<Slot> slots;
+    std::atomic<size_t> head{0};
+    size_t tail = 0; // consumer only
+    std::atomic<size_t> dropped{0};
+};
+
+class Profiler
+{
+public:
+    Profiler() : epoch(std::chrono::steady_clock::now()) {}
+
+    // called once per PROFILE_* site (function-local static), so zone lookups never hit the mutex per frame;
+    // names are compared by content, since each translation unit may have its own copy of a string literal
+    int RegisterZone(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(zoneMutex);
+        for (int i = 0; i < zoneCount; i++)
+            if (std::strcmp(zones[i].name, name) == 0)
+                return i;
+        if (zoneCount == PROFILER_MAX_ZONES)
+            return -1;
+        zones[zoneCount].name = name;
+        return zoneCount++;
+    }
+
+    uint64_t NowNs() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static unsigned int ThreadIndex()
+    {
+        static std::atomic<unsigned int> next{0};
+        thread_local unsigned int index = next.fetch_add(1);
+        return index;
+    }
+
+    void PushEvent(const ProfileEvent& e) { ring.Push(e); }
+
+    // GPU side of PROFILE_PASS; returns false when another pass is already timing
+    bool BeginGpu(int zone, uint64_t cpuStartNs)
+    {
+        if (gpuActive)
+            return false;
+        std::vector<GpuQuery>& set = gpuQueries[frame & 1];
+        if (gpuUsed[frame & 1] == set.size()) {
+            GpuQuery q = {};
+            glGenQueries(1, &q.query);
+            set.push_back(q);
+        }
+        GpuQuery& q = set[gpuUsed[frame & 1]++];
+        q.zone = zone;
+        q.cpuStartNs = cpuStartNs;
+        glBeginQuery(GL_TIME_ELAPSED, q.query);
+        gpuActive = true;
+        return true;
+    }
+
+    void EndGpu()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuActive = false;
+    }
+
+    // drains the ring, reads last frame's queries if the GPU is done with them, and rolls the statistics
+    void EndFrame()
+    {
+        for (int z = 0; z < zoneCount; z++) {
+            zones[z].frameCpuMs = 0.0;
+            zones[z].seenCpu = false;
+        }
+
+        ring.Drain([&](const ProfileEvent& e) {
+            if (e.zone < 0)
+                return;
+            zones[e.zone].frameCpuMs += (e.endNs - e.startNs) * 1e-6;
+            zones[e.zone].seenCpu = true;
+            if (capturing && captured.size() < PROFILER_MAX_CAPTURE)
+                captured.push_back({ e, frame, false });
+        });
+
+        // the other set was filled last frame; this frame's set is read at the next frame end
+        unsigned int previous = (frame + 1) & 1;
+        for (unsigned int i = 0; i < gpuUsed[previous]; i++) {
+            GpuQuery& q = gpuQueries[previous][i];
+            GLint available = 0;
+            glGetQueryObjectiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                lateQueries++;
+                continue;
+            }
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &ns);
+            // the very first frame's timings include driver start-up (llvmpipe reports garbage there); skip them
+            if (frame == 1)
+                continue;
+            zones[q.zone].gpu.Add(ns * 1e-6);
+            if (capturing && captured.size() < PROFILER_MAX_CAPTURE)
+                captured.push_back({ { q.zone, PROFILER_GPU_TID, q.cpuStartNs, q.cpuStartNs + ns }, frame - 1, true });
+        }
+        gpuUsed[previous] = 0;
+
+        for (int z = 0; z < zoneCount; z++)
+            if (zones[z].seenCpu)
+                zones[z].cpu.Add(zones[z].frameCpuMs);
+        frame++;
+    }
+
+    void SetCapture(bool on) { capturing = on; }
+
+    void PrintSummary() const
+    {
+        std::printf("%-18s %10s %10s %10s %10s %10s %10s\n", "zone", "cpu min", "cpu avg", "cpu p99", "gpu min", "gpu avg", "gpu p99");
+        for (int z = 0; z < zoneCount; z++) {
+            const Zone& zone = zones[z];
+            std::printf("%-18s", zone.name);
+            PrintWindow(zone.cpu);
+            PrintWindow(zone.gpu);
+            std::printf("\n");
+        }
+        if (ring.Dropped() || lateQueries)
+            std::printf("(%zu events dropped, %zu GPU queries not ready in time)\n", ring.Dropped(), lateQueries);
+    }
+
+    // Chrome trace event format: one complete ("X") event per zone instance, microsecond timestamps.
+    // GPU durations sit on their own lane, starting where the CPU issued the pass.
+    bool WriteTrace(const std::string& path) const
+    {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        std::fprintf(file, "{\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", PROFILER_GPU_TID);
+        for (const CapturedEvent& c : captured)
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                JsonEscape(zones[c.event.zone].name).c_str(), c.gpu ? "gpu" : "cpu", c.event.thread,
+                c.event.startNs * 1e-3, (c.event.endNs - c.event.startNs) * 1e-3, c.frame);
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+        return true;
+    }
+
+    // a zone name as the inside of a JSON string
+    static std::string JsonEscape(const char* text)
+    {
+        std::string escaped;
+        for (const char* p = text; *p; p++) {
+            if (*p == '"' || *p == '\\') {
+                escaped += '\\';
+                escaped += *p;
+            }
+            else if ((unsigned char)*p < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", (unsigned int)(unsigned char)*p);
+                escaped += code;
+            }
+            else
+                escaped += *p;
+        }
+        return escaped;
+    }
+
+    // a zone name as one CSV field (RFC 4180): quoted, with inner quotes doubled, when it holds , " or a line break
+    static std::string CsvField(const char* text)
+    {
+        if (!std::strpbrk(text, ",\"\r\n"))
+            return text;
+        std::string field = "\"";
+        for (const char* p = text; *p; p++) {
+            if (*p == '"')
+                field += '"';
+            field += *p;
+        }
+        return field + "\"";
+    }
+
+    bool WriteCsv(const std::string& path) const
+    {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        std::fprintf(file, "frame,zone,timeline,thread,start_ms,duration_ms\n");
+        for (const CapturedEvent& c : captured)
+            std::fprintf(file, "%u,%s,%s,%u,%.6f,%.6f\n", c.frame, CsvField(zones[c.event.zone].name).c_str(), c.gpu ? "gpu" : "cpu",
+                c.event.thread, c.event.startNs * 1e-6, (c.event.endNs - c.event.startNs) * 1e-6);
+        std::fclose(file);
+        return true;
+    }
+
+    void Destroy()
+    {
+        for (int set = 0; set < 2; set++) {
+            for (GpuQuery& q : gpuQueries[set])
+                glDeleteQueries(1, &q.query);
+            gpuQueries[set].clear();
+            gpuUsed[set] = 0;
+        }
+    }
+
+private:
+    // the last PROFILER_WINDOW samples of one zone, in frame order
+    struct Window {
+        double samples[PROFILER_WINDOW];
+        size_t count = 0, next = 0;
+
+        void Add(double ms)
+        {
+            samples[next] = ms;
+            next = (next + 1) % PROFILER_WINDOW;
+            count = std::min(count + 1, PROFILER_WINDOW);
+        }
+    };
+
+    struct Zone {
+        const char* name = "";
+        Window cpu, gpu;
+        double frameCpuMs = 0.0; // summed over every instance and thread this frame
+        bool seenCpu = false;
+    };
+
+    struct GpuQuery {
+        GLuint query;
+        int zone;
+        uint64_t cpuStartNs;
+    };
+
+    struct CapturedEvent {
+        ProfileEvent event;
+        unsigned int frame;
+        bool gpu;
+    };
+
+    static void PrintWindow(const Window& w)
+    {
+        if (w.count == 0) {
+            std::printf(" %10s %10s %10s", "-", "-", "-");
+            return;
+        }
+        std::vector<double> sorted(w.samples, w.samples + w.count);
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double s : sorted)
+            sum += s;
+        size_t p99 = std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()));
+        std::printf(" %10.3f %10.3f %10.3f", sorted.front(), sum / sorted.size(), sorted[p99]);
+    }
+
+    std::chrono::steady_clock::time_point epoch;
+    std::mutex zoneMutex;
+    Zone zones[PROFILER_MAX_ZONES];
+    int zoneCount = 0;
+    ProfileEventRing ring;
+    std::vector<GpuQuery> gpuQueries[2];
+    unsigned int gpuUsed[2] = { 0, 0 };
+    bool gpuActive = false;
+    size_t lateQueries = 0;
+    unsigned int frame = 0;
+    bool capturing = false;
+    std::vector<CapturedEvent> captured;
+};
+
+inline Profiler& GetProfiler()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+class ProfileScope
+{
+public:
+    ProfileScope(int zone, bool gpu) : zone(zone)
+    {
+        Profiler& p = GetProfiler();
+        startNs = p.NowNs();
+        timingGpu = gpu && zone >= 0 && p.BeginGpu(zone, startNs);
+    }
+
+    ~ProfileScope()
+    {
+        Profiler& p = GetProfiler();
+        if (timingGpu)
+            p.EndGpu();
+        p.PushEvent({ zone, Profiler::ThreadIndex(), startNs, p.NowNs() });
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    int zone;
+    uint64_t startNs;
+    bool timingGpu;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE_(name, gpu) \
+    static const int PROFILE_CONCAT(profileZone, __LINE__) = GetProfiler().RegisterZone(name); \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__), gpu)
+#define PROFILE_CPU(name) PROFILE_ZONE_(name, false)
+#define PROFILE_PASS(name) PROFILE_ZONE_(name, true)
+#define PROFILE_FRAME_END() GetProfiler().EndFrame()
+#define PROFILE_PRINT_SUMMARY() GetProfiler().PrintSummary()
+#define PROFILE_CAPTURE(on) GetProfiler().SetCapture(on)
+#define PROFILE_WRITE_TRACE(path) GetProfiler().WriteTrace(path)
+#define PROFILE_WRITE_CSV(path) GetProfiler().WriteCsv(path)
+#define PROFILE_DESTROY() GetProfiler().Destroy()
+
+#else
+
+#define PROFILE_CPU(name) ((void)0)
+#define PROFILE_PASS(name) ((void)0)
+#define PROFILE_FRAME_END() ((void)0)
+#define PROFILE_PRINT_SUMMARY() ((void)0)
+#define PROFILE_CAPTURE(on) ((void)0)
+#define PROFILE_WRITE_TRACE(path) false
+#define PROFILE_WRITE_CSV(path) false
+#define PROFILE_DESTROY() ((void)0)
+
+#endif
+
+#endif
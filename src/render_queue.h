@@ -0,0 +1,296 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Render queue
+// ------------
+// Drawing code submits DrawItems instead of calling GL. Once per frame the queue sorts them by a 64-bit key
+//   bits 56..63 program | 40..55 vertex array | 24..39 texture set | 0..23 depth, front to back
+// and executes them through a GLStateCache, which drops binds and uniform writes that would change nothing.
+// Programs, vertex arrays and texture sets go into the key as small slots handed out in order of first
+// submission, so the order is stable from frame to frame.
+// Items drawn from the geometry arena all share its VAO, so after sorting they form long runs with the same
+// program and textures; each run becomes one multi-draw of indirect commands (see GeometryArena).
+
+// binds and uniform writes that actually reach GL, and the ones that were skipped because nothing changed
+class GLStateCache
+{
+public:
+    static const unsigned int TEXTURE_UNITS = 2;
+
+    struct Counter {
+        unsigned int issued = 0, skipped = 0;
+    };
+    Counter programs, vertexArrays, textures, uniforms;
+
+    // binding state can be changed by code that bypasses the cache (uploads, framebuffers, texture streaming);
+    // call before a run of cached calls
+    void InvalidateBindings()
+    {
+        program = vertexArray = activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < TEXTURE_UNITS; unit++)
+            boundTextures[unit] = UNKNOWN;
+    }
+
+    // uniform values are remembered per program across frames; uniforms written through the cache must
+    // not be written around it
+    void InvalidateUniforms() { uniformValues.clear(); }
+
+    void UseProgram(unsigned int id)
+    {
+        if (Changed(program, id, programs))
+            glUseProgram(id);
+    }
+
+    void BindVertexArray(unsigned int id)
+    {
+        if (Changed(vertexArray, id, vertexArrays))
+            glBindVertexArray(id);
+    }
+
+    void BindTexture2D(unsigned int unit, unsigned int id)
+    {
+        if (!Changed(boundTextures[unit], id, textures))
+            return;
+        if (activeUnit != unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, id);
+    }
+
+    // uniforms of the program in use
+    void SetUniform(GLint location, const glm::mat4& value)
+    {
+        if (location >= 0 && UniformChanged(location, glm::value_ptr(value), sizeof(value)))
+            glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void SetUniform(GLint location, bool value)
+    {
+        int v = value ? 1 : 0;
+        if (location >= 0 && UniformChanged(location, &v, sizeof(v)))
+            glUniform1i(location, v);
+    }
+
+    unsigned int Issued() const { return programs.issued + vertexArrays.issued + textures.issued + uniforms.issued; }
+    unsigned int Skipped() const { return programs.skipped + vertexArrays.skipped + textures.skipped + uniforms.skipped; }
+
+    void ResetCounters() { programs = vertexArrays = textures = uniforms = Counter(); }
+
+    void PrintCounters(const char* label, unsigned int frames) const
+    {
+        frames = std::max(frames, 1u);
+        std::printf("%s: issued/skipped per frame | programs %u/%u | vertex arrays %u/%u | textures %u/%u | uniforms %u/%u\n", label,
+            programs.issued / frames, programs.skipped / frames, vertexArrays.issued / frames, vertexArrays.skipped / frames,
+            textures.issued / frames, textures.skipped / frames, uniforms.issued / frames, uniforms.skipped / frames);
+    }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+
+    struct UniformValue {
+        unsigned char bytes[sizeof(glm::mat4)];
+    };
+
+    unsigned int program = UNKNOWN, vertexArray = UNKNOWN, activeUnit = UNKNOWN;
+    unsigned int boundTextures[TEXTURE_UNITS] = { UNKNOWN, UNKNOWN };
+    std::unordered_map<uint64_t, UniformValue> uniformValues; // (program, location) -> last value written
+
+    static bool Changed(unsigned int& current, unsigned int id, Counter& counter)
+    {
+        if (current == id) {
+            counter.skipped++;
+            return false;
+        }
+        current = id;
+        counter.issued++;
+        return true;
+    }
+
+    bool UniformChanged(GLint location, const void* value, size_t size)
+    {
+        uint64_t key = ((uint64_t)program << 32) | (uint32_t)location;
+        std::unordered_map<uint64_t, UniformValue>::iterator found = uniformValues.find(key);
+        if (found != uniformValues.end() && std::memcmp(found->second.bytes, value, size) == 0) {
+            uniforms.skipped++;
+            return false;
+        }
+        std::memcpy(uniformValues[key].bytes, value, size);
+        uniforms.issued++;
+        return true;
+    }
+};
+
+// one draw call and the state it needs
+struct DrawItem {
+    static const int FLAGS = 2;
+
+    unsigned int program = 0;
+    unsigned int vertexArray = 0;
+    unsigned int textures[GLStateCache::TEXTURE_UNITS] = { 0, 0 }; // 0 leaves the unit as it is
+    // geometry outside the arena
+    GLenum mode = GL_TRIANGLES;
+    GLsizei count = 0;
+    GLenum indexType = 0;   // 0: glDrawArrays, otherwise the element type of the bound index buffer
+    size_t first = 0;       // first vertex, or byte offset into the index buffer
+    // geometry in the arena (vertexArray is the arena's): indexCount indices from firstIndex of the mesh
+    const ArenaMesh* arenaMesh = NULL;
+    uint32_t firstIndex = 0, indexCount = 0;
+    // arena draws are always instanced: instanceModels[0..instances), or just model when instanceModels is NULL
+    const glm::mat4* instanceModels = NULL;
+    GLsizei instances = 0;
+    GLint modelLocation = -1;
+    glm::mat4 model = glm::mat4(1.0f);
+    // bool uniforms per item ('instanced', 'pointSprites'); -1 for unused slots
+    GLint flagLocations[FLAGS] = { -1, -1 };
+    bool flags[FLAGS] = { false, false };
+};
+
+class RenderQueue
+{
+public:
+    GLStateCache state;
+
+    // items on the arena's VAO are drawn through its indirect commands
+    void SetArena(GeometryArena* geometryArena) { arena = geometryArena; }
+
+    void Clear()
+    {
+        items.clear();
+        order.clear();
+    }
+
+    // depth: distance from the camera; items sharing all state are drawn front to back
+    void Submit(const DrawItem& item, float depth)
+    {
+        uint64_t key = (uint64_t)Slot(programSlots, item.program, 8) << 56
+                     | (uint64_t)Slot(vertexArraySlots, item.vertexArray, 16) << 40
+                     | (uint64_t)Slot(textureSlots, (uint64_t)item.textures[0] << 32 | item.textures[1], 16) << 24
+                     | DepthBits(depth);
+        order.push_back(std::make_pair(key, (uint32_t)items.size()));
+        items.push_back(item);
+    }
+
+    size_t Size() const { return items.size(); }
+
+    // sorts and draws everything submitted since Clear()
+    void Execute()
+    {
+        std::sort(order.begin(), order.end());
+        state.InvalidateBindings();
+
+        // every arena command of the frame, in sorted order, goes up in one upload
+        if (arena) {
+            arena->BeginFrame();
+            for (const std::pair<uint64_t, uint32_t>& entry : order) {
+                const DrawItem& item = items[entry.second];
+                if (item.arenaMesh)
+                    arena->AddCommand(*item.arenaMesh, item.firstIndex, item.indexCount,
+                        item.instanceModels ? item.instanceModels : &item.model, item.instanceModels ? (uint32_t)item.instances : 1);
+            }
+            arena->Upload();
+        }
+
+        uint32_t command = 0, runStart = 0;
+        const DrawItem* run = NULL; // first item of the pending arena run
+        for (const std::pair<uint64_t, uint32_t>& entry : order) {
+            const DrawItem& item = items[entry.second];
+            if (item.arenaMesh) {
+                if (run && !SameState(*run, item)) {
+                    DrawArenaRun(*run, runStart, command - runStart);
+                    run = NULL;
+                }
+                if (!run) {
+                    run = &item;
+                    runStart = command;
+                }
+                command++;
+                continue;
+            }
+            if (run) {
+                DrawArenaRun(*run, runStart, command - runStart);
+                run = NULL;
+            }
+
+            Bind(item);
+            state.SetUniform(item.modelLocation, item.model);
+            if (item.indexType && item.instances)
+                glDrawElementsInstanced(item.mode, item.count, item.indexType, (void*)item.first, item.instances);
+            else if (item.indexType)
+                glDrawElements(item.mode, item.count, item.indexType, (void*)item.first);
+            else if (item.instances)
+                glDrawArraysInstanced(item.mode, (GLint)item.first, item.count, item.instances);
+            else
+                glDrawArrays(item.mode, (GLint)item.first, item.count);
+        }
+        if (run)
+            DrawArenaRun(*run, runStart, command - runStart);
+    }
+
+private:
+    GeometryArena* arena = NULL;
+    std::vector<DrawItem> items;
+    std::vector<std::pair<uint64_t, uint32_t>> order; // sort key, index into items
+    std::unordered_map<uint64_t, uint32_t> programSlots, vertexArraySlots, textureSlots;
+
+    void Bind(const DrawItem& item)
+    {
+        state.UseProgram(item.program);
+        state.BindVertexArray(item.vertexArray);
+        for (unsigned int unit = 0; unit < GLStateCache::TEXTURE_UNITS; unit++)
+            if (item.textures[unit])
+                state.BindTexture2D(unit, item.textures[unit]);
+        for (int i = 0; i < DrawItem::FLAGS; i++)
+            state.SetUniform(item.flagLocations[i], item.flags[i]);
+    }
+
+    static bool SameState(const DrawItem& a, const DrawItem& b)
+    {
+        return a.program == b.program && a.vertexArray == b.vertexArray
+            && std::equal(a.textures, a.textures + GLStateCache::TEXTURE_UNITS, b.textures)
+            && std::equal(a.flagLocations, a.flagLocations + DrawItem::FLAGS, b.flagLocations)
+            && std::equal(a.flags, a.flags + DrawItem::FLAGS, b.flags);
+    }
+
+    void DrawArenaRun(const DrawItem& first, uint32_t command, uint32_t count)
+    {
+        Bind(first);
+        arena->Draw(command, count);
+    }
+
+    // small dense number for a GL name; past the field's range everything shares the last slot
+    static uint32_t Slot(std::unordered_map<uint64_t, uint32_t>& slots, uint64_t id, unsigned int bits)
+    {
+        std::unordered_map<uint64_t, uint32_t>::iterator found = slots.find(id);
+        if (found != slots.end())
+            return found->second;
+        uint32_t slot = std::min((uint32_t)slots.size(), (1u << bits) - 1);
+        slots[id] = slot;
+        return slot;
+    }
+
+    // the bit pattern of a non-negative float orders like its value; keep the top 24 bits
+    static uint64_t DepthBits(float depth)
+    {
+        depth = std::max(depth, 0.0f);
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 8;
+    }
+};
+
+#endif
@@ -0,0 +1,563 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include "benchmarks.h"
+#include "gear_train.h"
+#include "light_rig.h"
+#include "starfield.h"
+#include "texture_cache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scene files
+// -----------
+// A scene (gears, meshing links, lights, stars, materials) has two forms. The text form, <name>.scene,
+// has one record per line and is what people edit and diff. It is compiled into <name>.scene.bin: a
+// fixed header, then one flat array per field (structure of arrays), each 16-byte aligned. Compiling
+// does the work that only depends on the text: it solves the gear speeds and phases and generates the
+// stars. Loading maps the compiled file and reads every array in place, with no parsing and no
+// per-object allocation. The gear train copies its arrays in bulk, since it also owns generated trains.
+// Like a cooked texture, the compiled file records the hash of the text, and an edited text is
+// recompiled on its next load.
+//
+// Text records ('#' starts a comment; gears are numbered from 0 in the order they appear):
+//   teeth      length height thickness               tooth size, shared by every gear
+//   gear       x y z teeth pitch-radius
+//   mesh       a b                                   gears a and b are in contact
+//   driver     gear omega                            the gear the train is solved from, in rad/s
+//   dirlight   dx dy dz  ambient diffuse specular    (colours are r g b)
+//   pointlight x y z  ambient diffuse specular  constant linear quadratic
+//   spotlight  ambient diffuse specular  constant linear quadratic  cutoff outer-cutoff (degrees)
+//   stars      count seed radius
+//   material   diffuse-path specular-path shininess   (paths under the LearnOpenGL root, no spaces)
+// The first four point lights are the light rig's lamps; a scene needs at least four, and any further
+// ones are shaded in clustered mode. The spotlight is the camera's flashlight. The demo draws every
+// gear with the first material.
+//
+// Compiled layout (native byte order; like the texture cache it is rebuilt per machine, never shipped):
+//   CompiledSceneHeader, then the arrays at the offsets it lists.
+
+const char COMPILED_SCENE_MAGIC[4] = { 'G', 'S', 'C', 'N' };
+const uint32_t COMPILED_SCENE_VERSION = 1;
+
+enum SceneArray {
+    SCENE_GEAR_X, SCENE_GEAR_Y, SCENE_GEAR_Z, SCENE_GEAR_RADIUS, // float per gear
+    SCENE_GEAR_TEETH,                                            // int32 per gear
+    SCENE_GEAR_OMEGA, SCENE_GEAR_PHASE,                          // double per gear, solved when compiling
+    SCENE_MESH_A, SCENE_MESH_B,                                  // uint32 per meshing link
+    SCENE_LIGHT_POSITION, SCENE_LIGHT_AMBIENT, SCENE_LIGHT_DIFFUSE, SCENE_LIGHT_SPECULAR,
+    SCENE_LIGHT_ATTENUATION,                                     // vec3 per point light (constant, linear, quadratic)
+    SCENE_STAR_POSITION, SCENE_STAR_COLOR,                       // vec3 per star
+    SCENE_MATERIAL_DIFFUSE, SCENE_MATERIAL_SPECULAR,             // uint32 per material: offsets into SCENE_STRINGS
+    SCENE_MATERIAL_SHININESS,                                    // float per material
+    SCENE_STRINGS,                                               // zero-terminated paths
+    SCENE_ARRAYS
+};
+
+struct SceneDirLight {
+    glm::vec3 direction = glm::vec3(-0.3f, -1.0f, -0.1f);
+    glm::vec3 ambient = glm::vec3(0.3f, 0.25f, 0.2f), diffuse = glm::vec3(0.9f, 0.85f, 0.7f), specular = glm::vec3(1.0f, 0.95f, 0.8f);
+};
+
+struct ScenePointLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 ambient = glm::vec3(0.05f), diffuse = glm::vec3(0.8f), specular = glm::vec3(1.0f);
+    glm::vec3 attenuation = glm::vec3(1.0f, 0.09f, 0.032f); // constant, linear, quadratic
+};
+
+struct SceneSpotLight {
+    glm::vec3 ambient = glm::vec3(0.2f), diffuse = glm::vec3(1.5f), specular = glm::vec3(5.0f);
+    glm::vec3 attenuation = glm::vec3(1.0f, 0.02f, 0.001f);
+    float cutOffDegrees = 5.0f, outerCutOffDegrees = 10.0f;
+};
+
+struct SceneMaterial {
+    std::string diffuse, specular;
+    float shininess = 32.0f;
+};
+
+struct CompiledSceneHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t gears, meshes, pointLights, stars, materials, stringBytes;
+    uint32_t driver, starSeed;
+    double driverOmega;
+    float toothLength, toothHeight, toothThickness, starRadius;
+    SceneDirLight dirLight;
+    SceneSpotLight spotLight;
+    uint64_t arrayOffset[SCENE_ARRAYS];
+};
+
+// bytes of one element of an array, and how many elements a header says it has
+inline size_t SceneArrayElementSize(int array)
+{
+    switch (array) {
+    case SCENE_GEAR_OMEGA: case SCENE_GEAR_PHASE: return sizeof(double);
+    case SCENE_LIGHT_POSITION: case SCENE_LIGHT_AMBIENT: case SCENE_LIGHT_DIFFUSE: case SCENE_LIGHT_SPECULAR:
+    case SCENE_LIGHT_ATTENUATION: case SCENE_STAR_POSITION: case SCENE_STAR_COLOR: return sizeof(glm::vec3);
+    case SCENE_STRINGS: return 1;
+    default: return 4;
+    }
+}
+
+inline size_t SceneArrayCount(const CompiledSceneHeader& h, int array)
+{
+    if (array <= SCENE_GEAR_PHASE)
+        return h.gears;
+    if (array <= SCENE_MESH_B)
+        return h.meshes;
+    if (array <= SCENE_LIGHT_ATTENUATION)
+        return h.pointLights;
+    if (array <= SCENE_STAR_COLOR)
+        return h.stars;
+    if (array <= SCENE_MATERIAL_SHININESS)
+        return h.materials;
+    return h.stringBytes;
+}
+
+// the text form, as parsed or as gathered from a running scene for export
+struct SceneSource {
+    float toothLength = 0.25f, toothHeight = 0.2f, toothThickness = 0.2f;
+    std::vector<float> x, y, z, radius;
+    std::vector<int> teeth;
+    std::vector<uint32_t> meshA, meshB;
+    uint32_t driver = 0;
+    double driverOmega = 0.5;
+    SceneDirLight dirLight;
+    std::vector<ScenePointLight> pointLights;
+    SceneSpotLight spotLight;
+    uint32_t stars = 50, starSeed = 1;
+    float starRadius = 30.0f;
+    std::vector<SceneMaterial> materials;
+
+    void AddGear(const glm::vec3& center, int toothCount, float pitchRadius)
+    {
+        x.push_back(center.x);
+        y.push_back(center.y);
+        z.push_back(center.z);
+        teeth.push_back(toothCount);
+        radius.push_back(pitchRadius);
+    }
+};
+
+// parses a text scene; on failure error says which line and why
+inline bool ParseSceneText(const std::string& path, SceneSource& scene, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot read " + path;
+        return false;
+    }
+    scene = SceneSource();
+    bool driverSet = false;
+    std::string line, record;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream in(line);
+        if (!(in >> record))
+            continue;
+        auto vec3 = [&](glm::vec3& v) { return (bool)(in >> v.x >> v.y >> v.z); };
+        bool ok;
+        if (record == "gear") {
+            glm::vec3 center;
+            int toothCount;
+            float pitchRadius;
+            ok = vec3(center) && in >> toothCount >> pitchRadius && toothCount >= 3 && pitchRadius > 0.0f;
+            if (ok)
+                scene.AddGear(center, toothCount, pitchRadius);
+        }
+        else if (record == "mesh") {
+            uint32_t a, b;
+            ok = (bool)(in >> a >> b) && a != b;
+            if (ok) {
+                scene.meshA.push_back(a);
+                scene.meshB.push_back(b);
+            }
+        }
+        else if (record == "teeth")
+            ok = (bool)(in >> scene.toothLength >> scene.toothHeight >> scene.toothThickness);
+        else if (record == "driver")
+            ok = driverSet = (bool)(in >> scene.driver >> scene.driverOmega);
+        else if (record == "dirlight") {
+            SceneDirLight& d = scene.dirLight;
+            ok = vec3(d.direction) && vec3(d.ambient) && vec3(d.diffuse) && vec3(d.specular);
+        }
+        else if (record == "pointlight") {
+            ScenePointLight p;
+            ok = vec3(p.position) && vec3(p.ambient) && vec3(p.diffuse) && vec3(p.specular) && vec3(p.attenuation);
+            if (ok)
+                scene.pointLights.push_back(p);
+        }
+        else if (record == "spotlight") {
+            SceneSpotLight& s = scene.spotLight;
+            ok = vec3(s.ambient) && vec3(s.diffuse) && vec3(s.specular) && vec3(s.attenuation) && in >> s.cutOffDegrees >> s.outerCutOffDegrees;
+        }
+        else if (record == "stars")
+            ok = (bool)(in >> scene.stars >> scene.starSeed >> scene.starRadius);
+        else if (record == "material") {
+            SceneMaterial m;
+            ok = (bool)(in >> m.diffuse >> m.specular >> m.shininess);
+            if (ok)
+                scene.materials.push_back(m);
+        }
+        else {
+            error = path + ":" + std::to_string(lineNumber) + ": unknown record '" + record + "'";
+            return false;
+        }
+        std::string extra;
+        if (!ok || in >> extra) {
+            error = path + ":" + std::to_string(lineNumber) + ": malformed '" + record + "' record";
+            return false;
+        }
+    }
+
+    size_t gears = scene.x.size();
+    for (size_t m = 0; m < scene.meshA.size(); m++)
+        if (scene.meshA[m] >= gears || scene.meshB[m] >= gears) {
+            error = path + ": mesh " + std::to_string(scene.meshA[m]) + " " + std::to_string(scene.meshB[m]) + " names a gear that does not exist";
+            return false;
+        }
+    if (gears == 0 || (driverSet && scene.driver >= gears)) {
+        error = path + (gears == 0 ? ": no gears" : ": the driver gear does not exist");
+        return false;
+    }
+    if (scene.pointLights.size() < NR_POINT_LIGHTS) {
+        error = path + ": needs at least four point lights (the light rig's lamps)";
+        return false;
+    }
+    return true;
+}
+
+// the shortest decimal that reads back as exactly f, so exported text compiles to the same bits
+inline std::string SceneFloat(float f)
+{
+    char buffer[32];
+    for (int digits = 6; digits <= 9; digits++) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", digits, f);
+        if (std::strtof(buffer, NULL) == f)
+            break;
+    }
+    return buffer;
+}
+
+inline bool WriteSceneText(const std::string& path, const SceneSource& scene)
+{
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+    auto v = [](const glm::vec3& c) { return SceneFloat(c.x) + " " + SceneFloat(c.y) + " " + SceneFloat(c.z); };
+    std::fprintf(file, "# gear scene: %zu gears, %zu meshes, %zu point lights (see src/scene.h for the records)\n",
+        scene.x.size(), scene.meshA.size(), scene.pointLights.size());
+    std::fprintf(file, "teeth %s %s %s\n", SceneFloat(scene.toothLength).c_str(), SceneFloat(scene.toothHeight).c_str(),
+        SceneFloat(scene.toothThickness).c_str());
+    std::fprintf(file, "driver %u %.17g\n", scene.driver, scene.driverOmega);
+    const SceneDirLight& d = scene.dirLight;
+    std::fprintf(file, "dirlight %s  %s  %s  %s\n", v(d.direction).c_str(), v(d.ambient).c_str(), v(d.diffuse).c_str(), v(d.specular).c_str());
+    const SceneSpotLight& s = scene.spotLight;
+    std::fprintf(file, "spotlight %s  %s  %s  %s  %s %s\n", v(s.ambient).c_str(), v(s.diffuse).c_str(), v(s.specular).c_str(),
+        v(s.attenuation).c_str(), SceneFloat(s.cutOffDegrees).c_str(), SceneFloat(s.outerCutOffDegrees).c_str());
+    for (const ScenePointLight& p : scene.pointLights)
+        std::fprintf(file, "pointlight %s  %s  %s  %s  %s\n", v(p.position).c_str(), v(p.ambient).c_str(), v(p.diffuse).c_str(),
+            v(p.specular).c_str(), v(p.attenuation).c_str());
+    std::fprintf(file, "stars %u %u %s\n", scene.stars, scene.starSeed, SceneFloat(scene.starRadius).c_str());
+    for (const SceneMaterial& m : scene.materials)
+        std::fprintf(file, "material %s %s %s\n", m.diffuse.c_str(), m.specular.c_str(), SceneFloat(m.shininess).c_str());
+    std::fprintf(file, "# x y z teeth pitch-radius\n");
+    for (size_t g = 0; g < scene.x.size(); g++)
+        std::fprintf(file, "gear %s %d %s\n", v(glm::vec3(scene.x[g], scene.y[g], scene.z[g])).c_str(), scene.teeth[g], SceneFloat(scene.radius[g]).c_str());
+    for (size_t m = 0; m < scene.meshA.size(); m++)
+        std::fprintf(file, "mesh %u %u\n", scene.meshA[m], scene.meshB[m]);
+    return std::fclose(file) == 0;
+}
+
+// where compiling spent its time
+struct SceneCompileStats {
+    double parseMs = 0.0, solveMs = 0.0, starsMs = 0.0, writeMs = 0.0;
+    unsigned int conflicts = 0; // meshes that would lock the train, ignored by the solve
+};
+
+// solves the train, generates the stars and writes the compiled form, through a temporary file like cooked textures
+inline bool CompileScene(const SceneSource& scene, uint64_t sourceHash, const std::string& path, SceneCompileStats& stats, ThreadPool* pool = nullptr)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    GearTrain train;
+    for (size_t g = 0; g < scene.x.size(); g++)
+        train.AddGear(glm::vec3(scene.x[g], scene.y[g], scene.z[g]), scene.teeth[g], scene.radius[g]);
+    for (size_t m = 0; m < scene.meshA.size(); m++)
+        train.AddMesh(scene.meshA[m], scene.meshB[m]);
+    stats.conflicts = train.Solve(scene.driver, scene.driverOmega);
+    std::vector<double> omega(train.Size()), phase(train.Size());
+    for (size_t g = 0; g < train.Size(); g++) {
+        omega[g] = train.Omega(g);
+        phase[g] = train.Phase(g);
+    }
+    stats.solveMs = ElapsedMs(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<Star> stars = GenerateStars(scene.stars, scene.starRadius, scene.starSeed, pool);
+    std::vector<glm::vec3> starPosition(stars.size()), starColor(stars.size());
+    for (size_t i = 0; i < stars.size(); i++) {
+        starPosition[i] = stars[i].position;
+        starColor[i] = stars[i].color;
+    }
+    stats.starsMs = ElapsedMs(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<glm::vec3> lightPosition, lightAmbient, lightDiffuse, lightSpecular, lightAttenuation;
+    for (const ScenePointLight& p : scene.pointLights) {
+        lightPosition.push_back(p.position);
+        lightAmbient.push_back(p.ambient);
+        lightDiffuse.push_back(p.diffuse);
+        lightSpecular.push_back(p.specular);
+        lightAttenuation.push_back(p.attenuation);
+    }
+    std::string strings;
+    std::vector<uint32_t> materialDiffuse, materialSpecular;
+    std::vector<float> materialShininess;
+    for (const SceneMaterial& m : scene.materials) {
+        materialDiffuse.push_back((uint32_t)strings.size());
+        strings += m.diffuse + '\0';
+        materialSpecular.push_back((uint32_t)strings.size());
+        strings += m.specular + '\0';
+        materialShininess.push_back(m.shininess);
+    }
+
+    CompiledSceneHeader header = {};
+    std::memcpy(header.magic, COMPILED_SCENE_MAGIC, 4);
+    header.version = COMPILED_SCENE_VERSION;
+    header.sourceHash = sourceHash;
+    header.gears = (uint32_t)scene.x.size();
+    header.meshes = (uint32_t)scene.meshA.size();
+    header.pointLights = (uint32_t)scene.pointLights.size();
+    header.stars = (uint32_t)stars.size();
+    header.materials = (uint32_t)scene.materials.size();
+    header.stringBytes = (uint32_t)strings.size();
+    header.driver = scene.driver;
+    header.starSeed = scene.starSeed;
+    header.driverOmega = scene.driverOmega;
+    header.toothLength = scene.toothLength;
+    header.toothHeight = scene.toothHeight;
+    header.toothThickness = scene.toothThickness;
+    header.starRadius = scene.starRadius;
+    header.dirLight = scene.dirLight;
+    header.spotLight = scene.spotLight;
+
+    const void* arrays[SCENE_ARRAYS] = {
+        scene.x.data(), scene.y.data(), scene.z.data(), scene.radius.data(), scene.teeth.data(),
+        omega.data(), phase.data(), scene.meshA.data(), scene.meshB.data(),
+        lightPosition.data(), lightAmbient.data(), lightDiffuse.data(), lightSpecular.data(), lightAttenuation.data(),
+        starPosition.data(), starColor.data(),
+        materialDiffuse.data(), materialSpecular.data(), materialShininess.data(), strings.data()
+    };
+    uint64_t offset = (sizeof(header) + 15) & ~15ull;
+    for (int a = 0; a < SCENE_ARRAYS; a++) {
+        header.arrayOffset[a] = offset;
+        offset = (offset + SceneArrayElementSize(a) * SceneArrayCount(header, a) + 15) & ~15ull;
+    }
+
+    std::string temp = path + ".tmp";
+    FILE* file = std::fopen(temp.c_str(), "wb");
+    if (!file)
+        return false;
+    static const unsigned char zeros[16] = {};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    for (int a = 0; ok && a < SCENE_ARRAYS; a++) {
+        size_t bytes = SceneArrayElementSize(a) * SceneArrayCount(header, a);
+        ok = std::fwrite(zeros, 1, (size_t)(header.arrayOffset[a] - written), file) == header.arrayOffset[a] - written
+          && (bytes == 0 || std::fwrite(arrays[a], 1, bytes, file) == bytes);
+        written = header.arrayOffset[a] + bytes;
+    }
+    ok = std::fclose(file) == 0 && ok;
+    std::remove(path.c_str()); // rename does not replace an existing file everywhere
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    stats.writeMs = ElapsedMs(start);
+    return true;
+}
+
+// a mapped compiled scene; every accessor points into the mapping
+class CompiledScene
+{
+public:
+    const CompiledSceneHeader* header = NULL;
+    std::string error; // why the last Open failed
+
+    // checkHash: only accept a file compiled from text with that hash (a .bin opened directly skips it).
+    // A .bin can come from anywhere, so it gets the same checks ParseSceneText makes on text before anything
+    // indexes into it.
+    bool Open(const std::string& path, bool checkHash = false, uint64_t sourceHash = 0)
+    {
+        header = NULL;
+        error = "is not a compiled scene";
+        if (!file.Open(path) || file.Size() < sizeof(CompiledSceneHeader))
+            return false;
+        const CompiledSceneHeader* h = (const CompiledSceneHeader*)file.Data();
+        if (std::memcmp(h->magic, COMPILED_SCENE_MAGIC, 4) != 0)
+            return false;
+        if (h->version != COMPILED_SCENE_VERSION || (checkHash && h->sourceHash != sourceHash)) {
+            error = "is from another version or another text";
+            return false;
+        }
+        error = "is truncated or corrupt";
+        for (int a = 0; a < SCENE_ARRAYS; a++)
+            if (h->arrayOffset[a] % 16 != 0 || h->arrayOffset[a] > file.Size()
+                || SceneArrayElementSize(a) * SceneArrayCount(*h, a) > file.Size() - h->arrayOffset[a])
+                return false;
+        header = h;
+        if (!Validate())
+            header = NULL;
+        return header != NULL;
+    }
+
+    bool Loaded() const { return header != NULL; }
+
+    template <typename T>
+    const T* Array(SceneArray array) const { return (const T*)(file.Data() + header->arrayOffset[array]); }
+
+    const char* String(uint32_t offset) const { return offset < header->stringBytes ? Array<char>(SCENE_STRINGS) + offset : ""; }
+
+    glm::vec3 GearCenter(size_t g) const
+    {
+        return glm::vec3(Array<float>(SCENE_GEAR_X)[g], Array<float>(SCENE_GEAR_Y)[g], Array<float>(SCENE_GEAR_Z)[g]);
+    }
+
+    ScenePointLight PointLight(size_t i) const
+    {
+        ScenePointLight p;
+        p.position = Array<glm::vec3>(SCENE_LIGHT_POSITION)[i];
+        p.ambient = Array<glm::vec3>(SCENE_LIGHT_AMBIENT)[i];
+        p.diffuse = Array<glm::vec3>(SCENE_LIGHT_DIFFUSE)[i];
+        p.specular = Array<glm::vec3>(SCENE_LIGHT_SPECULAR)[i];
+        p.attenuation = Array<glm::vec3>(SCENE_LIGHT_ATTENUATION)[i];
+        return p;
+    }
+
+    SceneMaterial Material(size_t i) const
+    {
+        SceneMaterial m;
+        m.diffuse = String(Array<uint32_t>(SCENE_MATERIAL_DIFFUSE)[i]);
+        m.specular = String(Array<uint32_t>(SCENE_MATERIAL_SPECULAR)[i]);
+        m.shininess = Array<float>(SCENE_MATERIAL_SHININESS)[i];
+        return m;
+    }
+
+    // the solved train, copied in bulk: one allocation per array, however many gears
+    GearTrain MakeGearTrain() const
+    {
+        GearTrain train;
+        train.Assign(header->gears, Array<float>(SCENE_GEAR_X), Array<float>(SCENE_GEAR_Y), Array<float>(SCENE_GEAR_Z),
+            Array<int>(SCENE_GEAR_TEETH), Array<float>(SCENE_GEAR_RADIUS), Array<double>(SCENE_GEAR_OMEGA), Array<double>(SCENE_GEAR_PHASE),
+            header->meshes, Array<uint32_t>(SCENE_MESH_A), Array<uint32_t>(SCENE_MESH_B), header->driver, header->driverOmega);
+        return train;
+    }
+
+    std::vector<Star> Stars() const
+    {
+        std::vector<Star> stars(header->stars);
+        const glm::vec3* position = Array<glm::vec3>(SCENE_STAR_POSITION);
+        const glm::vec3* color = Array<glm::vec3>(SCENE_STAR_COLOR);
+        for (size_t i = 0; i < stars.size(); i++)
+            stars[i] = { position[i], color[i] };
+        return stars;
+    }
+
+    size_t Bytes() const { return file.Size(); }
+
+private:
+    MappedFile file;
+
+    bool Validate()
+    {
+        if (header->gears == 0 || header->driver >= header->gears) {
+            error = header->gears == 0 ? "has no gears" : "names a driver gear that does not exist";
+            return false;
+        }
+        if (header->pointLights < NR_POINT_LIGHTS) {
+            error = "has fewer than four point lights (the light rig's lamps)";
+            return false;
+        }
+        const int* teeth = Array<int>(SCENE_GEAR_TEETH);
+        const float* radius = Array<float>(SCENE_GEAR_RADIUS);
+        for (uint32_t g = 0; g < header->gears; g++)
+            if (teeth[g] < 3 || !(radius[g] > 0.0f)) {
+                error = "has gear " + std::to_string(g) + " with fewer than 3 teeth or no radius";
+                return false;
+            }
+        const uint32_t* meshA = Array<uint32_t>(SCENE_MESH_A);
+        const uint32_t* meshB = Array<uint32_t>(SCENE_MESH_B);
+        for (uint32_t m = 0; m < header->meshes; m++)
+            if (meshA[m] >= header->gears || meshB[m] >= header->gears || meshA[m] == meshB[m]) {
+                error = "has mesh " + std::to_string(m) + " joining a gear to itself or to one that does not exist";
+                return false;
+            }
+        return true;
+    }
+};
+
+// Loads a scene for --scene. A .bin path is mapped as it is. A text path maps <path>.bin when that was
+// compiled from the same text, and otherwise compiles it first. Prints what it did and how long it took.
+inline bool LoadScene(const std::string& path, CompiledScene& scene, ThreadPool* pool = nullptr)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    bool compiled = path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    if (compiled) {
+        if (!scene.Open(path)) {
+            std::printf("scene: %s %s\n", path.c_str(), scene.error.c_str());
+            return false;
+        }
+        std::printf("scene: mapped %s (%.1f KB) in %.3f ms\n", path.c_str(), scene.Bytes() / 1024.0, ElapsedMs(start));
+    }
+    else {
+        uint64_t hash = 0;
+        if (!HashFile(path, hash)) {
+            std::printf("scene: cannot read %s\n", path.c_str());
+            return false;
+        }
+        double hashMs = ElapsedMs(start);
+        std::string binary = path + ".bin";
+        if (scene.Open(binary, true, hash)) {
+            std::printf("scene: mapped %s (%.1f KB) in %.3f ms, %.3f ms of it hashing the text\n", binary.c_str(),
+                scene.Bytes() / 1024.0, ElapsedMs(start), hashMs);
+        }
+        else {
+            SceneCompileStats stats;
+            SceneSource source;
+            std::string error;
+            auto parseStart = std::chrono::high_resolution_clock::now();
+            if (!ParseSceneText(path, source, error)) {
+                std::printf("scene: %s\n", error.c_str());
+                return false;
+            }
+            stats.parseMs = ElapsedMs(parseStart);
+            if (!CompileScene(source, hash, binary, stats, pool) || !scene.Open(binary, true, hash)) {
+                std::printf("scene: could not write %s\n", binary.c_str());
+                return false;
+            }
+            std::printf("scene: compiled %s into %s (%.1f KB) in %.3f ms: hash %.3f, parse %.3f, solve %.3f, stars %.3f, write %.3f ms\n",
+                path.c_str(), binary.c_str(), scene.Bytes() / 1024.0, ElapsedMs(start), hashMs, stats.parseMs, stats.solveMs, stats.starsMs, stats.writeMs);
+            if (stats.conflicts)
+                std::printf("scene: %u meshes would lock the train and are ignored\n", stats.conflicts);
+        }
+    }
+    const CompiledSceneHeader& h = *scene.header;
+    std::printf("scene: %u gears, %u meshes, %u point lights, %u stars, %u materials\n", h.gears, h.meshes, h.pointLights, h.stars, h.materials);
+    return true;
+}
+
+#endif
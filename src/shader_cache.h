@@ -0,0 +1,307 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Program binary cache
+// --------------------
+// Linked programs are saved with glGetProgramBinary and reloaded with glProgramBinary on later runs,
+// skipping compile and link. The key hashes the exact sources handed to the compiler together with the
+// driver's vendor, renderer and version strings, so a shader edit or a driver update simply misses.
+// A binary the driver rejects anyway (it may, after any update) is deleted and the program is compiled
+// from source as usual. Program binaries are GL 4.1 / ARB_get_program_binary, so the entry points are
+// resolved here through the same loader glad used, and the cache turns itself off where they are missing.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    return hash;
+}
+
+class ProgramBinaryCache
+{
+public:
+    unsigned int hits = 0, misses = 0, rejected = 0;
+    double loadMs = 0.0, compileMs = 0.0, linkMs = 0.0;
+
+    // load is the GL loader glad was initialized with; directory is created on the first store
+    bool Init(GLADloadproc load, const std::string& cacheDirectory)
+    {
+        getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+        programBinary = (ProgramBinaryProc)load("glProgramBinary");
+        programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+        // the entry points alone do not mean the context exposes them, and on a context without program binaries
+        // the format query itself is an invalid enum
+        GLint formats = 0;
+        if (getProgramBinary && programBinary && programParameteri && ContextHasProgramBinaries())
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats <= 0) {
+            std::cout << "shader cache: the driver offers no program binary formats, compiling from source" << std::endl;
+            return false;
+        }
+        directory = cacheDirectory;
+        driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER)
+               + "|" + (const char*)glGetString(GL_VERSION);
+        enabled = true;
+        return true;
+    }
+
+    bool Enabled() const { return enabled; }
+
+    uint64_t Key(const std::vector<std::string>& sources) const
+    {
+        uint64_t hash = HashBytes(driver.data(), driver.size());
+        for (const std::string& source : sources)
+            hash = HashBytes(source.c_str(), source.size() + 1, hash); // the terminator separates the stages
+        return hash;
+    }
+
+    // true when program now holds a linked binary from the cache
+    bool Load(uint64_t key, GLuint program)
+    {
+        if (!enabled)
+            return false;
+        auto start = std::chrono::high_resolution_clock::now();
+        std::ifstream file(Path(key), std::ios::binary);
+        BinaryHeader header;
+        if (!file || !file.read((char*)&header, sizeof(header)) || header.magic != BINARY_MAGIC || header.key != key) {
+            misses++;
+            return false;
+        }
+        // the length comes from disk: a truncated or corrupt file must not size the allocation
+        std::streamoff offset = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff remaining = file.tellg() - offset;
+        file.seekg(offset);
+        std::vector<char> binary((std::streamoff)header.length <= remaining ? header.length : 0);
+        GLint linked = 0;
+        if (!binary.empty() && file.read(binary.data(), binary.size())) {
+            programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        if (!linked) {
+            // stale or truncated; drop it so the next run stores a fresh one
+            file.close();
+            std::remove(Path(key).c_str());
+            rejected++;
+            misses++;
+            return false;
+        }
+        loadMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        hits++;
+        return true;
+    }
+
+    // call before glLinkProgram on a program that should be stored afterwards
+    void PrepareLink(GLuint program) const
+    {
+        if (enabled)
+            programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    void Store(uint64_t key, GLuint program)
+    {
+        if (!enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        BinaryHeader header;
+        header.key = key;
+        GLsizei written = 0;
+        getProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = (uint32_t)written;
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::ofstream file(Path(key), std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), written))
+            std::cout << "shader cache: could not write " << Path(key) << std::endl;
+    }
+
+    void PrintStats() const
+    {
+        std::printf("shader cache: %u hits, %u misses (%u rejected by the driver) | binaries loaded in %.2f ms, compile %.2f ms, link %.2f ms\n",
+            hits, misses, rejected, loadMs, compileMs, linkMs);
+    }
+
+private:
+    typedef void (APIENTRYP GetProgramBinaryProc)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+    typedef void (APIENTRYP ProgramBinaryProc)(GLuint, GLenum, const void*, GLsizei);
+    typedef void (APIENTRYP ProgramParameteriProc)(GLuint, GLenum, GLint);
+
+    static const uint32_t BINARY_MAGIC = 0x47505247; // "GRPG"
+    struct BinaryHeader {
+        uint32_t magic = BINARY_MAGIC;
+        GLenum format = 0;
+        uint64_t key = 0;
+        uint32_t length = 0;
+    };
+
+    bool enabled = false;
+    std::string directory, driver;
+    GetProgramBinaryProc getProgramBinary = NULL;
+    ProgramBinaryProc programBinary = NULL;
+    ProgramParameteriProc programParameteri = NULL;
+
+    // program binaries are core in GL 4.1, and ARB_get_program_binary before that
+    static bool ContextHasProgramBinaries()
+    {
+        GLint major = 0, minor = 0, extensions = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major * 10 + minor >= 41)
+            return true;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions; i++)
+            if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i), "GL_ARB_get_program_binary") == 0)
+                return true;
+        return false;
+    }
+
+    std::string Path(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+};
+
+// Drop-in for learnopengl's Shader (same ID, use() and setters) that goes through a ProgramBinaryCache.
+// With no cache, or on a miss, it compiles and links from source exactly like Shader does.
+// defines ("#define NAME value" lines) are inserted into both stages right after their #version line.
+class CachedShader
+{
+public:
+    unsigned int ID = 0;
+
+    CachedShader(const char* vertexPath, const char* fragmentPath, ProgramBinaryCache* cache = NULL,
+        const std::string& defines = std::string())
+    {
+        std::vector<std::string> sources = { InjectDefines(ReadFile(vertexPath), defines),
+                                             InjectDefines(ReadFile(fragmentPath), defines) };
+        ID = glCreateProgram();
+        uint64_t key = cache ? cache->Key(sources) : 0;
+        if (cache && cache->Load(key, ID)) {
+            linked = true;
+            return;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        unsigned int vertex = Compile(GL_VERTEX_SHADER, sources[0], "VERTEX");
+        unsigned int fragment = Compile(GL_FRAGMENT_SHADER, sources[1], "FRAGMENT");
+        auto compiled = std::chrono::high_resolution_clock::now();
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if (cache)
+            cache->PrepareLink(ID);
+        glLinkProgram(ID);
+        linked = CheckLinkErrors(ID);
+        auto end = std::chrono::high_resolution_clock::now();
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+
+        if (cache) {
+            cache->compileMs += std::chrono::duration<double, std::milli>(compiled - start).count();
+            cache->linkMs += std::chrono::duration<double, std::milli>(end - compiled).count();
+            if (linked)
+                cache->Store(key, ID);
+        }
+    }
+
+    CachedShader(const CachedShader&) = delete;
+    CachedShader& operator=(const CachedShader&) = delete;
+
+    bool Linked() const { return linked; }
+
+    void use() const { glUseProgram(ID); }
+    void setBool(const std::string& name, bool value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); }
+    void setInt(const std::string& name, int value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), value); }
+    void setFloat(const std::string& name, float value) const { glUniform1f(glGetUniformLocation(ID, name.c_str()), value); }
+    void setVec3(const std::string& name, const glm::vec3& value) const { glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); }
+    void setMat4(const std::string& name, const glm::mat4& mat) const { glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]); }
+
+private:
+    bool linked = false;
+
+    static std::string InjectDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+
+    static std::string ReadFile(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return std::string();
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+
+    static unsigned int Compile(GLenum type, const std::string& source, const char* typeName)
+    {
+        unsigned int shader = glCreateShader(type);
+        const char* code = source.c_str();
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        GLint success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLchar infoLog[1024];
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << typeName << "\n" << infoLog
+                      << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+        return shader;
+    }
+
+    static bool CheckLinkErrors(unsigned int program)
+    {
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            GLchar infoLog[1024];
+            glGetProgramInfoLog(program, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog
+                      << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+        return success != 0;
+    }
+};
+
+#endif
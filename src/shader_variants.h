@@ -0,0 +1,298 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "light_rig.h"
+#include "shader_cache.h"
+#include "uniforms.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lighting shader variants
+// ------------------------
+// 6.multiple_lights.fs as written is an uber-shader: every fragment evaluates the directional light, all
+// NR_POINT_LIGHTS point lights, the flashlight and the starlight, picks the point-light path from a uniform,
+// and each light samples both material textures again. A variant is the same source compiled with the light
+// setup as constants (see the defines at the top of the .fs): lights that would add nothing are stripped,
+// the point-light loop gets a constant trip count, and the material is sampled once per fragment.
+// Variants are built the first time a feature set is drawn and kept by its key; one that fails to build
+// is replaced by the uber-shader, so a driver that rejects a variant still renders the same image.
+
+struct LightingFeatures {
+    bool dirLight = true;
+    int pointLights = NR_POINT_LIGHTS;
+    bool spotLight = true;
+    bool clustered = false; // the clustered path replaces the fixed point lights
+    bool starlight = true;
+    bool shadows = false;     // with shadows off, the shadow lookups are compiled out instead of skipped at run time
+    bool bakedLights = false; // the directional and point lights' ambient and diffuse come from the irradiance volume
+
+    // the lights that actually contribute with the rig as it is now; the volume only holds the rig's own point lights
+    static LightingFeatures FromRig(const LightRigStd140& rig, bool clustered, bool starlight, bool shadows, bool bakedLights = false)
+    {
+        LightingFeatures features;
+        features.dirLight = !IsBlack(rig.dirLight.ambient, rig.dirLight.diffuse, rig.dirLight.specular);
+        features.pointLights = 0;
+        if (!clustered)
+            for (int i = 0; i < NR_POINT_LIGHTS; i++)
+                if (!IsBlack(rig.pointLights[i].ambient, rig.pointLights[i].diffuse, rig.pointLights[i].specular))
+                    features.pointLights = i + 1; // the loop runs over a prefix, dark lights before the last lit one stay in
+        features.spotLight = !IsBlack(rig.spotLight.ambient, rig.spotLight.diffuse, rig.spotLight.specular);
+        features.clustered = clustered;
+        features.starlight = starlight;
+        features.shadows = shadows;
+        features.bakedLights = bakedLights && !clustered && !shadows;
+        return features;
+    }
+
+    unsigned int Key() const
+    {
+        return (dirLight ? 1u : 0u) | (spotLight ? 2u : 0u) | (clustered ? 4u : 0u) | (starlight ? 8u : 0u)
+             | (shadows ? 16u : 0u) | (bakedLights ? 32u : 0u) | ((unsigned int)pointLights << 6);
+    }
+
+    std::string Defines() const
+    {
+        return "#define VARIANT\n"
+               "#define DIR_LIGHT " + std::to_string(dirLight ? 1 : 0) + "\n"
+               "#define POINT_LIGHTS " + std::to_string(pointLights) + "\n"
+               "#define SPOT_LIGHT " + std::to_string(spotLight ? 1 : 0) + "\n"
+               "#define CLUSTERED " + std::to_string(clustered ? 1 : 0) + "\n"
+               "#define STARLIGHT " + std::to_string(starlight ? 1 : 0) + "\n"
+               "#define SHADOWS " + std::to_string(shadows ? 1 : 0) + "\n"
+               "#define BAKED_LIGHTS " + std::to_string(bakedLights ? 1 : 0) + "\n";
+    }
+
+    std::string Name() const
+    {
+        std::string name;
+        if (dirLight)
+            name += "+dir";
+        if (clustered)
+            name += "+clustered";
+        else if (pointLights > 0)
+            name += "+" + std::to_string(pointLights) + "pt";
+        if (spotLight)
+            name += "+spot";
+        if (starlight)
+            name += "+stars";
+        if (shadows)
+            name += "+shadows";
+        if (bakedLights)
+            name += "+baked";
+        return name.empty() ? "unlit" : name.substr(1);
+    }
+
+    // material texture samples per fragment, not counting clustered lights (three each in the uber-shader)
+    static unsigned int UberTextureFetches(bool clustered) { return 3 * (1 + (clustered ? 0 : NR_POINT_LIGHTS) + 1) + 1; }
+    // twice the material, plus three faces of the irradiance volume when baked
+    unsigned int VariantTextureFetches() const { return bakedLights ? 5 : 2; }
+
+private:
+    static bool IsBlack(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        return a == glm::vec3(0.0f) && b == glm::vec3(0.0f) && c == glm::vec3(0.0f);
+    }
+};
+
+// a linked lighting program and its uniform locations
+struct LightingProgram {
+    std::unique_ptr<CachedShader> shader;
+    LightingUniforms uniforms;
+    std::string name;
+};
+
+class LightingVariants
+{
+public:
+    // one-time setup of a freshly linked program (samplers, uniform blocks, constant uniforms); it is in use when called
+    typedef std::function<void(const CachedShader&, const LightingUniforms&)> ConfigureFn;
+
+    unsigned int failed = 0;
+
+    // builds the uber-shader right away; variants follow on demand
+    void Init(const char* vertex, const char* fragment, ProgramBinaryCache* cache)
+    {
+        vertexPath = vertex;
+        fragmentPath = fragment;
+        programCache = cache;
+        // link errors are printed and the program kept regardless, as with a plain Shader; there is nothing to fall back to
+        uber.reset(new LightingProgram());
+        uber->shader.reset(new CachedShader(vertexPath.c_str(), fragmentPath.c_str(), programCache));
+        uber->uniforms.Resolve(uber->shader->ID);
+        uber->name = "uber-shader";
+    }
+
+    // sets the one-time setup and applies it to every program built so far
+    void Configure(ConfigureFn fn)
+    {
+        configure = fn;
+        ApplyConfigure(*uber);
+        for (const std::unique_ptr<LightingProgram>& program : variants)
+            ApplyConfigure(*program);
+    }
+
+    const LightingProgram& Uber() const { return *uber; }
+
+    const LightingProgram& Get(const LightingFeatures& features)
+    {
+        std::map<unsigned int, const LightingProgram*>::iterator found = byKey.find(features.Key());
+        if (found != byKey.end())
+            return *found->second;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::unique_ptr<LightingProgram> program = BuildVariant(features);
+        const LightingProgram* chosen = uber.get();
+        if (program) {
+            ApplyConfigure(*program);
+            chosen = program.get();
+            variants.push_back(std::move(program));
+            std::printf("shader variant %s ready in %.2f ms\n", chosen->name.c_str(),
+                std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        else {
+            failed++;
+            std::cout << "shader variant " << features.Name() << " failed to build, drawing it with the uber-shader" << std::endl;
+        }
+        byKey[features.Key()] = chosen;
+        return *chosen;
+    }
+
+    size_t Count() const { return variants.size(); }
+
+    void Destroy()
+    {
+        for (const std::unique_ptr<LightingProgram>& program : variants)
+            glDeleteProgram(program->shader->ID);
+        if (uber)
+            glDeleteProgram(uber->shader->ID);
+        variants.clear();
+        byKey.clear();
+        uber.reset();
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    ProgramBinaryCache* programCache = NULL;
+    ConfigureFn configure;
+    std::unique_ptr<LightingProgram> uber;
+    std::vector<std::unique_ptr<LightingProgram>> variants;
+    std::map<unsigned int, const LightingProgram*> byKey;
+
+    std::unique_ptr<LightingProgram> BuildVariant(const LightingFeatures& features) const
+    {
+        std::unique_ptr<LightingProgram> program(new LightingProgram());
+        program->shader.reset(new CachedShader(vertexPath.c_str(), fragmentPath.c_str(), programCache, features.Defines()));
+        if (!program->shader->Linked()) {
+            glDeleteProgram(program->shader->ID);
+            return std::unique_ptr<LightingProgram>();
+        }
+        program->uniforms.Resolve(program->shader->ID);
+        program->name = features.Name();
+        return program;
+    }
+
+    void ApplyConfigure(const LightingProgram& program) const
+    {
+        if (!configure)
+            return;
+        program.shader->use();
+        configure(*program.shader, program.uniforms);
+    }
+};
+
+// --bench-variants: GPU time of the lighting fragment shader, uber-shader against each variant.
+// Draws `layers` full-screen quads per sample without depth testing, so every layer shades every pixel,
+// and keeps the best of `samples`, both as a GPU timer query and as wall clock up to glFinish (software
+// rasterizers such as llvmpipe report timer queries that miss most of the shading work; the speedup column
+// uses the wall clock). Expects the material textures, the light rig and the shadow maps bound; the uber-shader
+// runs with its shadows uniform off, the variants with shadows as their features say, filtered by shadowPcf.
+inline void RunLightingVariantBenchmark(LightingVariants& lighting, const std::vector<LightingFeatures>& configs,
+    int width, int height, int shadowPcf, unsigned int layers = 16, unsigned int samples = 5)
+{
+    // a full-screen quad facing the viewer, in the cube's vertex layout (position, normal, texture coords)
+    const float quad[] = {
+        -1.0f, -1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+         1.0f, -1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  1.0f, 0.0f,
+         1.0f,  1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  1.0f, 1.0f,
+        -1.0f,  1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 1.0f
+    };
+    unsigned int vao, vbo, query;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glGenQueries(1, &query);
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+
+    // identity transforms put the quad at z = 0 in front of a viewer at z = 3, between the point lights
+    auto measure = [&](const LightingProgram& program) {
+        program.shader->use();
+        SetUniform(program.uniforms.model, glm::mat4(1.0f));
+        SetUniform(program.uniforms.view, glm::mat4(1.0f));
+        SetUniform(program.uniforms.projection, glm::mat4(1.0f));
+        SetUniform(program.uniforms.instanced, false);
+        SetUniform(program.uniforms.clustered, false);
+        SetUniform(program.uniforms.shadows, false);
+        SetUniform(program.uniforms.shadowPcf, shadowPcf);
+        SetUniform(program.uniforms.viewPos, glm::vec3(0.0f, 0.0f, 3.0f));
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4); // first use may still finish compiling in the driver
+        glFinish();
+        double bestGpuMs = 1.0e30, bestWallMs = 1.0e30;
+        for (unsigned int s = 0; s < samples; s++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            for (unsigned int l = 0; l < layers; l++)
+                glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            glEndQuery(GL_TIME_ELAPSED);
+            glFinish();
+            bestWallMs = std::min(bestWallMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            bestGpuMs = std::min(bestGpuMs, ns / 1.0e6);
+        }
+        return glm::dvec2(bestGpuMs, bestWallMs) / (double)layers; // ms per full-screen layer
+    };
+
+    const double pixels = (double)width * height;
+    std::printf("lighting fragment cost, %dx%d, best of %u samples of %u full-screen layers\n", width, height, samples, layers);
+    std::printf("%-26s %9s %13s %14s %12s %9s\n", "program", "tex/frag", "gpu ms/layer", "wall ms/layer", "ns/pixel", "speedup");
+    auto print = [&](const char* name, unsigned int fetches, glm::dvec2 ms, double uberWallMs) {
+        std::printf("%-26s %9u %13.3f %14.3f %12.3f %8.2fx\n", name, fetches, ms.x, ms.y, ms.y * 1.0e6 / pixels,
+            ms.y > 0.0 ? uberWallMs / ms.y : 0.0);
+    };
+    glm::dvec2 uberMs = measure(lighting.Uber());
+    print("uber-shader", LightingFeatures::UberTextureFetches(false), uberMs, uberMs.y);
+    for (const LightingFeatures& features : configs) {
+        const LightingProgram& program = lighting.Get(features);
+        bool fellBack = &program == &lighting.Uber();
+        print(features.Name().c_str(), fellBack ? LightingFeatures::UberTextureFetches(false) : features.VariantTextureFetches(),
+            measure(program), uberMs.y);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    glDeleteQueries(1, &query);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    glBindVertexArray(0);
+}
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "culling.h"
+#include "geometry_arena.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Cached shadow maps
+// ------------------
+// The directional light gets one 2D depth map over the whole gear train and each point light gets a depth
+// cube map. Every map has two layers:
+//   static   what never moves (the hub cylinders, which are round and only spin, and the lamps), drawn once
+//   dynamic  what moves (cube teeth, baked gears), drawn again every frame
+// The lighting shader tests a point against both layers and multiplies the results, so nothing has to be
+// composited. A dynamic view with no casters in its frustum is not drawn. After its last caster leaves, it
+// is cleared once. In uncached mode the static layers are redrawn every frame as well, which is what a
+// renderer without caching would pay.
+// Casters are rendered back faces only, which moves the stored depth to the far side of each object, so lit
+// surfaces do not shadow themselves. The shader adds a small offset along the normal for the remaining
+// grazing angles.
+
+enum ShadowMode { SHADOWS_OFF, SHADOWS_CACHED, SHADOWS_UNCACHED, SHADOW_MODES };
+const char* const SHADOW_MODE_NAMES[SHADOW_MODES] = { "off", "cached", "uncached" };
+
+const int SHADOW_POINT_LIGHTS = 4;
+
+struct ShadowSettings {
+    int dirSize = 2048;       // directional map, texels per side
+    int cubeSize = 256;       // point light cube maps, texels per face side
+    float pointNear = 0.05f;
+    float pointFar = 30.0f;
+    int firstUnit = 5;        // texture units firstUnit..firstUnit + 9: dir static, dir dynamic, 4 static cubes, 4 dynamic cubes
+};
+
+// instances of one arena mesh range; models must stay valid until Render() returns
+struct ShadowCaster {
+    const ArenaMesh* mesh = NULL;
+    uint32_t firstIndex = 0, indexCount = 0;
+    const glm::mat4* models = NULL;
+    uint32_t instances = 1;
+    Aabb bounds;                    // world space, around every instance
+    bool pointLights = true;        // false: only the directional light sees it (the lamps, which hold the point lights)
+};
+
+// views drawn and time spent, summed over frames
+struct ShadowStats {
+    size_t frames = 0, staticViews = 0, dynamicViews = 0, clearedViews = 0, commands = 0;
+    double ms = 0.0;
+
+    void Print(const char* label, int pcf) const
+    {
+        size_t n = std::max<size_t>(frames, 1);
+        std::printf("%s: %.3f ms per frame | views drawn per frame: %.1f static, %.1f dynamic, %.2f cleared (of %d each)"
+                    " | %zu caster commands per frame | PCF radius %d\n", label, ms / n,
+            (double)staticViews / n, (double)dynamicViews / n, (double)clearedViews / n, 1 + 6 * SHADOW_POINT_LIGHTS, commands / n, pcf);
+    }
+};
+
+class ShadowMaps
+{
+public:
+    ShadowSettings settings;
+    ShadowStats stats;
+
+    // program: 6.shadow_depth; the directional map covers sceneBounds as seen along lightDirection
+    void Init(unsigned int depthProgram, const glm::vec3& lightDirection, const Aabb& sceneBounds, const glm::vec3* pointLights, const ShadowSettings& shadowSettings = ShadowSettings())
+    {
+        settings = shadowSettings;
+        program = depthProgram;
+        lightViewProjection = glGetUniformLocation(program, "lightViewProjection");
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        // directional: an orthographic box around the scene's bounding sphere, so it fits at any light angle
+        glm::vec3 dir = glm::normalize(lightDirection), center = sceneBounds.Center();
+        float radius = std::max(0.5f * glm::length(sceneBounds.Extent()), 0.01f);
+        glm::vec3 up = std::fabs(dir.y) > 0.9f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 dirView = glm::lookAt(center - dir * 2.0f * radius, center, up);
+        views[0].viewProjection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius) * dirView;
+        dirTexelWorld = 2.0f * radius / settings.dirSize;
+
+        // point lights: the six 90 degree faces in the order and orientation cube map lookups expect
+        static const glm::vec3 FACE_DIRECTIONS[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                                      glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+        static const glm::vec3 FACE_UPS[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+                                               glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+        glm::mat4 faceProjection = glm::perspective(glm::radians(90.0f), 1.0f, settings.pointNear, settings.pointFar);
+        for (int light = 0; light < SHADOW_POINT_LIGHTS; light++)
+            for (int face = 0; face < 6; face++)
+                views[1 + light * 6 + face].viewProjection = faceProjection
+                    * glm::lookAt(pointLights[light], pointLights[light] + FACE_DIRECTIONS[face], FACE_UPS[face]);
+        for (View& view : views)
+            view.frustum = Frustum::FromMatrix(view.viewProjection);
+
+        for (int layer = 0; layer < 2; layer++) {
+            dirMaps[layer] = CreateDepthTexture(GL_TEXTURE_2D, settings.dirSize);
+            for (int light = 0; light < SHADOW_POINT_LIGHTS; light++)
+                cubeMaps[layer][light] = CreateDepthTexture(GL_TEXTURE_CUBE_MAP, settings.cubeSize);
+        }
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // the maps stay bound to their units for the whole run; nothing else uses units past the cluster buffers
+        for (int layer = 0; layer < 2; layer++) {
+            glActiveTexture(GL_TEXTURE0 + settings.firstUnit + layer);
+            glBindTexture(GL_TEXTURE_2D, dirMaps[layer]);
+            for (int light = 0; light < SHADOW_POINT_LIGHTS; light++) {
+                glActiveTexture(GL_TEXTURE0 + settings.firstUnit + 2 + layer * SHADOW_POINT_LIGHTS + light);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMaps[layer][light]);
+            }
+        }
+        glActiveTexture(GL_TEXTURE0);
+        staticDirty = true;
+    }
+
+    void AddStaticCaster(const ShadowCaster& caster)
+    {
+        staticCasters.push_back(caster);
+        staticDirty = true;
+    }
+
+    // sampler units and the fixed lookup parameters of a lighting program (6.multiple_lights.fs)
+    void Attach(unsigned int lightingProgram) const
+    {
+        GLint dirUnits[2], pointUnits[2 * SHADOW_POINT_LIGHTS];
+        for (int i = 0; i < 2; i++)
+            dirUnits[i] = settings.firstUnit + i;
+        for (int i = 0; i < 2 * SHADOW_POINT_LIGHTS; i++)
+            pointUnits[i] = settings.firstUnit + 2 + i;
+        glUseProgram(lightingProgram);
+        glUniform1iv(glGetUniformLocation(lightingProgram, "dirShadow"), 2, dirUnits);
+        glUniform1iv(glGetUniformLocation(lightingProgram, "pointShadow"), 2 * SHADOW_POINT_LIGHTS, pointUnits);
+        // depth [0, 1] texture space, not [-1, 1] clip space
+        glm::mat4 toTexture = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+        glUniformMatrix4fv(glGetUniformLocation(lightingProgram, "dirShadowMatrix"), 1, GL_FALSE, glm::value_ptr(toTexture * views[0].viewProjection));
+        glUniform2f(glGetUniformLocation(lightingProgram, "dirShadowParams"), 1.0f / settings.dirSize, 1.5f * dirTexelWorld);
+        glUniform3f(glGetUniformLocation(lightingProgram, "pointShadowParams"), settings.pointNear, settings.pointFar, 2.0f / settings.cubeSize);
+    }
+
+    // draws the out-of-date layers: the dynamic ones every frame, the static ones once (every frame when !cached).
+    // finish waits for the GPU on both sides, so the time covers the shadow pass alone; otherwise it is submission only.
+    double Render(GeometryArena& arena, const std::vector<ShadowCaster>& dynamicCasters, bool cached, bool finish)
+    {
+        if (finish)
+            glFinish();
+        auto start = std::chrono::high_resolution_clock::now();
+        GLint previousFramebuffer = 0, previousViewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+        // one command list for every view of both layers, uploaded once
+        struct Pass {
+            int view, layer;
+            uint32_t first, count;
+        };
+        std::vector<Pass> passes;
+        bool drawStatic = staticDirty || !cached;
+        arena.BeginFrame();
+        uint32_t commands = 0;
+        for (int v = 0; v < VIEWS; v++) {
+            for (int layer = drawStatic ? 0 : 1; layer < 2; layer++) {
+                const std::vector<ShadowCaster>& casters = layer == 0 ? staticCasters : dynamicCasters;
+                uint32_t first = commands;
+                for (const ShadowCaster& caster : casters) {
+                    if ((v > 0 && !caster.pointLights) || views[v].frustum.Test(caster.bounds) == CULL_OUTSIDE)
+                        continue;
+                    arena.AddCommand(*caster.mesh, caster.firstIndex, caster.indexCount, caster.models, caster.instances);
+                    commands++;
+                }
+                // an empty static view is still cleared when the layer is built; an empty dynamic one only once
+                uint32_t count = commands - first;
+                if (layer == 1 && count == 0 && !views[v].dynamicDrawn)
+                    continue;
+                if (layer == 1)
+                    views[v].dynamicDrawn = count > 0;
+                passes.push_back(Pass{ v, layer, first, count });
+            }
+        }
+        arena.Upload();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glUseProgram(program);
+        glBindVertexArray(arena.VertexArray());
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.1f, 4.0f);
+        for (const Pass& pass : passes) {
+            if (pass.view == 0) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, dirMaps[pass.layer], 0);
+                glViewport(0, 0, settings.dirSize, settings.dirSize);
+            }
+            else {
+                int light = (pass.view - 1) / 6, face = (pass.view - 1) % 6;
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeMaps[pass.layer][light], 0);
+                glViewport(0, 0, settings.cubeSize, settings.cubeSize);
+            }
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glUniformMatrix4fv(lightViewProjection, 1, GL_FALSE, glm::value_ptr(views[pass.view].viewProjection));
+            arena.Draw(pass.first, pass.count);
+            if (pass.layer == 0)
+                stats.staticViews++;
+            else if (pass.count > 0)
+                stats.dynamicViews++;
+            else
+                stats.clearedViews++;
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        staticDirty = false;
+
+        if (finish)
+            glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        stats.frames++;
+        stats.commands += commands;
+        stats.ms += ms;
+        return ms;
+    }
+
+    // the static layers are redrawn by the next Render()
+    void Invalidate() { staticDirty = true; }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        for (int layer = 0; layer < 2; layer++) {
+            glDeleteTextures(1, &dirMaps[layer]);
+            glDeleteTextures(SHADOW_POINT_LIGHTS, cubeMaps[layer]);
+        }
+        fbo = 0;
+    }
+
+private:
+    static const int VIEWS = 1 + 6 * SHADOW_POINT_LIGHTS; // the directional map, then six faces per point light
+
+    struct View {
+        glm::mat4 viewProjection;
+        Frustum frustum;
+        bool dynamicDrawn = true; // the dynamic layer holds casters (or has never been cleared)
+    };
+    View views[VIEWS];
+    std::vector<ShadowCaster> staticCasters;
+    bool staticDirty = true;
+    float dirTexelWorld = 0.0f;
+    unsigned int program = 0, fbo = 0;
+    GLint lightViewProjection = -1;
+    unsigned int dirMaps[2] = { 0, 0 }, cubeMaps[2][SHADOW_POINT_LIGHTS] = {};
+
+    // depth texture for hardware comparison: texture() on a shadow sampler returns the filtered pass rate
+    static unsigned int CreateDepthTexture(GLenum target, int size)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        if (target == GL_TEXTURE_2D)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        else
+            for (int face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        if (target == GL_TEXTURE_2D) {
+            // outside the map is lit
+            float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+        }
+        else {
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(target, 0);
+        return texture;
+    }
+};
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Simulation thread
+// -----------------
+// The simulation advances in fixed ticks of 1/hz seconds, independent of how fast frames are drawn. Each
+// tick it publishes a snapshot holding the state at this tick and at the one before. The render thread
+// draws the state at (now - one tick), interpolated between the two, so motion stays smooth when frames
+// and ticks don't line up. Snapshots go through a triple buffer: the writer never waits for the reader,
+// and the reader always gets the newest complete snapshot without taking a lock.
+// If the simulation falls more than SIM_MAX_CATCH_UP ticks behind, it skips ahead instead of
+// trying to catch up, and reports the skipped ticks as dropped.
+// Fixed-clock runs step the same simulation inline on the render thread, up to each frame's time exactly,
+// so they render the same frames as always.
+
+const unsigned int SIM_MAX_CATCH_UP = 8;
+
+// seconds since Start() on the monotonic clock; one instance is shared, so times from both threads compare
+class SteadyClock
+{
+public:
+    void Start() { origin = std::chrono::steady_clock::now(); }
+    double Now() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count(); }
+
+private:
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+// the render loop's time and the length of the last frame (what camera movement is scaled by)
+struct FrameClock {
+    double time = 0.0;
+    float delta = 0.0f;
+
+    void Tick(double now)
+    {
+        delta = (float)(now - time);
+        time = now;
+    }
+};
+
+// spins for ms milliseconds: a stand-in for work, to load one thread without the other
+inline void BusyWait(double ms)
+{
+    if (ms <= 0.0)
+        return;
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(ms);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// Lock-free single-producer, single-consumer triple buffer. The writer fills Back() and calls Publish(),
+// which swaps its slot with the middle one. The reader's Update() swaps the middle slot with Front() when
+// something new was published. Each side owns its slot between calls. state holds the middle slot's index
+// plus a bit saying it is newer than what the reader has.
+template <typename T>
+class TripleBuffer
+{
+public:
+    T& Back() { return slots[back]; }
+
+    void Publish() { back = state.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // true when Front() changed
+    bool Update()
+    {
+        if (!(state.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = state.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& Front() const { return slots[front]; }
+
+    bool LockFree() const { return state.is_lock_free(); }
+
+private:
+    static const unsigned int INDEX = 3, FRESH = 4;
+    T slots[3];
+    unsigned int back = 0, front = 2;
+    std::atomic<unsigned int> state{ 1 };
+};
+
+// what one tick publishes: the state at the last two ticks (for gears, one angle per gear)
+struct SimSnapshot {
+    uint64_t tick = 0;            // ticks simulated; 0 is the initial state
+    double previousTime = 0.0, time = 0.0;
+    std::vector<float> previous, current;
+    double publishedAt = 0.0;     // SteadyClock time
+};
+
+// angles at time, interpolated the short way round between the snapshot's two ticks. Outside them it holds
+// the nearest tick rather than extrapolating, so a late simulation shows as a pause, never as overshoot.
+inline void InterpolateAngles(const SimSnapshot& snapshot, double time, std::vector<float>& out)
+{
+    if (time >= snapshot.time || snapshot.time <= snapshot.previousTime) {
+        out = snapshot.current;
+        return;
+    }
+    if (time <= snapshot.previousTime) {
+        out = snapshot.previous;
+        return;
+    }
+    const float PI = 3.14159265358979323846f, TWO_PI = 2.0f * PI;
+    float alpha = (float)((time - snapshot.previousTime) / (snapshot.time - snapshot.previousTime));
+    out.resize(snapshot.current.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        float a = snapshot.previous[i], d = snapshot.current[i] - a;
+        d -= TWO_PI * std::floor((d + PI) / TWO_PI);
+        out[i] = a + d * alpha;
+    }
+}
+
+class Simulation
+{
+public:
+    // state at time into out; called on the simulation thread, or inline by AdvanceTo
+    typedef std::function<void(double, std::vector<float>&)> StepFunction;
+
+    double hz = 120.0;
+    double loadMs = 0.0; // --sim-load: extra busy work per tick
+
+    ~Simulation() { Stop(); }
+
+    void Init(double ticksPerSecond, const StepFunction& stepFunction, const SteadyClock* steadyClock)
+    {
+        hz = ticksPerSecond;
+        step = stepFunction;
+        clock = steadyClock;
+        tick = 0;
+        step(0.0, current);
+        previous = current;
+        Publish(0.0);
+    }
+
+    // runs the ticks on their own thread until Stop()
+    void StartThread()
+    {
+        running = true;
+        thread = std::thread([this] { Run(); });
+    }
+
+    void Stop()
+    {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    bool Threaded() const { return thread.joinable(); }
+
+    // inline stepping: runs every tick up to and including the first at or after time
+    void AdvanceTo(double time)
+    {
+        while ((double)tick / hz < time)
+            Step(tick + 1);
+    }
+
+    // the newest published snapshot
+    const SimSnapshot& Latest()
+    {
+        snapshots.Update();
+        return snapshots.Front();
+    }
+
+    double TickSeconds() const { return 1.0 / hz; }
+
+    // ticks run and dropped, and time spent stepping, since the last ResetStats (safe to read from any thread)
+    uint64_t Ticks() const { return ticks.load(std::memory_order_relaxed); }
+    uint64_t Dropped() const { return dropped.load(std::memory_order_relaxed); }
+    double StepMs() const { return stepMicros.load(std::memory_order_relaxed) / 1000.0; }
+
+    void ResetStats()
+    {
+        ticks = 0;
+        dropped = 0;
+        stepMicros = 0;
+    }
+
+private:
+    StepFunction step;
+    const SteadyClock* clock = NULL;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    TripleBuffer<SimSnapshot> snapshots;
+    uint64_t tick = 0;                    // owned by whichever thread steps
+    double previousTime = 0.0;
+    std::vector<float> previous, current;
+    std::atomic<uint64_t> ticks{ 0 }, dropped{ 0 }, stepMicros{ 0 };
+
+    void Run()
+    {
+        while (running.load(std::memory_order_relaxed)) {
+            double now = clock->Now();
+            uint64_t due = (uint64_t)std::floor(now * hz); // the last tick whose time has come
+            if (due <= tick) {
+                std::this_thread::sleep_for(std::chrono::duration<double>((double)(tick + 1) / hz - now));
+                continue;
+            }
+            uint64_t next = tick + 1;
+            if (due - tick > SIM_MAX_CATCH_UP) {
+                dropped += due - SIM_MAX_CATCH_UP - tick;
+                next = due - SIM_MAX_CATCH_UP + 1;
+            }
+            Step(next);
+        }
+    }
+
+    // tick times are tick / hz, never a running sum, so inline stepping lands exactly on frame times
+    void Step(uint64_t next)
+    {
+        PROFILE_CPU("simulation tick");
+        auto start = std::chrono::steady_clock::now();
+        previousTime = (double)tick / hz;
+        tick = next;
+        std::swap(previous, current);
+        double time = (double)tick / hz;
+        step(time, current);
+        BusyWait(loadMs);
+        Publish(time);
+        ticks++;
+        stepMicros += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Publish(double time)
+    {
+        SimSnapshot& snapshot = snapshots.Back();
+        snapshot.tick = tick;
+        snapshot.previousTime = tick > 0 ? previousTime : time;
+        snapshot.time = time;
+        snapshot.previous = previous;
+        snapshot.current = current;
+        snapshot.publishedAt = clock->Now();
+        snapshots.Publish();
+    }
+};
+
+// render and simulation rates over the same stretch of wall-clock time, and how old the drawn state was
+struct SimulationStats {
+    size_t frames = 0, framesAhead = 0; // framesAhead: frames drawn past the newest tick
+    double ageMs = 0.0, maxAgeMs = 0.0; // from a snapshot's publication to the frame that drew it
+    double start = 0.0;
+
+    void Frame(const SimSnapshot& snapshot, double renderTime, double now)
+    {
+        double age = 1000.0 * (now - snapshot.publishedAt);
+        frames++;
+        framesAhead += renderTime > snapshot.time;
+        ageMs += age;
+        maxAgeMs = std::max(maxAgeMs, age);
+    }
+
+    void Print(const char* label, const Simulation& simulation, double now) const
+    {
+        double seconds = std::max(now - start, 1e-9);
+        size_t n = std::max<size_t>(frames, 1);
+        uint64_t ticks = std::max<uint64_t>(simulation.Ticks(), 1);
+        std::printf("%s: %s at %.0f Hz | simulation %.1f ticks/s, %.3f ms per tick, %llu dropped | render %.1f frames/s"
+                    " | snapshot age avg %.2f ms, max %.2f ms | %zu frames ahead of the simulation\n", label,
+            simulation.Threaded() ? "threaded" : "inline", simulation.hz, simulation.Ticks() / seconds, simulation.StepMs() / ticks,
+            (unsigned long long)simulation.Dropped(), frames / seconds, ageMs / n, maxAgeMs, framesAhead);
+    }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef STAR_IRRADIANCE_H
+#define STAR_IRRADIANCE_H
+
+#include <glm/glm.hpp>
+
+#include "starfield.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <vector>
+
+// Starlight as a 9-coefficient (order 2) spherical-harmonics irradiance term.
+// The stars are far away compared to the gears, so each one is treated as a directional light from
+// its position as seen from the origin. Projecting them onto SH once and folding in the clamped-cosine
+// convolution (Ramamoorthi & Hanrahan) turns "sum over every star of color * max(dot(n, l), 0)" into
+// nine multiply-adds per fragment, independent of the star count.
+struct StarlightSH {
+    glm::vec3 coeffs[9];
+};
+
+// real SH basis up to l = 2 for a unit direction
+inline void ShBasis9(const glm::vec3& n, float out[9])
+{
+    out[0] = 0.282095f;
+    out[1] = 0.488603f * n.y;
+    out[2] = 0.488603f * n.z;
+    out[3] = 0.488603f * n.x;
+    out[4] = 1.092548f * n.x * n.y;
+    out[5] = 1.092548f * n.y * n.z;
+    out[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+    out[7] = 1.092548f * n.x * n.z;
+    out[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+}
+
+// intensity is the average irradiance the whole starfield adds to a surface, so the ambient level
+// stays the same no matter how many stars there are (each star gets 4 * intensity / count)
+inline StarlightSH ProjectStarlight(const std::vector<Star>& stars, float intensity, ThreadPool* pool = nullptr)
+{
+    StarlightSH sh = {};
+    if (stars.empty())
+        return sh;
+
+    // clamped-cosine kernel per band, times the per-star weight
+    const float PI = 3.14159265358979323846f;
+    const float weight = 4.0f * intensity / (float)stars.size();
+    const float band[9] = { PI, 2.0f * PI / 3.0f, 2.0f * PI / 3.0f, 2.0f * PI / 3.0f,
+                            PI / 4.0f, PI / 4.0f, PI / 4.0f, PI / 4.0f, PI / 4.0f };
+
+    // one partial sum per STAR_CHUNK stars, added up in chunk order afterwards, so the float rounding
+    // (and the golden images) does not depend on the thread count or which chunk finished first
+    const size_t chunks = (stars.size() + STAR_CHUNK - 1) / STAR_CHUNK;
+    std::vector<StarlightSH> partials(chunks, StarlightSH{});
+    auto project = [&](size_t firstChunk, size_t lastChunk) {
+        float basis[9];
+        for (size_t chunk = firstChunk; chunk < lastChunk; chunk++) {
+            glm::vec3* partial = partials[chunk].coeffs;
+            size_t end = std::min(stars.size(), (chunk + 1) * STAR_CHUNK);
+            for (size_t i = chunk * STAR_CHUNK; i < end; i++) {
+                ShBasis9(glm::normalize(stars[i].position), basis);
+                for (int k = 0; k < 9; k++)
+                    partial[k] += stars[i].color * basis[k];
+            }
+        }
+    };
+    if (pool)
+        pool->ParallelFor(chunks, project);
+    else
+        project(0, chunks);
+    for (const StarlightSH& partial : partials)
+        for (int k = 0; k < 9; k++)
+            sh.coeffs[k] += partial.coeffs[k];
+
+    for (int k = 0; k < 9; k++)
+        sh.coeffs[k] *= band[k] * weight;
+    return sh;
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef STARFIELD_H
+#define STARFIELD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+struct Star {
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+// HSV (all components 0..1) to RGB
+inline glm::vec3 HsvToRgb(float hue, float s, float v)
+{
+    float c = v * s;
+    float d = c * (1 - std::fabs(std::fmod(hue * 6.0f, 2.0f) - 1));
+    float m = v - c;
+
+    float r, g, b;
+    if (hue < 1.0 / 6.0) { r = c; g = d; b = 0; }
+    else if (hue < 2.0 / 6.0) { r = d; g = c; b = 0; }
+    else if (hue < 3.0 / 6.0) { r = 0; g = c; b = d; }
+    else if (hue < 4.0 / 6.0) { r = 0; g = d; b = c; }
+    else if (hue < 5.0 / 6.0) { r = d; g = 0; b = c; }
+    else { r = c; g = 0; b = d; }
+
+    return glm::vec3(r + m, g + m, b + m);
+}
+
+// Stars are generated in fixed-size chunks, each with its own generator seeded from (seed, chunk),
+// so the result depends only on the seed and count, never on how many threads ran it.
+const size_t STAR_CHUNK = 16384;
+
+inline uint32_t StarChunkSeed(uint32_t seed, uint64_t chunk)
+{
+    // splitmix64 finalizer: neighbouring chunks get unrelated streams
+    uint64_t z = ((uint64_t)seed << 32) + chunk + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)(z ^ (z >> 31));
+}
+
+// stars uniformly distributed on a sphere of the given radius around the origin, each with a random bright hue
+inline std::vector<Star> GenerateStars(size_t count, float radius = 30.0f, uint32_t seed = 1, ThreadPool* pool = nullptr)
+{
+    const float TWO_PI = 6.28318530717958647692f;
+    std::vector<Star> stars(count);
+    auto generate = [&](size_t firstChunk, size_t lastChunk) {
+        for (size_t chunk = firstChunk; chunk < lastChunk; chunk++) {
+            std::mt19937 rng(StarChunkSeed(seed, chunk));
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            size_t end = std::min(count, (chunk + 1) * STAR_CHUNK);
+            for (size_t i = chunk * STAR_CHUNK; i < end; i++) {
+                // uniform in height and azimuth is uniform in area on a sphere (Archimedes), so no clumping at the poles
+                float y = 1.0f - 2.0f * unit(rng);
+                float azimuth = TWO_PI * unit(rng);
+                float ring = std::sqrt(std::max(0.0f, 1.0f - y * y));
+                stars[i].position = radius * glm::vec3(ring * std::cos(azimuth), y, ring * std::sin(azimuth));
+
+                // random star color but still bright
+                stars[i].color = HsvToRgb(unit(rng), 0.8f, 1.0f);
+            }
+        }
+    };
+    size_t chunks = (count + STAR_CHUNK - 1) / STAR_CHUNK;
+    if (pool)
+        pool->ParallelFor(chunks, generate);
+    else
+        generate(0, chunks);
+    return stars;
+}
+
+// A patch of sky: stars [first, first + count) of the reordered array and their bounds, culled as one object
+struct StarCell {
+    size_t first = 0, count = 0;
+    Aabb bounds;
+};
+
+// Reorders stars by direction into cellsPerFace x cellsPerFace cells on each face of a cube around the
+// origin. The order is stable within a cell. Rows run back and forth across each face, so neighbouring
+// cells are usually neighbours in the buffer and the visible ones merge into a few contiguous ranges.
+inline std::vector<StarCell> SortStarsIntoCells(std::vector<Star>& stars, unsigned int cellsPerFace = 4)
+{
+    const unsigned int n = std::max(1u, cellsPerFace), cellCount = 6 * n * n;
+    auto cellOf = [n](const glm::vec3& p) {
+        glm::vec3 a = glm::abs(p);
+        int axis = a.x >= a.y && a.x >= a.z ? 0 : a.y >= a.z ? 1 : 2;
+        unsigned int face = axis * 2 + (p[axis] < 0.0f ? 1 : 0);
+        float major = std::max(a[axis], 1e-20f);
+        float u = p[(axis + 1) % 3] / major, v = p[(axis + 2) % 3] / major; // both in [-1, 1]
+        unsigned int x = std::min(n - 1, (unsigned int)((u * 0.5f + 0.5f) * n));
+        unsigned int y = std::min(n - 1, (unsigned int)((v * 0.5f + 0.5f) * n));
+        return (face * n + y) * n + (y % 2 ? n - 1 - x : x);
+    };
+
+    // counting sort by cell
+    std::vector<uint32_t> cellIndex(stars.size());
+    std::vector<StarCell> cells(cellCount);
+    for (size_t i = 0; i < stars.size(); i++) {
+        cellIndex[i] = cellOf(stars[i].position);
+        cells[cellIndex[i]].count++;
+    }
+    for (unsigned int c = 1; c < cellCount; c++)
+        cells[c].first = cells[c - 1].first + cells[c - 1].count;
+    std::vector<size_t> fill(cellCount);
+    for (unsigned int c = 0; c < cellCount; c++)
+        fill[c] = cells[c].first;
+    std::vector<Star> sorted(stars.size());
+    for (size_t i = 0; i < stars.size(); i++) {
+        sorted[fill[cellIndex[i]]++] = stars[i];
+        cells[cellIndex[i]].bounds.Add(stars[i].position);
+    }
+    stars.swap(sorted);
+    return cells;
+}
+
+// every star in one vertex buffer (position + color), drawn as point sprites: all at once with Draw(), or
+// as the ranges of the StarCells that survive culling
+class StarfieldMesh
+{
+public:
+    unsigned int vao = 0, vbo = 0;
+    size_t count = 0;
+
+    void Upload(const std::vector<Star>& stars)
+    {
+        if (!vao) {
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+        }
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(Star), stars.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Star), (void*)offsetof(Star, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Star), (void*)offsetof(Star, color));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        count = stars.size();
+    }
+
+    void Draw() const
+    {
+        glBindVertexArray(vao);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)count);
+    }
+
+    void Destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        vao = vbo = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Cooked textures
+// ---------------
+// A source image cooked once into <source>.gtex: a fixed header followed by every mip level, already
+// filtered, as tightly packed 8-bit rows in the order stb_image returns them, so cooked and decoded
+// textures upload identically. Later runs map the file and copy levels straight out of the mapping:
+// no decode, no mip generation. The header keeps a hash of the source file's bytes, so editing the
+// source invalidates its cooked copy on the next load.
+//
+// Layout (native byte order, the cache is never shared between machines):
+//   CookedTextureHeader, then the levels at the offsets it lists, each 16-byte aligned.
+
+const char COOKED_TEXTURE_MAGIC[4] = { 'G', 'T', 'E', 'X' };
+const uint32_t COOKED_TEXTURE_VERSION = 1;
+const int COOKED_TEXTURE_MAX_LEVELS = 16; // up to 32768 x 32768
+
+struct CookedTextureHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t width, height, channels, levels;
+    uint64_t levelOffset[COOKED_TEXTURE_MAX_LEVELS];
+    uint64_t levelSize[COOKED_TEXTURE_MAX_LEVELS];
+};
+
+inline int MipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+inline std::string CookedTexturePath(const std::string& source)
+{
+    return source + ".gtex";
+}
+
+// read-only view of a whole file; unmapped on destruction
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            Close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file alive
+        data = p == MAP_FAILED ? NULL : (const unsigned char*)p;
+        size = (size_t)st.st_size;
+#endif
+        if (!data) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap((void*)data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char* data = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+// 64-bit FNV-1a of a whole file; false when it cannot be read
+inline bool HashFile(const std::string& path, uint64_t& hash)
+{
+    MappedFile file;
+    if (!file.Open(path))
+        return false;
+    hash = 14695981039346656037ull;
+    const unsigned char* p = file.Data();
+    for (size_t i = 0; i < file.Size(); i++)
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    return true;
+}
+
+// a mapped cooked texture, valid only when its header matches the expected source hash
+struct CookedTexture {
+    MappedFile file;
+    const CookedTextureHeader* header = NULL;
+
+    bool Open(const std::string& path, uint64_t sourceHash)
+    {
+        header = NULL;
+        if (!file.Open(path) || file.Size() < sizeof(CookedTextureHeader))
+            return false;
+        const CookedTextureHeader* h = (const CookedTextureHeader*)file.Data();
+        if (std::memcmp(h->magic, COOKED_TEXTURE_MAGIC, 4) != 0 || h->version != COOKED_TEXTURE_VERSION
+            || h->sourceHash != sourceHash)
+            return false;
+
+        // the loader copies w * h * channels bytes per level straight out of the mapping, so every size
+        // in the header has to agree with the others before anything indexes it
+        const uint32_t maxSide = 1u << COOKED_TEXTURE_MAX_LEVELS; // the writer never cooks more levels
+        if (h->width == 0 || h->height == 0 || h->width >= maxSide || h->height >= maxSide
+            || (h->channels != 1 && h->channels != 3 && h->channels != 4)
+            || h->levels == 0 || h->levels > (uint32_t)MipLevelCount((int)h->width, (int)h->height))
+            return false;
+        for (uint32_t level = 0; level < h->levels; level++) {
+            uint64_t w = std::max(1u, h->width >> level), ht = std::max(1u, h->height >> level);
+            if (h->levelSize[level] != w * ht * h->channels || h->levelOffset[level] > file.Size()
+                || h->levelSize[level] > file.Size() - h->levelOffset[level])
+                return false; // truncated or corrupt
+        }
+        header = h;
+        return true;
+    }
+
+    const unsigned char* Level(int level) const { return file.Data() + header->levelOffset[level]; }
+};
+
+// writes levels (level 0 first) to path, through a temporary file so a crash never leaves half a cache behind
+inline bool WriteCookedTexture(const std::string& path, uint64_t sourceHash, int width, int height, int channels,
+    const std::vector<const unsigned char*>& levels, const std::vector<size_t>& levelSizes)
+{
+    if (levels.empty() || levels.size() > (size_t)COOKED_TEXTURE_MAX_LEVELS)
+        return false;
+    CookedTextureHeader header = {};
+    std::memcpy(header.magic, COOKED_TEXTURE_MAGIC, 4);
+    header.version = COOKED_TEXTURE_VERSION;
+    header.sourceHash = sourceHash;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.channels = (uint32_t)channels;
+    header.levels = (uint32_t)levels.size();
+    uint64_t offset = (sizeof(header) + 15) & ~15ull;
+    for (size_t level = 0; level < levels.size(); level++) {
+        header.levelOffset[level] = offset;
+        header.levelSize[level] = levelSizes[level];
+        offset = (offset + levelSizes[level] + 15) & ~15ull;
+    }
+
+    std::string temp = path + ".tmp";
+    FILE* file = std::fopen(temp.c_str(), "wb");
+    if (!file)
+        return false;
+    static const unsigned char zeros[16] = {};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    for (size_t level = 0; ok && level < levels.size(); level++) {
+        ok = std::fwrite(zeros, 1, (size_t)(header.levelOffset[level] - written), file) == header.levelOffset[level] - written
+          && std::fwrite(levels[level], 1, levelSizes[level], file) == levelSizes[level];
+        written = header.levelOffset[level] + levelSizes[level];
+    }
+    ok = std::fclose(file) == 0 && ok;
+    std::remove(path.c_str()); // rename does not replace an existing file everywhere
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,431 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asynchronous textures
+// ---------------------
+// Worker threads decode each image and build its whole mip chain on the CPU, so the render thread never
+// waits on stbi_load or glGenerateMipmap. A decoded image is cooked into <source>.gtex on the way
+// (texture_cache.h); later runs map that file instead and skip decoding and filtering entirely. Once per frame Update() streams finished
+// levels into GL through a pixel unpack buffer, at most bytesPerFrame per frame, splitting large levels
+// by rows. Until every level of a texture is in, Texture() returns a 1x1 placeholder of the colour given
+// to Load(), so a frame never samples an incomplete texture.
+
+// one image and its mip chain, filled in on a worker thread: either decoded and filtered here
+// (pixels owns the levels) or mapped from the cooked cache (cooked owns them)
+struct DecodedImage {
+    int width = 0, height = 0, channels = 0;
+    std::vector<const unsigned char*> levels; // level 0 first, tightly packed rows
+    std::vector<std::vector<unsigned char>> pixels;
+    CookedTexture cooked;
+    bool fromCache = false;
+    double hashMs = 0.0, decodeMs = 0.0, mipMs = 0.0, cookMs = 0.0;
+};
+
+// next level down with a separable [1 3 3 1] / 8 kernel: the 4-tap filter a half-resolution bilinear
+// resample needs, which keeps fine detail from aliasing the way a 2x2 box lets it (edges clamp)
+inline std::vector<unsigned char> DownsampleLevel(const std::vector<unsigned char>& src, int w, int h, int channels)
+{
+    const int weights[4] = { 1, 3, 3, 1 };
+    int dw = std::max(1, w / 2), dh = std::max(1, h / 2);
+
+    // horizontal pass into 16-bit sums (at most 8 * 255), then vertical
+    std::vector<unsigned short> rows((size_t)dw * h * channels);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < dw; x++)
+            for (int c = 0; c < channels; c++) {
+                int sum = 0;
+                for (int k = 0; k < 4; k++) {
+                    int sx = glm::clamp(2 * x - 1 + k, 0, w - 1);
+                    sum += weights[k] * src[((size_t)y * w + sx) * channels + c];
+                }
+                rows[((size_t)y * dw + x) * channels + c] = (unsigned short)sum;
+            }
+
+    std::vector<unsigned char> dst((size_t)dw * dh * channels);
+    for (int y = 0; y < dh; y++)
+        for (int x = 0; x < dw; x++)
+            for (int c = 0; c < channels; c++) {
+                int sum = 0;
+                for (int k = 0; k < 4; k++) {
+                    int sy = glm::clamp(2 * y - 1 + k, 0, h - 1);
+                    sum += weights[k] * rows[((size_t)sy * dw + x) * channels + c];
+                }
+                dst[((size_t)y * dw + x) * channels + c] = (unsigned char)((sum + 32) / 64);
+            }
+    return dst;
+}
+
+inline GLenum TextureFormat(int channels)
+{
+    if (channels == 1)
+        return GL_RED;
+    if (channels == 4)
+        return GL_RGBA;
+    return GL_RGB;
+}
+
+inline double MsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// the source image with its full mip chain: mapped from a cooked copy whose hash matches the source,
+// otherwise decoded, filtered and (with useCache) cooked for next time. Null when the source is unreadable.
+inline std::unique_ptr<DecodedImage> LoadTextureImage(const std::string& path, bool useCache)
+{
+    std::unique_ptr<DecodedImage> image(new DecodedImage);
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t sourceHash = 0;
+    bool hashed = useCache && HashFile(path, sourceHash);
+    image->hashMs = MsSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    if (hashed && image->cooked.Open(CookedTexturePath(path), sourceHash)) {
+        const CookedTextureHeader& h = *image->cooked.header;
+        image->width = (int)h.width;
+        image->height = (int)h.height;
+        image->channels = (int)h.channels;
+        for (uint32_t level = 0; level < h.levels; level++)
+            image->levels.push_back(image->cooked.Level(level));
+        image->fromCache = true;
+        image->decodeMs = MsSince(start);
+        return image;
+    }
+
+    int width, height, channels;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+    if (!data)
+        return nullptr;
+    image->width = width;
+    image->height = height;
+    image->channels = channels == 2 ? 4 : channels;
+    image->pixels.resize(MipLevelCount(width, height));
+    if (channels == 2) {
+        // grey + alpha has no GL 3.3 unsized format that samples the same way; widen it to RGBA
+        image->pixels[0].resize((size_t)width * height * 4);
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            unsigned char* p = &image->pixels[0][i * 4];
+            p[0] = p[1] = p[2] = data[i * 2];
+            p[3] = data[i * 2 + 1];
+        }
+    }
+    else
+        image->pixels[0].assign(data, data + (size_t)width * height * channels);
+    stbi_image_free(data);
+    image->decodeMs = MsSince(start);
+
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t level = 1; level < image->pixels.size(); level++)
+        image->pixels[level] = DownsampleLevel(image->pixels[level - 1], std::max(1, width >> (level - 1)),
+            std::max(1, height >> (level - 1)), image->channels);
+    std::vector<size_t> levelSizes;
+    for (const std::vector<unsigned char>& level : image->pixels) {
+        image->levels.push_back(level.data());
+        levelSizes.push_back(level.size());
+    }
+    image->mipMs = MsSince(start);
+
+    if (hashed) {
+        start = std::chrono::high_resolution_clock::now();
+        if (!WriteCookedTexture(CookedTexturePath(path), sourceHash, width, height, image->channels, image->levels, levelSizes))
+            std::printf("Could not write cooked texture %s\n", CookedTexturePath(path).c_str());
+        image->cookMs = MsSince(start);
+    }
+    return image;
+}
+
+// --cook-textures: cooks every image in a directory ahead of time, so even the first run maps instead of decoding
+inline void CookTextureDirectory(const std::string& directory)
+{
+    namespace fs = std::filesystem;
+    std::error_code error;
+    unsigned int cooked = 0, upToDate = 0, failed = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, error)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (!entry.is_regular_file() || (extension != ".png" && extension != ".jpg" && extension != ".jpeg"
+            && extension != ".tga" && extension != ".bmp"))
+            continue;
+        std::unique_ptr<DecodedImage> image = LoadTextureImage(entry.path().string(), true);
+        if (!image) {
+            std::printf("%-48s failed to decode\n", entry.path().filename().string().c_str());
+            failed++;
+        }
+        else if (image->fromCache) {
+            std::printf("%-48s up to date (hash %.1f ms)\n", entry.path().filename().string().c_str(), image->hashMs);
+            upToDate++;
+        }
+        else {
+            std::printf("%-48s %5dx%-5d %2zu levels | decode %7.1f ms, mips %6.1f ms, write %6.1f ms\n",
+                entry.path().filename().string().c_str(), image->width, image->height, image->levels.size(),
+                image->decodeMs, image->mipMs, image->cookMs);
+            cooked++;
+        }
+    }
+    if (error)
+        std::printf("Cannot read %s: %s\n", directory.c_str(), error.message().c_str());
+    std::printf("cooked %u, up to date %u, failed %u in %.1f ms\n", cooked, upToDate, failed, MsSince(start));
+}
+
+class AsyncTextureLoader
+{
+public:
+    size_t bytesPerFrame = 4 << 20; // upload budget per Update()
+    bool useCache = true;           // map and write cooked .gtex files; set before the first Load()
+
+    // threads decode in the background; the render thread is never one of them
+    explicit AsyncTextureLoader(unsigned int threads = 2)
+    {
+        for (unsigned int i = 0; i < std::max(1u, threads); i++)
+            workers.emplace_back([this] { WorkerLoop(); });
+    }
+
+    ~AsyncTextureLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers)
+            t.join();
+    }
+
+    AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+    AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+    // queues path for decoding and returns its handle; placeholder is the RGB colour shown until it is resident
+    int Load(const std::string& path, glm::vec3 placeholder)
+    {
+        Entry entry;
+        entry.path = path;
+        entry.requested = std::chrono::high_resolution_clock::now();
+        unsigned char texel[4] = { (unsigned char)(glm::clamp(placeholder.r, 0.0f, 1.0f) * 255.0f + 0.5f),
+                                   (unsigned char)(glm::clamp(placeholder.g, 0.0f, 1.0f) * 255.0f + 0.5f),
+                                   (unsigned char)(glm::clamp(placeholder.b, 0.0f, 1.0f) * 255.0f + 0.5f), 255 };
+        glGenTextures(1, &entry.placeholder);
+        glBindTexture(GL_TEXTURE_2D, entry.placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        entries.push_back(entry);
+
+        int handle = (int)entries.size() - 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decodeQueue.push_back({ handle, path });
+        }
+        wake.notify_one();
+        return handle;
+    }
+
+    // the texture to bind this frame: the real one once all its levels are uploaded, the placeholder before
+    unsigned int Texture(int handle) const
+    {
+        const Entry& e = entries[handle];
+        return e.resident ? e.texture : e.placeholder;
+    }
+
+    bool Resident(int handle) const { return entries[handle].resident; }
+    bool Done() const { return completed == entries.size(); }
+
+    // streams up to bytesPerFrame of finished levels into GL; returns true on the call that completes the last texture
+    bool Update()
+    {
+        if (Done())
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!decoded.empty()) {
+                uploads.push_back(std::move(decoded.front()));
+                decoded.pop_front();
+            }
+        }
+
+        size_t budget = bytesPerFrame;
+        while (budget > 0 && !uploads.empty()) {
+            Upload& u = uploads.front();
+            Entry& e = entries[u.handle];
+            if (!u.image) {
+                std::printf("Texture failed to load at path: %s\n", e.path.c_str());
+                completed++;
+                uploads.pop_front();
+                continue;
+            }
+            const DecodedImage& image = *u.image;
+            const GLenum format = TextureFormat(image.channels);
+            if (e.texture == 0) {
+                e.texture = CreateStorage(image, format);
+                e.firstUploadFrame = frame;
+            }
+
+            int w = std::max(1, image.width >> u.level), h = std::max(1, image.height >> u.level);
+            size_t rowBytes = (size_t)w * image.channels;
+            int rows = (int)std::min((size_t)(h - u.row), std::max((size_t)1, budget / rowBytes));
+            size_t bytes = rows * rowBytes;
+
+            // orphan the previous slice's storage so this copy never waits for the GPU to finish reading it
+            if (pbo == 0)
+                glGenBuffers(1, &pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            std::memcpy(dst, image.levels[u.level] + u.row * rowBytes, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            glBindTexture(GL_TEXTURE_2D, e.texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, u.level, 0, u.row, w, rows, format, GL_UNSIGNED_BYTE, (void*)0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            budget -= std::min(budget, bytes);
+            e.uploadedBytes += bytes;
+            e.uploadFrames = frame - e.firstUploadFrame + 1;
+            u.row += rows;
+            if (u.row == h) {
+                u.row = 0;
+                u.level++;
+            }
+            if (u.level == (int)image.levels.size()) {
+                e.resident = true;
+                if (image.fromCache)
+                    std::printf("texture: %s %dx%d, %zu levels | cached: hash %.1f ms, mapped %.1f ms (worker)",
+                        e.path.c_str(), image.width, image.height, image.levels.size(), image.hashMs, image.decodeMs);
+                else
+                    std::printf("texture: %s %dx%d, %zu levels | hash %.1f ms, decode %.1f ms, mips %.1f ms, cook %.1f ms (worker)",
+                        e.path.c_str(), image.width, image.height, image.levels.size(), image.hashMs, image.decodeMs, image.mipMs, image.cookMs);
+                std::printf(" | %zu KB uploaded over %u frames | resident %.1f ms after Load\n",
+                    e.uploadedBytes / 1024, e.uploadFrames,
+                    MsSince(e.requested));
+                completed++;
+                uploads.pop_front();
+            }
+        }
+        frame++;
+        return Done();
+    }
+
+    // blocks until every queued texture is resident (golden-image runs want the real textures from frame 0)
+    void Finish()
+    {
+        size_t budget = bytesPerFrame;
+        bytesPerFrame = (size_t)-1;
+        while (!Done()) {
+            bool waiting;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                waiting = decoded.empty() && uploads.empty();
+            }
+            if (waiting)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            Update();
+        }
+        bytesPerFrame = budget;
+    }
+
+    void Destroy()
+    {
+        for (Entry& e : entries) {
+            glDeleteTextures(1, &e.placeholder);
+            glDeleteTextures(1, &e.texture);
+            e.placeholder = e.texture = 0;
+        }
+        glDeleteBuffers(1, &pbo);
+        pbo = 0;
+    }
+
+private:
+    struct Entry {
+        std::string path;
+        unsigned int placeholder = 0, texture = 0;
+        bool resident = false;
+        size_t uploadedBytes = 0;
+        unsigned int firstUploadFrame = 0, uploadFrames = 0;
+        std::chrono::high_resolution_clock::time_point requested;
+    };
+    struct DecodeJob {
+        int handle;
+        std::string path;
+    };
+    struct Upload {
+        int handle;
+        std::unique_ptr<DecodedImage> image; // null when decoding failed
+        int level = 0, row = 0;              // next rows to upload
+    };
+
+    // render thread only
+    std::vector<Entry> entries;
+    std::deque<Upload> uploads;
+    unsigned int pbo = 0;
+    unsigned int frame = 0;
+    size_t completed = 0; // resident or failed
+
+    // shared with the workers
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<DecodeJob> decodeQueue;
+    std::deque<Upload> decoded;
+    bool stopping = false;
+
+    // every level allocated up front (GL 3.3 has no glTexStorage), filled in by later slices
+    unsigned int CreateStorage(const DecodedImage& image, GLenum format)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (size_t level = 0; level < image.levels.size(); level++)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, format, std::max(1, image.width >> level), std::max(1, image.height >> level),
+                0, format, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return texture;
+    }
+
+    void WorkerLoop()
+    {
+        for (;;) {
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !decodeQueue.empty(); });
+                if (stopping)
+                    return;
+                job = decodeQueue.front();
+                decodeQueue.pop_front();
+            }
+            Upload result;
+            result.handle = job.handle;
+            result.image = LoadTextureImage(job.path, useCache);
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(result));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. ParallelFor splits [0, count) into
+// chunks that the workers and the calling thread pull from a shared counter; it returns once
+// every chunk has run. One loop runs at a time; concurrent callers are serialized.
+class ThreadPool
+{
+public:
+    // threads counts the calling thread, so ThreadPool(1) runs everything inline
+    explicit ThreadPool(unsigned int threads = std::thread::hardware_concurrency())
+    {
+        if (threads == 0)
+            threads = 1;
+        for (unsigned int i = 1; i < threads; i++)
+            workers.emplace_back([this] { WorkerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int Size() const { return (unsigned int)workers.size() + 1; }
+
+    // fn(begin, end) is called for disjoint ranges covering [0, count); minChunk bounds the split
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& fn, size_t minChunk = 1)
+    {
+        if (count == 0)
+            return;
+        if (workers.empty() || count <= minChunk) {
+            fn(0, count);
+            return;
+        }
+
+        std::lock_guard<std::mutex> jobLock(jobMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            jobChunk = std::max(minChunk, (count + Size() * 4 - 1) / (Size() * 4));
+            next.store(0);
+            pending = (unsigned int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        RunChunks(fn, count, jobChunk);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex jobMutex;                  // serializes ParallelFor callers
+    std::mutex mutex;                     // guards the job description below
+    std::condition_variable wake, done;
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t jobCount = 0, jobChunk = 1;
+    std::atomic<size_t> next{0};
+    unsigned int pending = 0;
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    void RunChunks(const std::function<void(size_t, size_t)>& fn, size_t count, size_t chunk)
+    {
+        for (;;) {
+            size_t begin = next.fetch_add(chunk);
+            if (begin >= count)
+                break;
+            PROFILE_CPU("parallel chunk");
+            fn(begin, std::min(begin + chunk, count));
+        }
+    }
+
+    void WorkerLoop()
+    {
+        unsigned long long seen = 0;
+        for (;;) {
+            const std::function<void(size_t, size_t)>* fn;
+            size_t count, chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                fn = job;
+                count = jobCount;
+                chunk = jobChunk;
+            }
+            RunChunks(*fn, count, chunk);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+            done.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Shader::set*(name, ...) resolves the name with glGetUniformLocation on every call.
+// The render loop instead looks locations up once after linking and writes through them.
+inline GLint UniformLocation(unsigned int program, const char* name)
+{
+    return glGetUniformLocation(program, name);
+}
+
+inline void SetUniform(GLint location, bool value)             { glUniform1i(location, (int)value); }
+inline void SetUniform(GLint location, int value)              { glUniform1i(location, value); }
+inline void SetUniform(GLint location, float value)            { glUniform1f(location, value); }
+inline void SetUniform(GLint location, const glm::vec2& value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::uvec3& value) { glUniform3ui(location, value.x, value.y, value.z); }
+inline void SetUniform(GLint location, const glm::vec3& value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::vec4& value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+inline void SetUniform(GLint location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+// uniforms of 6.multiple_lights.vs/.fs outside the LightRig block
+struct LightingUniforms {
+    GLint model, view, projection, instanced;
+    GLint viewPos, shininess;
+    GLint clustered, clusterDims, clusterTileSize, clusterDepthParams;
+    GLint starlightSH;
+    GLint shadows, shadowPcf;
+
+    void Resolve(unsigned int program)
+    {
+        model      = UniformLocation(program, "model");
+        view       = UniformLocation(program, "view");
+        projection = UniformLocation(program, "projection");
+        instanced  = UniformLocation(program, "instanced");
+        viewPos    = UniformLocation(program, "viewPos");
+        shininess  = UniformLocation(program, "material.shininess");
+        clustered          = UniformLocation(program, "clustered");
+        clusterDims        = UniformLocation(program, "clusterDims");
+        clusterTileSize    = UniformLocation(program, "clusterTileSize");
+        clusterDepthParams = UniformLocation(program, "clusterDepthParams");
+        starlightSH        = UniformLocation(program, "starlightSH");
+        shadows            = UniformLocation(program, "shadows");
+        shadowPcf          = UniformLocation(program, "shadowPcf");
+    }
+};
+
+// uniforms of 6.light_cube.vs/.fs
+struct LightCubeUniforms {
+    GLint model, view, projection;
+    GLint instanced, pointSprites, pointSize, pointScale;
+
+    void Resolve(unsigned int program)
+    {
+        model        = UniformLocation(program, "model");
+        view         = UniformLocation(program, "view");
+        projection   = UniformLocation(program, "projection");
+        instanced    = UniformLocation(program, "instanced");
+        pointSprites = UniformLocation(program, "pointSprites");
+        pointSize    = UniformLocation(program, "pointSize");
+        pointScale   = UniformLocation(program, "pointScale");
+    }
+};
+
+#endif
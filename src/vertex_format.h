@@ -0,0 +1,140 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Vertex formats
+// --------------
+// The mesh builders all emit the same fat layout, 8 floats per vertex. The arena can store it as is or
+// encode it on upload:
+//   VERTEX_FLOAT    float3 position, float3 normal, float2 uv                        32 bytes
+//   VERTEX_PACKED   float3 position, normal as GL_INT_2_10_10_10_REV, uv as half2    20 bytes
+//   VERTEX_SNORM16  position as snorm16 (x, y, z, pad) scaled by the mesh's largest
+//                   coordinate, normal and uv as VERTEX_PACKED                       16 bytes
+// snorm16 positions leave a per-mesh scale (ArenaMesh::positionScale) that the arena folds into each
+// instance's model matrix, so the shaders read every format the same way. The normal matrix is built from
+// that same matrix, and the fragment shader renormalizes, so the quantized normals need no special care.
+
+enum VertexFormat { VERTEX_FLOAT, VERTEX_PACKED, VERTEX_SNORM16, VERTEX_FORMATS };
+const char* const VERTEX_FORMAT_NAMES[VERTEX_FORMATS] = { "float", "packed", "snorm16" };
+
+const unsigned int FAT_VERTEX_FLOATS = 8; // pos(3) + normal(3) + uv(2), what every mesh builder writes
+
+inline size_t VertexStride(VertexFormat format)
+{
+    switch (format) {
+    case VERTEX_PACKED:  return 12 + 4 + 4;
+    case VERTEX_SNORM16: return 8 + 4 + 4;
+    default:             return FAT_VERTEX_FLOATS * sizeof(float);
+    }
+}
+
+// IEEE half, round to nearest even; no NaN payloads, which UVs never carry
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7C00u); // overflow to infinity
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u; // subnormal: shift the implicit bit in
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half++; // may carry into the exponent, which is still the correctly rounded result
+    return (uint16_t)half;
+}
+
+// signed normalized integer with `bits` bits, decoded by GL as max(c / (2^(bits-1) - 1), -1)
+inline int32_t ToSnorm(float value, int bits)
+{
+    float scale = (float)((1 << (bits - 1)) - 1);
+    return (int32_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * scale);
+}
+
+inline uint32_t PackNormal2101010(const glm::vec3& n)
+{
+    return ((uint32_t)ToSnorm(n.x, 10) & 0x3FFu) | (((uint32_t)ToSnorm(n.y, 10) & 0x3FFu) << 10)
+         | (((uint32_t)ToSnorm(n.z, 10) & 0x3FFu) << 20);
+}
+
+// encodes fat vertices into format; positionScale is what the decoded positions must be multiplied by
+inline std::vector<unsigned char> EncodeVertices(VertexFormat format, const std::vector<float>& V, float& positionScale)
+{
+    size_t count = V.size() / FAT_VERTEX_FLOATS, stride = VertexStride(format);
+    positionScale = 1.0f;
+    std::vector<unsigned char> out(count * stride);
+    if (format == VERTEX_FLOAT) {
+        std::memcpy(out.data(), V.data(), out.size());
+        return out;
+    }
+    if (format == VERTEX_SNORM16) {
+        float extent = 0.0f;
+        for (size_t v = 0; v < count; v++)
+            for (int c = 0; c < 3; c++)
+                extent = std::max(extent, std::fabs(V[v * FAT_VERTEX_FLOATS + c]));
+        positionScale = extent > 0.0f ? extent : 1.0f;
+    }
+    for (size_t v = 0; v < count; v++) {
+        const float* in = &V[v * FAT_VERTEX_FLOATS];
+        unsigned char* p = &out[v * stride];
+        if (format == VERTEX_SNORM16) {
+            int16_t position[4] = { (int16_t)ToSnorm(in[0] / positionScale, 16), (int16_t)ToSnorm(in[1] / positionScale, 16),
+                                    (int16_t)ToSnorm(in[2] / positionScale, 16), 0 };
+            std::memcpy(p, position, sizeof(position));
+            p += sizeof(position);
+        }
+        else {
+            std::memcpy(p, in, 3 * sizeof(float));
+            p += 3 * sizeof(float);
+        }
+        uint32_t normal = PackNormal2101010(glm::vec3(in[3], in[4], in[5]));
+        uint16_t uv[2] = { FloatToHalf(in[6]), FloatToHalf(in[7]) };
+        std::memcpy(p, &normal, sizeof(normal));
+        std::memcpy(p + sizeof(normal), uv, sizeof(uv));
+    }
+    return out;
+}
+
+// attributes 0..2 (position, normal, uv) for format, from the buffer bound to GL_ARRAY_BUFFER; the VAO must be bound
+inline void SetVertexAttributes(VertexFormat format)
+{
+    GLsizei stride = (GLsizei)VertexStride(format);
+    if (format == VERTEX_FLOAT) {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    }
+    else {
+        size_t positionBytes = format == VERTEX_SNORM16 ? 8 : 12;
+        if (format == VERTEX_SNORM16)
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)0);
+        else
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)positionBytes);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(positionBytes + 4));
+    }
+    for (unsigned int i = 0; i < 3; i++)
+        glEnableVertexAttribArray(i);
+}
+
+#endif